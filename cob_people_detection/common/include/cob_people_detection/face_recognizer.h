@@ -65,6 +65,7 @@
 #include <cob_people_detection/abstract_face_recognizer.h>
 #include <cob_people_detection/face_normalizer.h>
 #include <cob_people_detection/face_recognizer_algorithms.h>
+#include <cob_people_detection/training_data_archive.h>
 #else
 #include "cob_vision/cob_vision_ipa_utils/common/include/cob_vision_ipa_utils/MathUtils.h"
 #include "cob_vision/cob_sensor_fusion/common/include/cob_sensor_fusion/ColoredPointCloud.h"	// todo: necessary?
@@ -77,6 +78,9 @@
 // boost
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/locks.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 #include "boost/filesystem/path.hpp"
 #include "boost/lexical_cast.hpp"
 
@@ -84,6 +88,52 @@
 namespace ipa_PeopleDetector
 {
 
+/// Face normalizers for the recognition. FaceNormalizer keeps intermediate results of the current face,
+/// so every thread that normalizes faces takes its own normalizer from the pool and returns it afterwards.
+class FaceNormalizerPool
+{
+public:
+	/// Sets the configuration of the normalizers, normalizers created before are dropped.
+	/// @param classifier_directory Directory of the haarcascades
+	/// @param config Configuration of the normalizers
+	void init(const std::string& classifier_directory, const FaceNormalizer::FNConfig& config);
+
+	/// Takes an idle normalizer from the pool, a new one is created if all normalizers are in use.
+	FaceNormalizer* acquire();
+
+	/// Returns a normalizer of acquire() to the pool.
+	void release(FaceNormalizer* normalizer);
+
+protected:
+	std::string classifier_directory_; ///< Directory of the haarcascades
+	FaceNormalizer::FNConfig config_; ///< Configuration of the normalizers
+	std::vector<boost::shared_ptr<FaceNormalizer> > normalizers_; ///< All normalizers of the pool
+	std::vector<FaceNormalizer*> idle_; ///< Normalizers that are not in use
+	boost::mutex mutex_; ///< secures normalizers_ and idle_
+};
+
+/// Recognition model as it is used by the recognition functions. A published model is not modified anymore,
+/// training and updates build a new model that replaces the published one by a pointer swap.
+struct RecognitionModel
+{
+	RecognitionModel() :
+		incremental_updates(0)
+	{
+	}
+	;
+
+	boost::shared_ptr<FaceRecognizerBaseClass> color; ///< FaceRecognizer for color images
+	boost::shared_ptr<FaceRecognizer_Eigenfaces> coarse; ///< Low resolution FaceRecognizer that selects the candidates verified by color, empty if the cascade is disabled
+	std::vector<std::string> label_set; ///< All different labels of the model exactly once, label_set[i] is the name of class i (stored with the model)
+	std::vector<std::string> face_labels; ///< Labels of the training images in the order of the model features
+	std::vector<std::string> active_labels; ///< Labels served by the recognition, a subset of label_set in the order of label_set
+	std::vector<int> active_rows; ///< Model features of the served labels, empty if all labels are served
+	std::vector<bool> row_active; ///< Flags of the model features of the served labels, empty if all labels are served
+	boost::unordered_map<std::string, std::vector<int> > label_rows; ///< Model features of every served label, used by the verification of a single identity
+	int incremental_updates; ///< number of incremental updates since the last full training (stored with the model)
+};
+typedef boost::shared_ptr<RecognitionModel> RecognitionModelPtr;
+
 class FaceRecognizer: public AbstractFaceRecognizer
 {
 public:
@@ -98,7 +148,9 @@ public:
 	/// @param identification_labels_to_recognize A list of labels of persons that shall be recognized
 	/// @return Return code
 	virtual unsigned long init(std::string data_directory, int norm_size, bool norm_illumination, bool norm_align, bool norm_extreme_illumination, int metric, bool debug,
-			std::vector<std::string>& identification_labels_to_recognize, int subs_meth, int feature_dim, bool use_unknown_thresh, bool use_depth);
+			std::vector<std::string>& identification_labels_to_recognize, int subs_meth, int feature_dim, bool use_unknown_thresh, bool use_depth, bool use_float_model = false,
+			int gallery_index_probes = 0, int max_incremental_updates = 0, int quantized_candidates = 0, int cascade_size = 0, int cascade_feature_dim = 5,
+			int cascade_candidates = 20, bool parallel_matching = false, bool export_xml_model = false);
 
 	/// Initialization function for training purposes (only for capturing images, not the training of recognition models).
 	/// Parameters: see class member explanations.
@@ -124,6 +176,12 @@ public:
 	/// @return Return code
 	virtual unsigned long updateFaceLabels(std::string old_label, std::string new_label);
 
+	/// Updates the labels of several stored persons in one call, the faces are found through the label index.
+	/// @param old_labels The labels in the database which shall be replaced, the updates are applied in this order
+	/// @param new_labels The new labels, one per old label
+	/// @return Return code
+	virtual unsigned long updateFaceLabels(const std::vector<std::string>& old_labels, const std::vector<std::string>& new_labels);
+
 	/// Updates the label of a single face in the database.
 	/// @param index The index of the face in the database whose label shall be replaced by the new label
 	/// @param new_label The new label
@@ -136,32 +194,94 @@ public:
 	/// @return Return code
 	virtual unsigned long deleteFaces(std::string label, std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps);
 
+	/// Deletes all database entries of several persons. The faces are found through the label index and
+	/// m_face_labels, face_images, face_depthmaps and dm_exist are compacted in a single pass.
+	/// @param labels The labels of the database entries which shall be deleted
+	/// @param face_images Vector containing all trained images
+	/// @param face_depthmaps Depth maps of the faces marked in dm_exist
+	/// @return Return code
+	virtual unsigned long deleteFaces(const std::vector<std::string>& labels, std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps);
+
 	/// Deletes the database entry with the provided index.
 	/// @param index The index of the database entry which shall be deleted
 	/// @param face_images Vector containing all trained images
 	/// @return Return code
 	virtual unsigned long deleteFace(int index, std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps);
 
-	/// Saves the training data
+	/// Saves the training data into the packed training data archive (tdata.pack, tdata.index) of the data directory.
+	/// Only faces added, relabeled or deleted since the last save are written, see saveTrainingDataArchive.
+	/// Data directories in the former layout (tdata.xml with image files) are converted with training_data_converter.
 	/// @param face_images A vector containing all training images
 	/// @return Return code
 	virtual unsigned long saveTrainingData(std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps);
 	virtual unsigned long saveTrainingData(std::vector<cv::Mat>& face_images);
 
 	/// Trains a model for the recognition of a given set of faces.
+	/// The recognition continues with the previous model until the new model is published.
 	/// @param identification_indices_to_train List of labels whose corresponding faces shall be trained. If empty, all available data is used and this list is filled with the labels.
 	/// @return Return code
 	virtual unsigned long trainRecognitionModel(std::vector<std::string>& identification_labels_to_train);
 
-	/// Saves the currently trained model for the recognition of a given set of faces.
+	/// Saves the currently published model for the recognition of a given set of faces.
 	/// @return Return code
 	virtual unsigned long saveRecognitionModel();
 
-	/// Loads a model for the recognition of a given set of faces.
-	/// @param identification_labels_to_recognize List of labels whose corresponding faces shall be available for recognition
+	/// Loads a model for the recognition of a given set of faces. The requested labels are compared with the stored model as a set,
+	/// a subset of the stored labels is served by masking the other model features. The model is only updated or trained
+	/// if a requested label is missing in the stored model.
+	/// The recognition continues with the previous model until the new model is published.
+	/// @param identification_labels_to_recognize List of labels whose corresponding faces shall be available for recognition, receives the served labels
 	/// @return Return code
 	virtual unsigned long loadRecognitionModel(std::vector<std::string>& identification_labels_to_recognize);
 
+	/// Starts loadRecognitionModel on a background thread.
+	/// @param identification_labels_to_recognize List of labels whose corresponding faces shall be available for recognition
+	/// @return False if a background job is still running
+	bool startLoadingRecognitionModel(const std::vector<std::string>& identification_labels_to_recognize);
+
+	/// Returns true while the background job of startLoadingRecognitionModel is running.
+	bool isLoadingRecognitionModel();
+
+	/// Waits for the background job of startLoadingRecognitionModel.
+	/// @param identification_labels_to_recognize Labels of the loaded model
+	/// @return Return code of loadRecognitionModel, RET_FAILED if no job was started
+	unsigned long finishLoadingRecognitionModel(std::vector<std::string>& identification_labels_to_recognize);
+
+	/// Returns the progress of the running training or loading of a model.
+	/// @param progress Fraction of the work that is done (0..1)
+	/// @param status Description of the current step
+	void getTrainingProgress(double& progress, std::string& status);
+
+	/// Function to Recognize faces
+	/// Normalizes the faces of all heads in a frame and classifies them in a single batch.
+	/// @param color_images Source color images
+	/// @param depth_images Source depth images (xyz), indices correspond with color_images
+	/// @param face_coordinates Bounding boxes of detected faces, outer index corresponds to color_image index
+	/// @param identification_labels Vector of labels of classified faces, both indices correspond with face_coordinates
+	/// @return Return code
+	virtual unsigned long recognizeFaces(std::vector<cv::Mat>& color_images, std::vector<cv::Mat>& depth_images, std::vector<std::vector<cv::Rect> >& face_coordinates,
+			std::vector<std::vector<std::string> >& identification_labels);
+	using AbstractFaceRecognizer::recognizeFaces;
+
+	/// Verifies the faces of a frame against a single identity (1:1 verification), e.g. the person who is escorted.
+	/// Only the model features of that identity are compared, so the cost per face does not depend on the size of the gallery.
+	/// @param color_images Source color images
+	/// @param depth_images Source depth images (xyz), indices correspond with color_images
+	/// @param face_coordinates Bounding boxes of detected faces, outer index corresponds to color_image index
+	/// @param verification_label Label of the identity
+	/// @param verification_threshold Faces are accepted if their distance to the identity, relative to the unknown threshold of the model, is below this value
+	/// @param identification_labels verification_label for accepted faces, "Unknown" otherwise, both indices correspond with face_coordinates
+	/// @param distances Relative distances of the faces to the identity, both indices correspond with face_coordinates
+	/// @return Return code, RET_FAILED if no model is loaded or the model does not serve verification_label (see servesLabel)
+	unsigned long verifyFaces(std::vector<cv::Mat>& color_images, std::vector<cv::Mat>& depth_images, std::vector<std::vector<cv::Rect> >& face_coordinates,
+			const std::string& verification_label, double verification_threshold, std::vector<std::vector<std::string> >& identification_labels,
+			std::vector<std::vector<double> >& distances);
+
+	/// Checks whether the published recognition model serves a label, i.e. whether faces can be verified against it.
+	/// @param label Label of the identity
+	/// @return True if a model is loaded and serves label
+	bool servesLabel(const std::string& label);
+
 	enum Metrics
 	{
 		EUCLIDEAN, MAHALANOBIS, MAHALANOBISCOSINE
@@ -178,6 +298,97 @@ protected:
 	virtual unsigned long recognizeFace(cv::Mat& color_image, std::vector<cv::Rect>& face_coordinates, std::vector<std::string>& identification_labels);
 	virtual unsigned long recognizeFace(cv::Mat& color_image, cv::Mat& depth_image, std::vector<cv::Rect>& face_coordinates, std::vector<std::string>& identification_labels);
 
+	/// Normalizes face crops in parallel and converts them to probes for the recognition model.
+	/// @param color_images Source color images
+	/// @param depth_images Source depth images (xyz)
+	/// @param faces Index of the source image and bounding box of every face
+	/// @param probes Normalized faces (of type m_model_type), indices correspond with faces
+	void normalizeProbes(std::vector<cv::Mat>& color_images, std::vector<cv::Mat>& depth_images, const std::vector<std::pair<int, cv::Rect> >& faces,
+			std::vector<cv::Mat>& probes);
+
+	/// Classifies a batch of normalized faces. The model is only read, faces that are verified on their own
+	/// (cascade, subset of the labels) are classified in parallel, all others with one call to the recognition model.
+	/// @param model Recognition model
+	/// @param probes Normalized faces (of type m_model_type)
+	/// @param unknown_label Label that is assigned to unknown faces
+	/// @param identification_labels Labels of the classified faces, indices correspond with probes
+	void classifyProbes(RecognitionModel& model, std::vector<cv::Mat>& probes, const std::string& unknown_label, std::vector<std::string>& identification_labels);
+
+	/// Returns the published recognition model, the returned model stays valid while the caller holds the pointer.
+	RecognitionModelPtr currentModel();
+
+	/// Replaces the published recognition model, recognitions that are running finish with the previous model.
+	void publishModel(const RecognitionModelPtr& model);
+
+	/// Trains a new model for the recognition of a given set of faces, the published model is not changed.
+	/// @param identification_labels_to_train List of labels whose corresponding faces shall be trained. If empty, all available data is used and this list is filled with the labels.
+	/// @param model Trained model
+	/// @return Return code
+	unsigned long trainNewModel(std::vector<std::string>& identification_labels_to_train, RecognitionModelPtr& model);
+
+	/// Adds the persons in new_labels to a model without a full training, only their images are loaded.
+	/// The model must not be published.
+	/// @param model Model that is updated
+	/// @param new_labels Labels of the persons which are appended to model.label_set
+	/// @return Return code, RET_FAILED if the model does not support updates and has to be trained
+	unsigned long updateRecognitionModel(RecognitionModel& model, std::vector<std::string>& new_labels);
+
+	/// Reads the labels of the stored model from the binary model file or, if it is missing, from the XML export.
+	/// @param model Model that receives face_labels, label_set and incremental_updates
+	/// @param model_file Mapped binary model file, empty if the labels were read from XML
+	/// @return Return code, RET_FAILED if no model is stored or the model does not store the names of its classes
+	unsigned long readModelLabels(RecognitionModel& model, boost::shared_ptr<ModelFile>& model_file);
+
+	/// Checks that the stored class names (label_set) cover the labels of all model features.
+	/// @param model Model with the labels read by readModelLabels, they are cleared if the check fails
+	/// @param model_file File the labels were read from
+	/// @return Return code
+	unsigned long checkModelLabels(RecognitionModel& model, const boost::filesystem::path& model_file);
+
+	/// Loads the stored recognizers into a model whose labels have been read already.
+	/// @param model Model that receives the recognizers
+	/// @param in_memory Published model with the same training images whose recognizers are copied instead, e.g. to keep intermediate training results for updates, may be empty
+	/// @param model_file Mapped binary model file from readModelLabels, empty to load the XML export
+	/// @return Return code
+	unsigned long loadStoredModel(RecognitionModel& model, const RecognitionModelPtr& in_memory, const boost::shared_ptr<ModelFile>& model_file);
+
+	/// Selects the labels a model serves, the model features of the other labels are masked during the recognition.
+	/// @param model Model whose active_labels, active_rows, row_active and label_rows are set
+	/// @param labels Requested labels in any order, labels that are not in the model are ignored, empty to serve all labels
+	void setActiveLabels(RecognitionModel& model, const std::vector<std::string>& labels);
+
+	/// Saves a recognition model as binary model files (rdata_color.bin, rdata_coarse.bin) and as XML export if m_export_xml_model is set.
+	/// @param model Model that is saved
+	/// @return Return code
+	unsigned long saveRecognitionModel(RecognitionModel& model);
+
+	/// Writes a recognition model in the XML format (rdata_color.xml, rdata_coarse.xml).
+	/// @param model Model that is exported
+	/// @return Return code
+	unsigned long exportRecognitionModel(RecognitionModel& model);
+
+	/// Creates an untrained recognizer for color images with the configured method and settings.
+	FaceRecognizerBaseClass* createColorRecognizer();
+
+	/// Creates an untrained coarse cascade stage, 0 if the cascade is disabled.
+	FaceRecognizer_Eigenfaces* createCoarseRecognizer();
+
+	/// Body of the background thread of startLoadingRecognitionModel.
+	void loadingJob();
+
+	/// Sets the progress that is reported by getTrainingProgress.
+	void setTrainingProgress(double progress, const std::string& status);
+
+	/// Downscales normalized faces to the resolution of the coarse cascade stage.
+	/// @param images Normalized faces
+	/// @param coarse_images Downscaled faces (CV_64FC1), indices correspond with images
+	void resizeToCascade(std::vector<cv::Mat>& images, std::vector<cv::Mat>& coarse_images);
+
+	/// Loads the stored coarse cascade stage.
+	/// @param coarse Recognizer that receives the coarse stage
+	/// @return Return code, RET_FAILED if the stored stage is missing or was trained with a different resolution
+	unsigned long loadCoarseModel(FaceRecognizer_Eigenfaces& coarse);
+
 	/// Function to find the closest face class
 	/// The function calculates the distance of each sample image to the trained face class
 	/// @param eigen_vector_weights The weights of corresponding eigenvectors of projected test face
@@ -186,13 +397,47 @@ protected:
 	/// @return Return code
 	virtual unsigned long convertAndResize(cv::Mat& img, cv::Mat& resized, cv::Rect& face, cv::Size new_size);
 
+	/// Removes the marked faces from all parallel arrays of the face store in one pass and rebuilds the label index.
+	/// @param remove Flags of the faces in m_face_labels which are removed
+	/// @param face_images Vector containing all trained images
+	/// @param face_depthmaps Depth maps of the faces marked in dm_exist
+	void removeFaces(const std::vector<bool>& remove, std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps);
+
+	/// Rebuilds m_label_index from m_face_labels.
+	void rebuildLabelIndex();
+
 	/// Loads the training data for the persons specified in identification_labels_to_train
+	/// The label filter is resolved first, then the selected images and depth maps are decoded in parallel.
 	/// @param face_images A vector containing all training images
 	/// @param identification_indices_to_train List of labels whose corresponding faces shall be trained. If empty, all available data is used and this list is filled with the labels.
+	/// @param training_vectors If true, the images are returned as CV_64FC1 training vectors
 	/// @return Return code
-	virtual unsigned long loadTrainingData(std::vector<cv::Mat>& face_images, std::vector<std::string>& identification_labels_to_train);
+	virtual unsigned long loadTrainingData(std::vector<cv::Mat>& face_images, std::vector<std::string>& identification_labels_to_train, bool training_vectors = false);
 	virtual unsigned long loadTrainingData(std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps, std::vector<std::string>& identification_labels_to_train);
 
+	/// Saves the training data incrementally: new faces are appended to the archive, deletions and label changes are
+	/// journaled in its index. The index and the data file are compacted periodically. The archive is rewritten if the
+	/// faces do not correspond to its records, e.g. after the data of a former layout has been loaded.
+	/// @param face_images A vector containing all training images
+	/// @param face_depthmaps Depth maps, it ends with the depth maps of the faces added since the last save, 0 to save the images only
+	/// @return Return code
+	unsigned long saveTrainingDataArchive(std::vector<cv::Mat>& face_images, std::vector<cv::Mat>* face_depthmaps);
+
+	/// Writes a new archive with all faces.
+	/// @param face_images A vector containing all training images
+	/// @param face_depthmaps Depth maps of the faces marked in dm_exist, 0 to save the images only
+	/// @return Return code
+	unsigned long rewriteTrainingDataArchive(std::vector<cv::Mat>& face_images, std::vector<cv::Mat>* face_depthmaps);
+
+	/// Loads the training data from the packed training data archive (tdata.pack, tdata.index) of the data directory.
+	/// @param face_images A vector containing all training images
+	/// @param face_depthmaps Receives the normalized depth maps and sets dm_exist, 0 if depth maps are not loaded
+	/// @param identification_labels_to_train List of labels whose corresponding faces shall be loaded, see loadTrainingData
+	/// @param training_vectors If true, the images are converted to CV_64FC1 training vectors
+	/// @return Return code
+	unsigned long loadTrainingDataArchive(std::vector<cv::Mat>& face_images, std::vector<cv::Mat>* face_depthmaps, std::vector<std::string>& identification_labels_to_train,
+			bool training_vectors);
+
 	/// Function can be used to verify the existence of the data directory and created if it does not exist.
 	/// @bief Assertion of the data directory
 	/// @param[in] data_directory Path to top level directory with training data
@@ -203,17 +448,38 @@ protected:
 	std::vector<std::string> depth_str_labels_unique; ///< Vector for class unique label strings for depth training data
 	std::vector<int> depth_num_labels; ///< Number of classes for depth training data
 	//
-	FaceNormalizer face_normalizer_; ///< Face normalizer object
+	FaceNormalizer face_normalizer_; ///< Face normalizer of addFace and the training data loaders, secured by m_data_mutex
+	FaceNormalizerPool m_probe_normalizers; ///< Face normalizers of the recognition threads
+	TrainingDataArchive m_training_archive; ///< Archive of the stored training data, its index follows the saved changes
+	std::vector<int> m_archive_records; ///< Archive record of each face in m_face_labels, -1 if the face has not been saved yet
 
 	ipa_PeopleDetector::FaceRecognizerBaseClass* eff_depth; ///< FaceRecognizer for depth maps
-	ipa_PeopleDetector::FaceRecognizerBaseClass* eff_color; ///< FaceRecognizer for color images
-	std::vector<int> m_label_num;
+	RecognitionModelPtr m_model; ///< published recognition model, empty if no model is loaded
 	int m_rec_method; ///< flag for recognition method
-	std::vector<bool> dm_exist; ///< vector indicating if depth map exists for corresponding color image
+	std::vector<bool> dm_exist; ///< vector indicating if the depth map of the corresponding color image is held in face_depthmaps
+	typedef boost::unordered_map<std::string, std::vector<int> > LabelIndex;
+	LabelIndex m_label_index; ///< ascending indices of the faces in m_face_labels per label
 	bool m_depth_mode; ///< flag indicates if depth maps are ignored or used for classification
 	ipa_PeopleDetector::Method m_subs_meth; ///< recognition method
 	bool m_use_unknown_thresh; ///< flag indicates if unknown threshold is used
+	int m_model_type; ///< precision of the recognition model and the probes (CV_64FC1 or CV_32FC1)
+	int m_max_incremental_updates; ///< number of incremental model updates before a full training is enforced, 0 disables updates
+	int m_gallery_index_probes; ///< number of gallery index lists searched per face, 0 = exact search
+	int m_quantized_candidates; ///< number of candidates of the quantized gallery compared in full precision, 0 = off
+	bool m_parallel_matching; ///< match large galleries in parallel shards
+	bool m_export_xml_model; ///< additionally write the model in the XML format, the binary model file is always written
+	int m_cascade_size; ///< width and height of the faces in the coarse cascade stage, 0 disables the cascade
+	int m_cascade_feature_dim; ///< feature dimension of the coarse cascade stage
+	int m_cascade_candidates; ///< number of training images passed from the coarse stage to the full model
 	unsigned long trainFaceRecognition(ipa_PeopleDetector::FaceRecognizerBaseClass* eff, std::vector<cv::Mat>& data, std::vector<int>& labels);
+
+	// background loading of a model
+	boost::thread* m_training_thread; ///< thread of startLoadingRecognitionModel, 0 if no job was started
+	bool m_job_running; ///< true while the background job is running
+	std::vector<std::string> m_job_labels; ///< labels requested from the background job, the labels of the loaded model when it is done
+	unsigned long m_job_result; ///< return code of the background job
+	double m_training_progress; ///< progress of the running training (0..1)
+	std::string m_training_status; ///< current step of the running training
 	//----------------------------------------------------
 	//----------------------------------------------------
 
@@ -225,12 +491,14 @@ protected:
 	cv::Mat m_projected_training_faces; ///< Projected training faces (coefficients for the eigenvectors of the face subspace)
 	std::vector<std::string> m_face_labels; ///< A vector containing the corresponding labels to each face image projection in m_projected_training_faces (m_face_labels[i] stores the corresponding name to the face representation in the face subspace in m_projected_training_faces.rows(i))
 	cv::Mat m_face_class_average_projections; ///< The average factors of the eigenvector decomposition from each face class; The average factors from each face class originating from the eigenvector decomposition.
-	std::vector<std::string> m_current_label_set; ///< A vector containing all different labels from the training session exactly once, order of appearance matters! (m_current_label_set[i] stores the corresponding name to the average face coordinates in the face subspace in m_face_class_average_projections.rows(i))
 	cv::SVM m_face_classifier; ///< classifier for the identity of a person
 	boost::filesystem::path m_data_directory; ///< folder that contains the training data
 
 	// mutex
-	boost::mutex m_data_mutex; ///< secures the internal data variables against usage during training
+	boost::mutex m_data_mutex; ///< secures the training data (m_face_labels, m_label_index, dm_exist, m_training_archive, face_normalizer_) while it is loaded or changed
+	boost::mutex m_model_mutex; ///< secures the pointer m_model, only held for the swap
+	boost::mutex m_training_mutex; ///< allows only one training or loading of a model at a time
+	boost::mutex m_progress_mutex; ///< secures the state of the background job and the progress
 
 	// parameters
 	int m_norm_size; ///< Desired width and height of the Eigenfaces (=eigenvectors).
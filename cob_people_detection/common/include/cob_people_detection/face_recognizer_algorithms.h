@@ -7,8 +7,12 @@
 #include<limits>
 
 #include<cob_people_detection/subspace_analysis.h>
+#include<cob_people_detection/gallery_index.h>
+#include<cob_people_detection/quantized_gallery.h>
+#include<cob_people_detection/model_file.h>
 
 #include<boost/filesystem.hpp>
+#include<boost/shared_ptr.hpp>
 #include<boost/lexical_cast.hpp>
 
 namespace ipa_PeopleDetector
@@ -24,12 +28,26 @@ enum Method
 	NONE, METH_FISHER, METH_EIGEN, METH_LDA2D, METH_PCA2D
 };
 
+class FaceRecognizerBaseClass;
+
+/// Creates an untrained recognizer of a subspace method.
+/// @param method Subspace method, Fisherfaces for NONE
+/// @return Recognizer allocated with new, the caller takes the ownership
+FaceRecognizerBaseClass* createRecognizer(Method method);
+
+/// Converts the name of a subspace method (FISHER, EIGEN, LDA2D or PCA2D) to a Method.
+/// @param name Name of the method
+/// @param method Converted method, NONE if the name is unknown
+/// @return False if the name is unknown
+bool parseMethod(const std::string& name, Method& method);
+
 class FaceRecognizerBaseClass
 {
 public:
 	/// Constructor
 	FaceRecognizerBaseClass() :
-		use_unknown_thresh_(false), trained_(false)
+		use_unknown_thresh_(false), model_type_(CV_64FC1), gallery_index_probes_(0), quantized_candidates_(0), parallel_matching_(false), use_incremental_updates_(false),
+				trained_(false)
 	{
 	}
 	;
@@ -48,6 +66,29 @@ public:
 	/// @return True when training was successful
 	virtual bool trainModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec, int& target_dim)=0;
 
+	/// Method to add samples to a trained model without retraining on the whole data set.
+	/// The labels have to continue the numbering of the model, i.e. known classes or the next free class indices.
+	/// The default implementation does not support updates.
+	/// @brief Method for incremental model updates.
+	/// @param[in] img_vec Vector of new image matrices (CV_64FC1)
+	/// @param[in] label_vec Vector of labels of the new images
+	/// @return True when the model was updated, false when a full training is necessary
+	virtual bool updateModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec)
+	{
+		return false;
+	}
+	;
+
+	/// Method to copy a trained model including the state for incremental updates, the copy shares no
+	/// data with the original, i.e. it can be updated while the original is still used for recognition.
+	/// The default implementation does not support copies.
+	/// @return New recognizer owned by the caller, 0 if the model can not be copied
+	virtual FaceRecognizerBaseClass* clone() const
+	{
+		return 0;
+	}
+	;
+
 	/// Abstract method to classifiy image.
 	/// @brief Abstract method for classification.
 	/// @param[in] src_vec Vector of image matrices
@@ -64,12 +105,46 @@ public:
 	/// for all classes in dataset
 	virtual void classifyImage(cv::Mat& probe_mat, int& max_prob_index, cv::Mat& classification_probabilities)=0;
 
+	/// Method to classify a batch of images, e.g. all faces of a frame, at once.
+	/// The default implementation classifies the images one by one, derived classes
+	/// may project and match the whole batch at once.
+	/// @brief Method for batch classification.
+	/// @param[in] probe_mats Images that are classified
+	/// @param[out] max_prob_indices Index of most probable label for each image
+	virtual void classifyImages(std::vector<cv::Mat>& probe_mats, std::vector<int>& max_prob_indices);
+
+	/// Method to classify an image by comparing it only to a subset of the model features,
+	///  e.g. the candidates of a coarse recognition stage. The model is not changed, so
+	///  several threads may classify with the same recognizer at once.
+	/// @brief Method for the verification of candidates.
+	/// @param[in] probe_mat Image that is classified
+	/// @param[in] rows Indices of the model features (training images) that are compared
+	/// @param[out] max_prob_index Index of most probable label
+	void classifyCandidates(cv::Mat& probe_mat, const std::vector<int>& rows, int& max_prob_index);
+
+	/// Method to verify an image against a single identity (1:1 verification) by comparing it only to
+	///  the model features of that identity. The model is not changed, so several threads may verify
+	///  with the same recognizer at once.
+	/// @brief Method for the verification of an identity.
+	/// @param[in] probe_mat Image that is verified
+	/// @param[in] rows Indices of the model features (training images) of the identity, must not be empty
+	/// @return Distance to the nearest of these model features relative to the "unknown" threshold (1 = threshold)
+	double verifyCandidates(cv::Mat& probe_mat, const std::vector<int>& rows);
+
 	/// Abstract method to save recognition model.
 	virtual bool saveModel(boost::filesystem::path& model_file)=0;
 
 	/// Abstract method to load recognition model.
 	virtual bool loadModel(boost::filesystem::path& model_file)=0;
 
+	/// Abstract method to add the recognition model to a binary model file, the gallery index is saved next to the file.
+	virtual void writeModel(ModelFileWriter& writer)=0;
+
+	/// Abstract method to load the recognition model from a mapped binary model file.
+	/// Model matrices that are stored with the model type are used in place, the recognizer keeps the mapping alive.
+	/// @return False if the file does not contain a model of this type
+	virtual bool readModel(const boost::shared_ptr<ModelFile>& model_file)=0;
+
 	///  Method to activate usage of "unknown" threshold
 	inline virtual void activate_unknown_treshold()
 	{
@@ -77,6 +152,60 @@ public:
 	}
 	;
 
+	///  Method to keep the intermediate training results that are necessary for updateModel.
+	/// Has to be called before training.
+	inline virtual void activate_incremental_updates()
+	{
+		use_incremental_updates_ = true;
+	}
+	;
+
+	/// Method to select the precision of the stored model and of the projection and distance kernels.
+	/// Training is always computed in double precision, the result is converted afterwards.
+	/// Has to be called before training or loading a model.
+	/// @param[in] model_type CV_64FC1 (default) or CV_32FC1
+	inline virtual void set_model_type(int model_type)
+	{
+		model_type_ = model_type;
+	}
+	;
+
+	/// Method to activate the approximate nearest neighbour search over the model features.
+	/// Has to be called before training or loading a model.
+	/// @param[in] num_probes Number of index lists that are searched per probe (recall/latency trade-off), 0 selects the exact search
+	inline virtual void set_gallery_index_probes(int num_probes)
+	{
+		gallery_index_probes_ = num_probes;
+	}
+	;
+
+	/// Method to activate the pre-selection of candidates with the 8 bit quantized model features.
+	/// Only the selected candidates are compared in full precision.
+	/// Has to be called before training or loading a model.
+	/// @param[in] num_candidates Number of candidates that are re-ranked per probe, 0 disables the quantized gallery
+	inline virtual void set_quantized_candidates(int num_candidates)
+	{
+		quantized_candidates_ = num_candidates;
+	}
+	;
+
+	/// Method to activate the exact matching of a probe against the model features in parallel shards.
+	/// Galleries that fit into a single shard are still matched sequentially.
+	/// @param[in] parallel_matching True to split the exact search over the worker threads
+	inline virtual void set_parallel_matching(bool parallel_matching)
+	{
+		parallel_matching_ = parallel_matching;
+	}
+	;
+
+	/// Computes the squared distances of a probe to the model features with indices begin..end-1.
+	/// Called concurrently for disjoint ranges by matchShards.
+	/// @param[in] probe Continuous probe feature of the model type
+	/// @param[in] begin First model feature
+	/// @param[in] end Model feature behind the last one
+	/// @param[out] sq_distances Squared distances, end-begin values
+	virtual void calcShardDistances(const cv::Mat& probe, int begin, int end, double* sq_distances)=0;
+
 	bool trained_; ///< Flag indicates whether model is trained and ready for recognition.
 protected:
 
@@ -104,6 +233,21 @@ protected:
 	/// @param[out] probabilities Classification probabilities for all classes in dataset
 	virtual void calcDIFS(cv::Mat& probe_mat, int& minDIFSindex, double& minDIFS, cv::Mat& probabilities)=0;
 
+	/// Abstract method to classify an image, optionally comparing it only to a subset of the model features.
+	/// @param[in] probe_mat Image that is classified
+	/// @param[in] rows Indices of the model features that are compared, 0 to search the whole model
+	/// @param[out] max_prob_index Index of most probable label
+	/// @param[out] classification_probabilities Classification probabilities for all classes in dataset
+	virtual void classifyRestricted(cv::Mat& probe_mat, const std::vector<int>* rows, int& max_prob_index, cv::Mat& classification_probabilities)=0;
+
+	/// Abstract method to project an image into the feature space and to find the nearest model feature.
+	/// @param[in] probe_mat Image that is compared to the model features
+	/// @param[in] rows Indices of the model features that are compared, 0 to search the whole model
+	/// @param[out] minDIFSindex Index of the nearest model feature
+	/// @param[out] minDIFS Distance to the nearest model feature
+	/// @param[out] classification_probabilities Classification probabilities for all classes in dataset
+	virtual void matchRestricted(cv::Mat& probe_mat, const std::vector<int>* rows, int& minDIFSindex, double& minDIFS, cv::Mat& classification_probabilities)=0;
+
 	/// Abstract method for the calculation of the "unknown" threshold
 	/// @brief Calculation of unknown threshold.
 	/// @param[in] data Matrix containing model features as matrix-rows.
@@ -115,6 +259,70 @@ protected:
 	/// @param[in] data Vector containing model features as matrices.
 	/// @param[out] thresh Value for "unknown" threshold.
 	virtual void calc_threshold(std::vector<cv::Mat>& data, double& thresh)=0;
+
+	/// Calculates the "unknown" threshold from the Gram matrix of the model features.
+	/// The pairwise distances are expanded as |x|^2+|y|^2-2<x,y> and evaluated block-wise
+	/// in parallel, at most threshold_block_elements distances are held per block.
+	/// @param[in] data Matrix containing model features as matrix-rows.
+	/// @param[in] squared Use squared distances instead of Euclidean distances.
+	/// @param[in] factor Threshold is factor*(P+D) with the nearest inter-class distance P and the largest intra-class distance D of a class.
+	/// @param[out] thresh Value for "unknown" threshold.
+	void calcThresholdGram(cv::Mat& data, bool squared, double factor, double& thresh);
+
+	static const int threshold_block_elements = 1 << 20; ///< Maximal number of distances per block of the threshold computation.
+
+	/// Exact search of the nearest model feature and the minimal squared distance to every class.
+	/// The model features are split into shards of at most match_shard_bytes that are matched in
+	/// parallel, every shard reduces into its own slot and the slots are merged afterwards.
+	/// @param[in] probe Continuous probe feature of the model type
+	/// @param[in] num_features Number of model features
+	/// @param[in] feature_bytes Size of one model feature in bytes
+	/// @param[out] min_index Index of the nearest model feature
+	/// @param[out] min_sq_dist Squared distance to the nearest model feature
+	/// @param[out] class_min_sq_dist Minimal squared distance to every class
+	/// @return False if parallel matching is off or the gallery fits into one shard, the caller has to match sequentially then
+	bool matchShards(const cv::Mat& probe, int num_features, size_t feature_bytes, int& min_index, double& min_sq_dist, std::vector<double>& class_min_sq_dist);
+
+	static const int match_shard_bytes = 1 << 18; ///< Maximal size of the model features matched by one task, about the size of a L2 cache.
+
+	/// Converts all model matrices to model_type_ and updates data derived from them.
+	/// Has to be called after training and loading.
+	virtual void convertModel()=0;
+
+	/// Builds the approximate nearest neighbour index and the quantized gallery over the model features if they are activated.
+	virtual void buildGalleryIndex()=0;
+
+	/// Reads the index and the quantized gallery stored in model_file or rebuilds them if they are missing or outdated.
+	void readGalleryIndex(const ModelFile& model_file, int num_features, int dim);
+
+	/// Adds the index and the quantized gallery to the sections written by writer.
+	void writeGalleryIndex(ModelFileWriter& writer);
+
+	/// Loads the index and the quantized gallery stored in an XML model file or rebuilds them if they are missing or outdated.
+	void loadGalleryIndex(cv::FileStorage& fs, int num_features, int dim);
+
+	/// Saves the index and the quantized gallery into an XML model file.
+	void saveGalleryIndex(cv::FileStorage& fs);
+
+	/// Selects the model features that are compared to a probe in full precision.
+	/// @param[in] probe Probe feature
+	/// @param[in] rows Model features given by the caller (e.g. a coarse recognition stage) which are used as they are, 0 otherwise
+	/// @param[out] candidates Indices of the selected model features
+	/// @return False if all model features have to be compared
+	bool selectCandidates(cv::Mat& probe, const std::vector<int>* rows, std::vector<int>& candidates);
+
+	/// Returns true if the search is narrowed down by the index or the quantized gallery.
+	bool useCandidates()
+	{
+		return (gallery_index_probes_ > 0 && !gallery_index_.empty()) || (quantized_candidates_ > 0 && !quantized_gallery_.empty());
+	}
+	;
+
+	/// Appends the labels of new samples to model_label_vec_ and updates num_classes_.
+	/// @param[in] label_vec Labels of the new samples
+	/// @return False (without changes) if the labels do not continue the numbering of the model
+	bool appendLabels(std::vector<int>& label_vec);
+
 	/// Method that checks input parameters for filetype and usable
 	/// dimensions
 	/// @return False when input parameter check detects invalid parameters
@@ -141,6 +349,14 @@ protected:
 	cv::Mat eigenvalues_; ///< Eigenvalues from Eigenvalue decomposition of training set.
 	std::vector<int> model_label_vec_; ///< Vector containing labels of training set.
 	bool use_unknown_thresh_; ///< When true unknown idendities are considered.
+	int model_type_; ///< Precision of the model matrices (CV_64FC1 or CV_32FC1).
+	GalleryIndex gallery_index_; ///< Approximate nearest neighbour index over the model features.
+	int gallery_index_probes_; ///< Number of index lists searched per probe, 0 disables the index.
+	QuantizedGallery quantized_gallery_; ///< 8 bit quantized model features for the pre-selection of candidates.
+	int quantized_candidates_; ///< Number of candidates re-ranked in full precision, 0 disables the quantized gallery.
+	bool parallel_matching_; ///< When true the exact search is split into shards that are matched in parallel.
+	bool use_incremental_updates_; ///< When true the state for updateModel is kept after training.
+	boost::shared_ptr<ModelFile> mapped_model_; ///< Mapped model file the model matrices refer to after readModel, empty otherwise.
 };
 
 class FaceRecognizer1D: public FaceRecognizerBaseClass
@@ -163,6 +379,7 @@ public:
 	virtual void extractFeatures(cv::Mat& src_vec, cv::Mat& proj_mat, cv::Mat& coeff_vec);
 	virtual void classifyImage(cv::Mat& probe_mat, int& max_prob_index);
 	virtual void classifyImage(cv::Mat& probe_mat, int& max_prob_index, cv::Mat& classification_probabilities);
+	virtual void classifyImages(std::vector<cv::Mat>& probe_mats, std::vector<int>& max_prob_indices);
 	virtual void calcDIFS(cv::Mat& probe_mat, int& minDIFSindex, double& minDIFS, cv::Mat& probabilities);
 	virtual void calc_threshold(cv::Mat& data, double& thresh);
 	virtual void calc_threshold(std::vector<cv::Mat>& data, double& thresh)
@@ -172,12 +389,63 @@ public:
 
 	virtual bool saveModel(boost::filesystem::path& model_file);
 	virtual bool loadModel(boost::filesystem::path& model_file);
+	virtual void writeModel(ModelFileWriter& writer);
+	virtual bool readModel(const boost::shared_ptr<ModelFile>& model_file);
 
 	virtual void model_data_mat(std::vector<cv::Mat>& input_data, cv::Mat& data_mat);
 
+	/// Ranks the model features by their distance to an image, used as coarse stage of a recognition cascade.
+	/// @param[in] probe_mat Image that is compared to the model features
+	/// @param[in] num_candidates Maximal number of returned model features
+	/// @param[out] rows Indices of the nearest model features, ordered by distance
+	/// @return False if the image is rejected as unknown (only when the unknown threshold is used)
+	bool rankCandidates(cv::Mat& probe_mat, int num_candidates, std::vector<int>& rows);
+
+	virtual void calcShardDistances(const cv::Mat& probe, int begin, int end, double* sq_distances);
+
 protected:
+	virtual void classifyRestricted(cv::Mat& probe_mat, const std::vector<int>* rows, int& max_prob_index, cv::Mat& classification_probabilities);
+	virtual void matchRestricted(cv::Mat& probe_mat, const std::vector<int>* rows, int& minDIFSindex, double& minDIFS, cv::Mat& classification_probabilities);
+
+	/// DIFS calculation restricted to the model features in rows, the whole model is searched if rows is 0.
+	void calcDIFS(cv::Mat& probe_mat, const std::vector<int>* rows, int& minDIFSindex, double& minDIFS, cv::Mat& probabilities);
+
+	/// Computes the squared Euclidean distances of all probe features to all model features at once as
+	/// ||p||^2 - 2*p*G^T + ||g||^2 using a single GEMM and the precomputed model norms.
+	/// @param[in] probe_mat Probe features as matrix-rows
+	/// @param[out] sq_distances Matrix with probe_mat.rows rows and model_features_.rows columns
+	void calcSquaredDistances(cv::Mat& probe_mat, cv::Mat& sq_distances);
+
+	/// Computes the squared Euclidean distances of one probe feature to a subset of the model features.
+	/// @param[in] probe_row Probe feature (one row)
+	/// @param[in] rows Indices of the model features
+	/// @param[out] sq_distances Squared distances, indices correspond with rows
+	void calcSquaredDistances(cv::Mat& probe_row, const std::vector<int>& rows, std::vector<double>& sq_distances);
+
+	/// Determines the nearest model feature and the minimal distance to every class in a single pass.
+	/// @param[in] sq_distances Squared distances to the model features
+	/// @param[in] rows Model feature indices corresponding with sq_distances, 0 if sq_distances covers all model features in order
+	/// @param[in] count Number of distances
+	/// @param[out] minDIFSindex Index of the minimal distance
+	/// @param[out] minDIFS Minimal (Euclidean) distance
+	/// @param[out] probabilities Classification probabilities for all classes in dataset
+	void reduceDistances(const double* sq_distances, const int* rows, int count, int& minDIFSindex, double& minDIFS, cv::Mat& probabilities);
+
+	/// Converts the minimal squared distances to every class to classification probabilities (proportional to 1/distance^2).
+	void classProbabilities(const std::vector<double>& class_min_sq_dist, cv::Mat& probabilities);
+
+	/// Precomputes the squared norms of the model features, has to be called whenever model_features_ changes.
+	void calcModelNorms();
+
+	/// Replaces the model matrices by deep copies, used by clone() after the copy construction.
+	virtual void detachModel();
+
+	virtual void convertModel();
+	virtual void buildGalleryIndex();
+
 	cv::Mat average_arr_;
 	cv::Mat model_features_;
+	cv::Mat model_sq_norms_; ///< Squared norms of the model features (1 x model_features_.rows)
 
 };
 
@@ -189,6 +457,7 @@ public:
 	virtual void extractFeatures(cv::Mat& src_vec, cv::Mat& proj_mat, cv::Mat& coeff_vec);
 	virtual void classifyImage(cv::Mat& probe_mat, int& max_prob_index, cv::Mat& classification_probabilities);
 	virtual void classifyImage(cv::Mat& probe_mat, int& max_prob_index);
+	virtual void classifyImages(std::vector<cv::Mat>& probe_mats, std::vector<int>& max_prob_indices);
 	virtual void calcDIFS(cv::Mat& probe_mat, int& minDIFSindex, double& minDIFS, cv::Mat& probabilities);
 	virtual void calc_threshold(cv::Mat& data, double& thresh)
 	{
@@ -198,10 +467,33 @@ public:
 
 	virtual bool saveModel(boost::filesystem::path& model_file);
 	virtual bool loadModel(boost::filesystem::path& model_file);
+	virtual void writeModel(ModelFileWriter& writer);
+	virtual bool readModel(const boost::shared_ptr<ModelFile>& model_file);
+
+	virtual void calcShardDistances(const cv::Mat& probe, int begin, int end, double* sq_distances);
 
 protected:
+	virtual void classifyRestricted(cv::Mat& probe_mat, const std::vector<int>* rows, int& max_prob_index, cv::Mat& classification_probabilities);
+	virtual void matchRestricted(cv::Mat& probe_mat, const std::vector<int>* rows, int& minDIFSindex, double& minDIFS, cv::Mat& classification_probabilities);
+
+	/// DIFS calculation restricted to the model features in rows, the whole model is searched if rows is 0.
+	void calcDIFS(cv::Mat& probe_mat, const std::vector<int>* rows, int& minDIFSindex, double& minDIFS, cv::Mat& probabilities);
+
+	virtual void convertModel();
+	virtual void buildGalleryIndex();
+
+	/// Copies the model features into model_tensor_ and lets model_features_ refer to its rows.
+	void packModelFeatures();
+
+	/// Fused squared Frobenius distance between a probe feature and one model feature, no temporaries are allocated.
+	/// @param[in] probe Continuous probe feature of the model type
+	/// @param[in] m Index of the model feature
+	/// @return Squared Frobenius distance
+	double sqFrobeniusDistance(const cv::Mat& probe, int m);
+
 	cv::Mat average_mat_;
-	std::vector<cv::Mat> model_features_;
+	std::vector<cv::Mat> model_features_; ///< Model feature matrices, headers into the rows of model_tensor_
+	cv::Mat model_tensor_; ///< Contiguous gallery, one flattened feature matrix per row (model type)
 };
 
 class FaceRecognizer_Eigenfaces: public FaceRecognizer1D
@@ -216,6 +508,8 @@ public:
 	}
 	;
 	virtual bool trainModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec, int& target_dim);
+	virtual bool updateModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec);
+	virtual FaceRecognizerBaseClass* clone() const;
 };
 
 class FaceRecognizer_Fisherfaces: public FaceRecognizer1D
@@ -230,9 +524,25 @@ public:
 	}
 	;
 	virtual bool trainModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec, int& target_dim);
+	virtual bool updateModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec);
+	virtual FaceRecognizerBaseClass* clone() const;
+	virtual bool saveModel(boost::filesystem::path& model_file);
+	virtual bool loadModel(boost::filesystem::path& model_file);
+	virtual void writeModel(ModelFileWriter& writer);
+	virtual bool readModel(const boost::shared_ptr<ModelFile>& model_file);
 
 protected:
+	virtual void detachModel();
+
+	/// Keeps a stored PCA stage if incremental updates are activated and it matches the model, releases it otherwise.
+	void checkPCAStage(const std::string& model_file);
+
 	SubspaceAnalysis::LDA lda_;
+
+	// PCA stage of the last training, only kept when incremental updates are activated (saved with the model then)
+	cv::Mat pca_projection_; ///< PCA eigenvectors as rows
+	cv::Mat pca_eigenvalues_; ///< PCA eigenvalues
+	cv::Mat pca_features_; ///< Training samples projected onto the PCA eigenvectors
 };
 
 class FaceRecognizer_LDA2D: public FaceRecognizer2D
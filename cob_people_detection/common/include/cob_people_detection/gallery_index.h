@@ -0,0 +1,80 @@
+#ifndef GALLERY_INDEX_H_
+#define GALLERY_INDEX_H_
+
+#include<opencv/cv.h>
+#include<iostream>
+#include<vector>
+
+#include<cob_people_detection/model_file.h>
+
+namespace ipa_PeopleDetector
+{
+
+/// Inverted file (IVF) index for approximate nearest neighbour search over the model features.
+/// The features are clustered with k-means into about sqrt(n) lists. A query only visits the
+/// lists of the num_probes nearest centroids, so num_probes trades recall against latency.
+/// Small galleries are not indexed and have to be searched exhaustively.
+class GalleryIndex
+{
+public:
+	GalleryIndex();
+
+	/// Builds the index over the rows of features, any previous index is discarded.
+	/// @param[in] features Model features as matrix-rows
+	void build(const cv::Mat& features);
+
+	/// Collects the candidate rows for a probe.
+	/// @param[in] probe Probe feature (one row)
+	/// @param[in] num_probes Number of lists that are visited
+	/// @param[out] candidates Indices of the model feature rows in the visited lists
+	/// @return False if the index cannot narrow down the search, i.e. the exact search has to be used
+	bool search(const cv::Mat& probe, int num_probes, std::vector<int>& candidates) const;
+
+	/// Adds the index to the sections of a model file, so that it is written together with the model.
+	void write(ModelFileWriter& writer) const;
+
+	/// Reads the index from the sections of a model file.
+	/// @param[in] model_file Model file
+	/// @param[in] num_features Number of model features the index has to cover
+	/// @param[in] dim Dimension of the model features, i.e. the width of the centroids
+	/// @return False if the model file contains no index or it does not match the model
+	bool read(const ModelFile& model_file, int num_features, int dim);
+
+	/// Saves the index as node of an XML model file.
+	void save(cv::FileStorage& fs) const;
+
+	/// Loads the index from the node of an XML model file.
+	/// @param[in] node Node written by save()
+	/// @param[in] num_features Number of model features the index has to cover
+	/// @param[in] dim Dimension of the model features, i.e. the width of the centroids
+	/// @return False if the node is missing or does not match the model
+	bool load(const cv::FileNode& node, int num_features, int dim);
+
+	/// Discards the index.
+	void clear();
+
+	/// Returns true if no index is available.
+	bool empty() const
+	{
+		return lists_.size() == 0;
+	}
+	;
+
+	static const int min_gallery_size = 64; ///< Galleries with less features are searched exhaustively.
+
+protected:
+	/// Sets the index from the stored centroids and the list assignment of every feature.
+	/// @return False (index cleared) if they do not match the model
+	bool assign(const cv::Mat& centroids, const cv::Mat& assignments, int num_features, int dim);
+
+	/// List assignment of every feature as one column (CV_32SC1).
+	cv::Mat assignments() const;
+
+	cv::Mat centroids_; ///< Cluster centers as matrix-rows (CV_32FC1)
+	std::vector<std::vector<int> > lists_; ///< Model feature indices assigned to each cluster
+	int num_features_; ///< Number of indexed model features
+};
+
+}
+;
+#endif
@@ -0,0 +1,156 @@
+#ifndef MODEL_FILE_H_
+#define MODEL_FILE_H_
+
+#include<opencv/cv.h>
+#include<iostream>
+#include<string>
+#include<vector>
+
+#include<stdint.h>
+
+#include<boost/filesystem.hpp>
+
+namespace ipa_PeopleDetector
+{
+
+/// Versioned binary container for recognition models.
+/// The file consists of a header, a table of named sections and the section data. Every section holds
+/// one continuous matrix whose data starts at a multiple of section_alignment bytes, so the file can be
+/// mapped into memory and the matrices are used in place without parsing or copying.
+/// Layout (host byte order):
+///   header:  magic "FRMF", version, byte order tag, number of sections, file size
+///   table:   name, rows, cols, type, offset and size of each section
+///   data:    section data, aligned to section_alignment bytes
+class ModelFile
+{
+public:
+	ModelFile();
+
+	/// Unmaps the file, matrices that refer to the mapping must not be used afterwards.
+	~ModelFile();
+
+	/// Maps a model file into memory and checks its structure.
+	/// The mapping is private, i.e. writes to the returned matrices never reach the file.
+	/// @param[in] model_file File that is mapped
+	/// @return False if the file is missing, has another version or is damaged
+	bool open(const boost::filesystem::path& model_file);
+
+	/// Returns true if a file has been mapped.
+	bool isOpen() const
+	{
+		return data_ != 0;
+	}
+	;
+
+	/// Returns true if the file contains a section.
+	bool contains(const std::string& name) const;
+
+	/// Returns a matrix header that refers to the mapped section data.
+	/// @param[in] name Name of the section
+	/// @param[out] mat Matrix of the section, valid as long as this object exists
+	/// @return False if the section is missing
+	bool getMat(const std::string& name, cv::Mat& mat) const;
+
+	/// Reads a section with a single integer.
+	bool getInt(const std::string& name, int& value) const;
+
+	/// Reads a section with a single floating point value.
+	bool getDouble(const std::string& name, double& value) const;
+
+	/// Reads a section with a list of strings.
+	bool getStrings(const std::string& name, std::vector<std::string>& strings) const;
+
+	/// Path of the mapped file.
+	const boost::filesystem::path& path() const
+	{
+		return path_;
+	}
+	;
+
+	/// Returns true if a file starts with the magic number of a model file.
+	static bool isModelFile(const boost::filesystem::path& model_file);
+
+	static const char magic[4]; ///< Magic number at the start of every model file
+	static const uint32_t version = 1; ///< Version of the file layout, files of other versions are not read
+	static const uint32_t byte_order_tag = 0x01020304; ///< Detects files written with another byte order
+	static const int section_alignment = 64; ///< Alignment of the section data in bytes (cache line, SIMD loads)
+	static const int section_name_length = 48; ///< Maximal length of a section name including the terminating zero
+
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t byte_order;
+		uint32_t num_sections;
+		uint64_t file_size;
+	};
+
+	struct Section
+	{
+		char name[section_name_length];
+		int32_t rows;
+		int32_t cols;
+		int32_t type;
+		int32_t reserved;
+		uint64_t offset;
+		uint64_t bytes;
+	};
+
+protected:
+	/// Unmaps the file.
+	void close();
+
+	/// Looks up a section by name, 0 if it is missing.
+	const Section* find(const std::string& name) const;
+
+	boost::filesystem::path path_; ///< Path of the mapped file
+	uchar* data_; ///< Start of the mapping, 0 if no file is mapped
+	size_t size_; ///< Size of the mapping in bytes
+	std::vector<const Section*> sections_; ///< Section table inside the mapping
+
+private:
+	// the mapping is owned by exactly one object
+	ModelFile(const ModelFile&);
+	ModelFile& operator=(const ModelFile&);
+};
+
+/// Collects the sections of a model and writes them as a ModelFile.
+class ModelFileWriter
+{
+public:
+	/// @param[in] model_file File that is written by write()
+	ModelFileWriter(const boost::filesystem::path& model_file);
+
+	/// Adds a matrix section, the data is referenced until write() is called.
+	void addMat(const std::string& name, const cv::Mat& mat);
+
+	/// Adds a section with a single integer.
+	void addInt(const std::string& name, int value);
+
+	/// Adds a section with a single floating point value.
+	void addDouble(const std::string& name, double value);
+
+	/// Adds a section with a list of strings (zero terminated, concatenated).
+	void addStrings(const std::string& name, const std::vector<std::string>& strings);
+
+	/// Writes all sections. The file is written under a temporary name and renamed afterwards, so
+	/// readers see either the old or the new file and existing mappings of the old file stay valid.
+	/// @return False if the file could not be written
+	bool write();
+
+	/// Path of the written file.
+	const boost::filesystem::path& path() const
+	{
+		return path_;
+	}
+	;
+
+protected:
+	boost::filesystem::path path_; ///< Path of the written file
+	std::vector<std::string> names_; ///< Section names
+	std::vector<cv::Mat> mats_; ///< Section data, continuous
+};
+
+}
+;
+#endif
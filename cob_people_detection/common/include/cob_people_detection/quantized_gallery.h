@@ -0,0 +1,88 @@
+#ifndef QUANTIZED_GALLERY_H_
+#define QUANTIZED_GALLERY_H_
+
+#include<opencv/cv.h>
+#include<iostream>
+#include<vector>
+
+#include<cob_people_detection/model_file.h>
+
+namespace ipa_PeopleDetector
+{
+
+/// 8 bit scalar quantization of the model features for a fast pre-selection of candidates.
+/// Every dimension is mapped linearly from its [min,max] range to the codes 0..255. The
+/// squared distance of two code vectors is weighted by the squared step size of each
+/// dimension, the weights are quantized to 7 bit so that the whole kernel runs in 16/32 bit
+/// integer SIMD arithmetic. The candidates have to be re-ranked with the full precision features.
+class QuantizedGallery
+{
+public:
+	QuantizedGallery();
+
+	/// Quantizes the rows of features, any previous gallery is discarded.
+	/// @param[in] features Model features as matrix-rows
+	void build(const cv::Mat& features);
+
+	/// Selects the rows with the smallest approximate distance to a probe.
+	/// @param[in] probe Probe feature (one row or continuous matrix)
+	/// @param[in] num_candidates Number of selected rows
+	/// @param[in] rows Rows the selection is restricted to, 0 for all rows
+	/// @param[out] candidates Selected row indices, ordered by approximate distance
+	/// @return False if the selection cannot narrow down the search, i.e. the exact search has to be used
+	bool search(const cv::Mat& probe, int num_candidates, const std::vector<int>* rows, std::vector<int>& candidates) const;
+
+	/// Adds the quantized gallery to the sections of a model file, so that it is written together with the model.
+	void write(ModelFileWriter& writer) const;
+
+	/// Reads the quantized gallery from the sections of a model file.
+	/// @param[in] model_file Model file
+	/// @param[in] num_features Number of model features the gallery has to cover
+	/// @param[in] dim Dimension of the model features
+	/// @return False if the model file contains no quantized gallery or it does not match the model
+	bool read(const ModelFile& model_file, int num_features, int dim);
+
+	/// Saves the quantized gallery as node of an XML model file.
+	void save(cv::FileStorage& fs) const;
+
+	/// Loads the quantized gallery from the node of an XML model file.
+	/// @param[in] node Node written by save()
+	/// @param[in] num_features Number of model features the gallery has to cover
+	/// @param[in] dim Dimension of the model features
+	/// @return False if the node is missing or does not match the model
+	bool load(const cv::FileNode& node, int num_features, int dim);
+
+	/// Discards the quantized gallery.
+	void clear();
+
+	/// Returns true if no quantized gallery is available.
+	bool empty() const
+	{
+		return codes_.rows == 0;
+	}
+	;
+
+protected:
+	/// Sets the gallery from the stored codes and quantization parameters.
+	/// @return False (gallery cleared) if they do not match the model
+	bool assign(const cv::Mat& codes, const cv::Mat& offset, const cv::Mat& step, int num_features, int dim);
+
+	/// Sets the quantization weights from the step sizes.
+	void calcWeights();
+
+	/// Quantizes a probe with the parameters of the gallery.
+	void quantize(const cv::Mat& probe, std::vector<uchar>& codes) const;
+
+	/// Weighted squared distance of two code vectors, n has to be a multiple of 8.
+	static int64 weightedSqDistance(const uchar* a, const uchar* b, const short* weights, int n);
+
+	cv::Mat codes_; ///< Codes of the model features as rows (CV_8UC1), padded with zeros to a multiple of 8
+	cv::Mat offset_; ///< Minimum of each dimension (CV_64FC1)
+	cv::Mat step_; ///< Step size of each dimension (CV_64FC1)
+	std::vector<short> weights_; ///< Quantized squared step sizes (0..128), padded with zeros
+	int dim_; ///< Dimension of the model features
+};
+
+}
+;
+#endif
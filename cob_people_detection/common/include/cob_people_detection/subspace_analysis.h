@@ -13,6 +13,13 @@
 namespace SubspaceAnalysis
 {
 
+/// Solvers for the generalized eigenproblem S_inter*v = lambda*S_intra*v of the LDA variants
+enum LDASolver
+{
+	LDA_SOLVER_CHOLESKY, ///< Cholesky whitening of S_intra and a symmetric eigensolver for the leading ss_dim vectors
+	LDA_SOLVER_INVERSE ///< Decomposition of S_intra^-1*S_inter (Hessenberg/QR of the JAMA port for LDA and ILDA)
+};
+
 //Baseclass for PCA LDA
 class SSA
 {
@@ -32,6 +39,19 @@ public:
 	void decomposeSVD(cv::Mat& data_mat);
 	void decomposeSymmetricMatrix(cv::Mat& data_mat);
 	void decomposeAsymmetricMatrix(cv::Mat& data_mat);
+	/// Solves S_inter*v = lambda*S_intra*v for symmetric S_inter and symmetric positive (semi-)definite S_intra.
+	/// S_intra = L*L^T is factorized by Cholesky (with a small ridge if it is singular), the leading num_vecs
+	/// eigenvectors of the symmetric L^-1*S_inter*L^-T are computed by subspace iteration and transformed back.
+	/// @param[in] S_inter Between-class scatter matrix
+	/// @param[in] S_intra Within-class scatter matrix
+	/// @param[in] num_vecs Number of computed eigenvectors (eigenvecs as rows, unit length, eigenvals as column)
+	void decomposeGeneralizedSymmetricMatrix(cv::Mat& S_inter, cv::Mat& S_intra, int num_vecs);
+	/// Computes only the leading num_vecs principal components of centered data (samples as rows).
+	/// Few samples are decomposed exactly through their Gram matrix, otherwise a randomized SVD with
+	/// power iterations is used, the covariance matrix is never formed.
+	/// @param[in] data_mat Centered data matrix (CV_64FC1)
+	/// @param[in] num_vecs Number of components (eigenvecs as rows, eigenvals of the covariance as column)
+	void decomposeTruncated(cv::Mat& data_mat, int num_vecs);
 	//Interface methods
 	void retrieve(cv::Mat& proj, cv::Mat& avg, cv::Mat& proj_model_data);
 
@@ -68,7 +88,7 @@ public:
 	{
 	}
 	;
-	LDA2D(std::vector<cv::Mat>& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim);
+	LDA2D(std::vector<cv::Mat>& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim, LDASolver solver = LDA_SOLVER_CHOLESKY);
 	virtual ~LDA2D()
 	{
 	}
@@ -84,11 +104,12 @@ class LDA: public SSA
 {
 
 public:
-	LDA()
+	LDA() :
+		solver_(LDA_SOLVER_CHOLESKY)
 	{
 	}
 	;
-	LDA(cv::Mat& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim);
+	LDA(cv::Mat& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim, LDASolver solver = LDA_SOLVER_CHOLESKY);
 	virtual ~LDA()
 	{
 	}
@@ -100,6 +121,7 @@ public:
 
 	int num_classes_;
 	std::vector<int> unique_labels_;
+	LDASolver solver_; ///< Solver of the generalized eigenproblem
 
 	cv::Mat class_mean_arr;
 };
@@ -111,7 +133,7 @@ public:
 	{
 	}
 	;
-	ILDA(cv::Mat& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim);
+	ILDA(cv::Mat& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim, LDASolver solver = LDA_SOLVER_CHOLESKY);
 	virtual ~ILDA()
 	{
 	}
@@ -137,6 +159,42 @@ public:
 	void PCA_OpenCv(cv::Mat& input_data, int& ss_dim);
 };
 
+// Incremental PCA - merges new samples into an existing eigenspace without the old samples.
+// The eigenspace is extended by the components of the new samples that are orthogonal to it
+// and the covariance is re-diagonalized in the extended space, which only depends on the
+// number of new samples and the dimension of the eigenspace.
+class IPCA: public SSA
+{
+public:
+	IPCA()
+	{
+	}
+	;
+	/// @param eigenvectors Current eigenvectors as rows
+	/// @param eigenvalues Current eigenvalues (covariance)
+	/// @param mean_arr Current mean as row
+	/// @param num_samples Number of samples the eigenspace has been computed from
+	IPCA(cv::Mat& eigenvectors, cv::Mat& eigenvalues, cv::Mat& mean_arr, int num_samples);
+	virtual ~IPCA()
+	{
+	}
+	;
+
+	/// Adds new samples to the eigenspace.
+	/// @param new_data New samples as rows
+	/// @param max_dim Maximal dimension of the updated eigenspace, 0 keeps all directions
+	void update(cv::Mat& new_data, int max_dim);
+
+	/// Maps features (data*eigenvectors^T) computed with the eigenspace before the last update to the updated eigenspace.
+	/// @param features Features as rows, replaced with the updated features
+	void updateFeatures(cv::Mat& features);
+
+	int num_samples_;
+	cv::Mat rotation; ///< Updated eigenvectors in coordinates of [previous eigenvectors; new directions]
+	cv::Mat prev_mean_coeffs; ///< Previous mean projected onto the previous eigenvectors
+	cv::Mat mean_coeffs; ///< Previous mean projected onto the updated eigenvectors
+};
+
 // Base class for SubSpace Analysis(SSA)
 //
 //
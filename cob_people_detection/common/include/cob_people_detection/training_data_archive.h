@@ -0,0 +1,255 @@
+#ifndef __TRAINING_DATA_ARCHIVE_H__
+#define __TRAINING_DATA_ARCHIVE_H__
+
+#include <opencv/cv.h>
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+namespace ipa_PeopleDetector
+{
+
+/// Packed, append-only store of the training data (normalized face images and depth maps).
+/// The archive replaces the directory layout of tdata.xml, img/<i>.bmp and depth/<i>.xml by two files:
+///   tdata.pack   raw image and depth map data, every record starts at a multiple of record_alignment bytes
+///   tdata.index  journal with one entry per stored face (record) with label, offset into tdata.pack, matrix sizes
+///                and the depth map flag, followed by entries that delete or relabel a record
+/// Both files start with a header carrying the same archive id, so a data file and an index of different
+/// archives are never combined. The data file is mapped into memory and the images are used in place.
+/// Records are numbered in the order they were appended and keep their number until the archive is compacted.
+class TrainingDataArchive
+{
+public:
+	TrainingDataArchive();
+
+	/// Unmaps the data file, matrices that refer to the mapping must not be used afterwards.
+	~TrainingDataArchive();
+
+	/// Maps the archive of a data directory into memory.
+	/// Index entries that point behind the end of the data file, e.g. after an interrupted append, are ignored.
+	/// A commit of a created archive that was interrupted between renaming the data file and the index is completed.
+	/// @param data_directory Directory that contains tdata.pack and tdata.index
+	/// @return False if the archive is missing or damaged
+	bool open(const boost::filesystem::path& data_directory);
+
+	/// Unmaps the archive.
+	void close();
+
+	/// Returns true if a data directory contains an archive.
+	static bool exists(const boost::filesystem::path& data_directory);
+
+	/// Returns true if an archive is open.
+	bool isOpen() const
+	{
+		return data_ != 0;
+	}
+	;
+
+	/// Number of stored faces, i.e. records that have not been deleted.
+	int size() const
+	{
+		return (int)live_.size();
+	}
+	;
+
+	/// Label of a stored face.
+	const std::string& label(int index) const
+	{
+		return record_labels_[live_[index]];
+	}
+	;
+
+	/// Record number of a stored face.
+	int record(int index) const
+	{
+		return live_[index];
+	}
+	;
+
+	/// Number of records including deleted ones.
+	int numRecords() const
+	{
+		return (int)records_.size();
+	}
+	;
+
+	/// Returns true if a record has not been deleted.
+	bool isLive(int record) const
+	{
+		return record_live_[record];
+	}
+	;
+
+	/// Current label of a record.
+	const std::string& recordLabel(int record) const
+	{
+		return record_labels_[record];
+	}
+	;
+
+	/// Number of delete and relabel entries in the index since it was compacted.
+	int journalEntries() const
+	{
+		return journal_entries_;
+	}
+	;
+
+	/// Number of deleted records whose data still occupies tdata.pack.
+	int deletedRecords() const
+	{
+		return (int)records_.size() - (int)live_.size();
+	}
+	;
+
+	/// Rewrites the index with the stored faces only, the records are renumbered in their current order.
+	/// @param reclaim_data If true, tdata.pack is rewritten as well and the data of deleted records is dropped
+	/// @return False if writing failed, the archive is closed then
+	bool compact(bool reclaim_data);
+
+	/// Returns true if a depth map is stored with the face.
+	bool hasDepthMap(int index) const;
+
+	/// Returns a matrix header that refers to the mapped face image.
+	/// Faces appended after open() are not mapped, their matrices are empty until the archive is opened again.
+	/// @param index Index of the face
+	/// @param image Face image, valid as long as this object is open
+	void getImage(int index, cv::Mat& image) const;
+
+	/// Returns a matrix header that refers to the mapped depth map, empty if the face has no depth map.
+	void getDepthMap(int index, cv::Mat& depth_map) const;
+
+	/// File names inside the data directory.
+	static const char* data_file_name;
+	static const char* index_file_name;
+
+	static const char data_magic[4]; ///< Magic number of tdata.pack
+	static const char index_magic[4]; ///< Magic number of tdata.index
+	static const uint32_t version = 1; ///< Version of the file layout, files of other versions are not read
+	static const uint32_t byte_order_tag = 0x01020304; ///< Detects files written with another byte order
+	static const int record_alignment = 64; ///< Alignment of the records in tdata.pack in bytes
+	static const uint32_t flag_depth_map = 1; ///< Index entry flag: a depth map follows the image
+	static const uint32_t flag_deleted = 2; ///< Index entry flag: the record given by offset is deleted
+	static const uint32_t flag_relabel = 4; ///< Index entry flag: the record given by offset gets the label of this entry
+
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t byte_order;
+		uint32_t reserved;
+		uint64_t archive_id; ///< identical in tdata.pack and tdata.index of one archive
+		uint64_t padding[5]; ///< the first record starts at record_alignment
+	};
+
+	/// Fixed part of an index entry, it is followed by the label padded to a multiple of 8 bytes.
+	struct IndexEntry
+	{
+		uint64_t offset; ///< start of the image in tdata.pack, the depth map follows at the next aligned position; record number for flag_deleted and flag_relabel
+		int32_t image_rows;
+		int32_t image_cols;
+		int32_t image_type;
+		int32_t depth_rows;
+		int32_t depth_cols;
+		int32_t depth_type;
+		uint32_t flags;
+		uint32_t label_length;
+	};
+
+protected:
+	friend class TrainingDataArchiveWriter;
+
+	/// Reads the index file, entries are only kept if their data lies inside the mapped data file.
+	bool readIndex(const boost::filesystem::path& index_file);
+
+	/// Applies an index entry to the records.
+	/// @return False if a journal entry refers to a missing record
+	bool applyEntry(const IndexEntry& entry, const std::string& label);
+
+	/// Collects the record numbers of the stored faces.
+	void updateLive();
+
+	/// Offset of the depth map of a record in tdata.pack.
+	uint64_t depthMapOffset(const IndexEntry& entry) const;
+
+	boost::filesystem::path directory_; ///< Data directory of the archive
+	uint64_t archive_id_; ///< Id of the open archive
+	uchar* data_; ///< Start of the mapped data file, 0 if no archive is open
+	size_t size_; ///< Size of the mapping in bytes
+	std::vector<IndexEntry> records_; ///< Index entries of all records
+	std::vector<std::string> record_labels_; ///< Current labels of all records
+	std::vector<bool> record_live_; ///< Flags indicate which records have not been deleted
+	std::vector<int> live_; ///< Record numbers of the stored faces
+	int journal_entries_; ///< Number of delete and relabel entries
+
+private:
+	// the mapping is owned by exactly one object
+	TrainingDataArchive(const TrainingDataArchive&);
+	TrainingDataArchive& operator=(const TrainingDataArchive&);
+};
+
+/// Writes faces into a TrainingDataArchive.
+class TrainingDataArchiveWriter
+{
+public:
+	TrainingDataArchiveWriter();
+
+	/// Closes the files, a created archive which has not been committed is discarded.
+	~TrainingDataArchiveWriter();
+
+	/// Starts a new archive. It is written under temporary names and replaces an existing archive at commit().
+	/// @param data_directory Directory that receives tdata.pack and tdata.index
+	/// @return False if the files can not be created
+	bool create(const boost::filesystem::path& data_directory);
+
+	/// Opens an archive for appending. The index of the archive object follows the committed changes.
+	/// @param archive Open archive
+	/// @return False if the archive has been replaced on disk or can not be written
+	bool openForAppend(TrainingDataArchive& archive);
+
+	/// Appends a face, it becomes visible to readers at commit().
+	/// @param label Label of the face
+	/// @param image Normalized face image
+	/// @param depth_map Depth map of the face, may be empty
+	/// @return Record number of the face, -1 if writing failed
+	int append(const std::string& label, const cv::Mat& image, const cv::Mat& depth_map);
+
+	/// Deletes a record of an archive opened with openForAppend(), its data remains in tdata.pack until the archive is compacted.
+	void remove(int record);
+
+	/// Changes the label of a record of an archive opened with openForAppend().
+	void relabel(int record, const std::string& label);
+
+	/// Flushes the appended faces and journal entries, a created archive replaces the previous archive of the data directory.
+	/// The data is written before the index, so an interrupted append never leaves index entries without data.
+	/// @return False if writing failed
+	bool commit();
+
+protected:
+	/// Writes the raw data of a matrix at the next aligned position of the data file.
+	void writeRecord(const cv::Mat& mat);
+
+	/// Queues an index entry for commit().
+	void addEntry(const TrainingDataArchive::IndexEntry& entry, const std::string& label);
+
+	boost::filesystem::path data_file_; ///< Written data file
+	boost::filesystem::path index_file_; ///< Written index file
+	boost::filesystem::path target_data_file_; ///< Final name of the data file
+	boost::filesystem::path target_index_file_; ///< Final name of the index file
+	std::ofstream data_; ///< Data file stream
+	std::ofstream index_; ///< Index file stream
+	std::string pending_index_; ///< Index entries which are written at commit()
+	std::vector<TrainingDataArchive::IndexEntry> pending_entries_; ///< Index entries which are applied to archive_ at commit()
+	std::vector<std::string> pending_labels_; ///< Labels of pending_entries_
+	TrainingDataArchive* archive_; ///< Archive opened for appending, 0 for a created archive
+	uint64_t data_size_; ///< Current size of the data file
+	int next_record_; ///< Record number of the next appended face
+	bool created_; ///< Flag indicates that the files are written under temporary names
+};
+
+} // end namespace
+
+#endif // __TRAINING_DATA_ARCHIVE_H__
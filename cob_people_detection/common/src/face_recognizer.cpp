@@ -68,6 +68,8 @@
 
 // stream
 #include <fstream>
+#include <sstream>
+#include <algorithm>
 
 // opencv
 #include <opencv/cv.h>
@@ -75,22 +77,348 @@
 #include <opencv/highgui.h>
 
 // boost
+#include "boost/bind.hpp"
 #include "boost/filesystem/operations.hpp"
 #include "boost/filesystem/convenience.hpp"
+#include "boost/unordered_set.hpp"
 
 #include <sys/time.h>
 
 namespace fs = boost::filesystem;
 using namespace ipa_PeopleDetector;
 
+namespace
+{
+/// Resolves the label filter of the training data loaders through a hash set.
+/// If identification_labels_to_train is empty, all entries are selected and the list is filled with their labels in order of appearance.
+/// @param entry_labels Labels of all stored faces
+/// @param identification_labels_to_train Labels whose faces are loaded
+/// @param selected Indices of the stored faces which are loaded
+void selectTrainingEntries(const std::vector<std::string>& entry_labels, std::vector<std::string>& identification_labels_to_train, std::vector<int>& selected)
+{
+	bool use_all_data = (identification_labels_to_train.size() == 0);
+	boost::unordered_set<std::string> labels(identification_labels_to_train.begin(), identification_labels_to_train.end());
+	selected.clear();
+	selected.reserve(entry_labels.size());
+	for (int i = 0; i < (int)entry_labels.size(); i++)
+	{
+		if (labels.count(entry_labels[i]) == 0)
+		{
+			// skip this data because it does not contain one of the desired labels
+			if (use_all_data == false)
+				continue;
+			labels.insert(entry_labels[i]);
+			identification_labels_to_train.push_back(entry_labels[i]);
+		}
+		selected.push_back(i);
+	}
+}
+
+/// Removes the labels without loaded faces and repeated labels from identification_labels_to_train, the labels become the class names of a model.
+void removeMissingLabels(const std::vector<std::string>& face_labels, std::vector<std::string>& identification_labels_to_train)
+{
+	boost::unordered_set<std::string> present(face_labels.begin(), face_labels.end());
+	std::vector<std::string> labels;
+	for (int j = 0; j < (int)identification_labels_to_train.size(); j++)
+		if (present.erase(identification_labels_to_train[j]) > 0)
+			labels.push_back(identification_labels_to_train[j]);
+	identification_labels_to_train.swap(labels);
+}
+
+/// Reads labels and file names of the stored faces from tdata.xml (former directory layout).
+/// @param depth_files Receives the depth map files, empty paths for faces without depth map, 0 if not needed
+/// @return False if tdata.xml can not be opened
+bool readTrainingDataIndex(const boost::filesystem::path& data_directory, std::vector<std::string>& entry_labels, std::vector<boost::filesystem::path>& image_files,
+		std::vector<boost::filesystem::path>* depth_files)
+{
+	cv::FileStorage fileStorage((data_directory / "tdata.xml").string(), cv::FileStorage::READ);
+	if (!fileStorage.isOpened())
+		return false;
+
+	int number_entries = (int)fileStorage["number_entries"];
+	entry_labels.resize(number_entries);
+	image_files.resize(number_entries);
+	if (depth_files != 0)
+		depth_files->resize(number_entries);
+	for (int i = 0; i < number_entries; i++)
+	{
+		std::ostringstream tag_label, tag_image, tag_dm;
+		tag_label << "label_" << i;
+		tag_image << "image_" << i;
+		tag_dm << "depthmap_" << i;
+		entry_labels[i] = (std::string)fileStorage[tag_label.str().c_str()];
+		image_files[i] = data_directory / (std::string)fileStorage[tag_image.str().c_str()];
+		if (depth_files != 0)
+		{
+			std::string dm_file = (std::string)fileStorage[tag_dm.str().c_str()];
+			(*depth_files)[i] = dm_file.empty() ? boost::filesystem::path() : data_directory / dm_file;
+		}
+	}
+	fileStorage.release();
+	return true;
+}
+
+/// Decodes the training images and depth maps of the former directory layout.
+/// Images are resized to the normalized size unless depth maps are loaded, these are normalized together with the image afterwards.
+class ImageFileBody: public cv::ParallelLoopBody
+{
+public:
+	ImageFileBody(const std::vector<boost::filesystem::path>& image_files, const std::vector<boost::filesystem::path>& depth_files, const cv::Size& norm_size,
+			std::vector<cv::Mat>& images, std::vector<cv::Mat>& xyz_maps) :
+		image_files_(image_files), depth_files_(depth_files), norm_size_(norm_size), images_(images), xyz_maps_(xyz_maps)
+	{
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		for (int k = range.start; k < range.end; k++)
+		{
+			images_[k] = cv::imread(image_files_[k].string(), -1);
+			if (images_[k].empty())
+				continue;
+			if (depth_files_.size() == 0)
+			{
+				cv::resize(images_[k], images_[k], norm_size_);
+				continue;
+			}
+			if (depth_files_[k].empty())
+				continue;
+			cv::FileStorage fs(depth_files_[k].string(), cv::FileStorage::READ);
+			if (fs.isOpened())
+				fs["depthmap"] >> xyz_maps_[k];
+		}
+	}
+
+protected:
+	const std::vector<boost::filesystem::path>& image_files_;
+	const std::vector<boost::filesystem::path>& depth_files_;
+	cv::Size norm_size_;
+	std::vector<cv::Mat>& images_;
+	std::vector<cv::Mat>& xyz_maps_;
+};
+
+/// Copies the training images and depth maps out of the mapped training data archive.
+/// Without depth maps the images are resized and optionally converted to training vectors right away.
+class ArchiveImageBody: public cv::ParallelLoopBody
+{
+public:
+	ArchiveImageBody(const TrainingDataArchive& archive, const std::vector<int>& selected, const cv::Size& norm_size, bool training_vectors, bool load_depth,
+			std::vector<cv::Mat>& images, std::vector<cv::Mat>& xyz_maps) :
+		archive_(archive), selected_(selected), norm_size_(norm_size), training_vectors_(training_vectors), load_depth_(load_depth), images_(images), xyz_maps_(xyz_maps)
+	{
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		for (int k = range.start; k < range.end; k++)
+		{
+			cv::Mat image;
+			archive_.getImage(selected_[k], image);
+			if (image.empty())
+				continue;
+			if (load_depth_ == true)
+			{
+				cv::Mat xyz;
+				images_[k] = image.clone();
+				archive_.getDepthMap(selected_[k], xyz);
+				xyz_maps_[k] = xyz.clone();
+				continue;
+			}
+			cv::resize(image, images_[k], norm_size_);
+			if (training_vectors_ == true)
+				images_[k].convertTo(images_[k], CV_64FC1);
+		}
+	}
+
+protected:
+	const TrainingDataArchive& archive_;
+	const std::vector<int>& selected_;
+	cv::Size norm_size_;
+	bool training_vectors_;
+	bool load_depth_;
+	std::vector<cv::Mat>& images_;
+	std::vector<cv::Mat>& xyz_maps_;
+};
+
+/// Normalizes the faces of a frame in parallel, every range of faces uses its own normalizer of the pool.
+class ProbeNormalizationBody: public cv::ParallelLoopBody
+{
+public:
+	ProbeNormalizationBody(std::vector<cv::Mat>& color_images, std::vector<cv::Mat>& depth_images, const std::vector<std::pair<int, cv::Rect> >& faces,
+			const cv::Size& norm_size, int model_type, FaceNormalizerPool& normalizers, std::vector<cv::Mat>& probes) :
+		color_images_(color_images), depth_images_(depth_images), faces_(faces), norm_size_(norm_size), model_type_(model_type), normalizers_(normalizers), probes_(probes)
+	{
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		FaceNormalizer* normalizer = normalizers_.acquire();
+		cv::Size norm_size = norm_size_;
+		for (int k = range.start; k < range.end; k++)
+		{
+			// the normalization works in place and the faces of one image may overlap, so the crops are copied
+			const cv::Rect& face = faces_[k].second;
+			cv::Mat color_crop = color_images_[faces_[k].first](face).clone();
+			cv::Mat depth_crop_xyz = depth_images_[faces_[k].first](face).clone();
+
+			cv::Mat DM_crop = cv::Mat::zeros(norm_size.height, norm_size.width, CV_8UC1);
+			if (normalizer->normalizeFace(color_crop, depth_crop_xyz, norm_size, DM_crop))
+				;
+
+			color_crop.convertTo(probes_[k], model_type_);
+		}
+		normalizers_.release(normalizer);
+	}
+
+protected:
+	std::vector<cv::Mat>& color_images_;
+	std::vector<cv::Mat>& depth_images_;
+	const std::vector<std::pair<int, cv::Rect> >& faces_;
+	cv::Size norm_size_;
+	int model_type_;
+	FaceNormalizerPool& normalizers_;
+	std::vector<cv::Mat>& probes_;
+};
+
+/// Classifies normalized faces one by one in parallel, the recognizers of the published model are only read.
+/// With the cascade the coarse stage selects the candidates, the model features of labels that are not served are skipped.
+class ProbeClassificationBody: public cv::ParallelLoopBody
+{
+public:
+	ProbeClassificationBody(const RecognitionModel& model, std::vector<cv::Mat>& probes, std::vector<cv::Mat>& coarse_probes, int cascade_candidates,
+			std::vector<int>& res_labels) :
+		model_(model), probes_(probes), coarse_probes_(coarse_probes), cascade_candidates_(cascade_candidates), res_labels_(res_labels)
+	{
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		bool masked = (model_.active_rows.size() > 0);
+		std::vector<int> candidates;
+		for (int k = range.start; k < range.end; k++)
+		{
+			if (coarse_probes_.size() == 0)
+			{
+				model_.color->classifyCandidates(probes_[k], model_.active_rows, res_labels_[k]);
+				continue;
+			}
+
+			bool known = model_.coarse->rankCandidates(coarse_probes_[k], cascade_candidates_, candidates);
+			if (known == true && masked == true)
+			{
+				// the nearest faces belong to persons that are not served -> unknown
+				int kept = 0;
+				for (int c = 0; c < (int)candidates.size(); c++)
+					if (model_.row_active[candidates[c]] == true)
+						candidates[kept++] = candidates[c];
+				candidates.resize(kept);
+				known = (kept > 0);
+			}
+			if (known == false)
+				res_labels_[k] = -1;
+			else
+				model_.color->classifyCandidates(probes_[k], candidates, res_labels_[k]);
+		}
+	}
+
+protected:
+	const RecognitionModel& model_;
+	std::vector<cv::Mat>& probes_;
+	std::vector<cv::Mat>& coarse_probes_;
+	int cascade_candidates_;
+	std::vector<int>& res_labels_;
+};
+
+/// Verifies normalized faces in parallel against the model features of a single identity.
+class ProbeVerificationBody: public cv::ParallelLoopBody
+{
+public:
+	ProbeVerificationBody(const RecognitionModel& model, std::vector<cv::Mat>& probes, const std::vector<int>& rows, std::vector<double>& distances) :
+		model_(model), probes_(probes), rows_(rows), distances_(distances)
+	{
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		for (int k = range.start; k < range.end; k++)
+			distances_[k] = model_.color->verifyCandidates(probes_[k], rows_);
+	}
+
+protected:
+	const RecognitionModel& model_;
+	std::vector<cv::Mat>& probes_;
+	const std::vector<int>& rows_;
+	std::vector<double>& distances_;
+};
+}
+
+void ipa_PeopleDetector::FaceNormalizerPool::init(const std::string& classifier_directory, const FaceNormalizer::FNConfig& config)
+{
+	boost::lock_guard<boost::mutex> lock(mutex_);
+	classifier_directory_ = classifier_directory;
+	config_ = config;
+	normalizers_.clear();
+	idle_.clear();
+}
+
+FaceNormalizer* ipa_PeopleDetector::FaceNormalizerPool::acquire()
+{
+	FaceNormalizer::FNConfig config;
+	std::string classifier_directory;
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		if (idle_.size() > 0)
+		{
+			FaceNormalizer* normalizer = idle_.back();
+			idle_.pop_back();
+			return normalizer;
+		}
+		config = config_;
+		classifier_directory = classifier_directory_;
+	}
+
+	// the haarcascades are loaded outside of the lock
+	boost::shared_ptr<FaceNormalizer> normalizer(new FaceNormalizer);
+	std::string storage_directory = "/share/goa-tz/people_detection/eval/KinectIPA/";
+	normalizer->init(classifier_directory, storage_directory, config, 0, false, false);
+
+	boost::lock_guard<boost::mutex> lock(mutex_);
+	normalizers_.push_back(normalizer);
+	return normalizer.get();
+}
+
+void ipa_PeopleDetector::FaceNormalizerPool::release(FaceNormalizer* normalizer)
+{
+	boost::lock_guard<boost::mutex> lock(mutex_);
+	idle_.push_back(normalizer);
+}
+
 ipa_PeopleDetector::FaceRecognizer::FaceRecognizer(void)
 {
 	m_eigenvectors_ipl = 0;
+	m_model_type = CV_64FC1;
+	m_max_incremental_updates = 0;
+	m_gallery_index_probes = 0;
+	m_quantized_candidates = 0;
+	m_parallel_matching = false;
+	m_export_xml_model = false;
+	m_cascade_size = 0;
+	m_cascade_feature_dim = 5;
+	m_cascade_candidates = 20;
+	m_training_thread = 0;
+	m_job_running = false;
+	m_job_result = ipa_Utils::RET_FAILED;
+	m_training_progress = 0.0;
 
 }
 
 ipa_PeopleDetector::FaceRecognizer::~FaceRecognizer(void)
 {
+	if (m_training_thread != 0)
+	{
+		m_training_thread->join();
+		delete m_training_thread;
+	}
 	if (m_eigenvectors_ipl != 0)
 	{
 		for (uint i=0; i<m_eigenvectors.size(); i++)
@@ -100,7 +428,9 @@ ipa_PeopleDetector::FaceRecognizer::~FaceRecognizer(void)
 }
 
 unsigned long ipa_PeopleDetector::FaceRecognizer::init(std::string data_directory, int norm_size, bool norm_illumination, bool norm_align, bool norm_extreme_illumination,
-		int metric, bool debug, std::vector<std::string>& identification_labels_to_recognize, int subs_meth, int feature_dim, bool use_unknown_thresh, bool use_depth)
+		int metric, bool debug, std::vector<std::string>& identification_labels_to_recognize, int subs_meth, int feature_dim, bool use_unknown_thresh, bool use_depth,
+		bool use_float_model, int gallery_index_probes, int max_incremental_updates,
+		int quantized_candidates, int cascade_size, int cascade_feature_dim, int cascade_candidates, bool parallel_matching, bool export_xml_model)
 {
 	// parameters
 	m_data_directory = boost::filesystem::path(data_directory);
@@ -120,39 +450,41 @@ unsigned long ipa_PeopleDetector::FaceRecognizer::init(std::string data_director
 	case 0:
 	{
 		m_subs_meth = ipa_PeopleDetector::METH_FISHER;
-		eff_color = new ipa_PeopleDetector::FaceRecognizer_Fisherfaces();
 		break;
 	}
 	case 1:
 	{
 		m_subs_meth = ipa_PeopleDetector::METH_EIGEN;
-		eff_color = new ipa_PeopleDetector::FaceRecognizer_Eigenfaces();
 		break;
 	}
 	case 2:
 	{
 		m_subs_meth = ipa_PeopleDetector::METH_LDA2D;
-		eff_color = new ipa_PeopleDetector::FaceRecognizer_LDA2D();
 		break;
 	}
 	case 3:
 	{
 		m_subs_meth = ipa_PeopleDetector::METH_PCA2D;
-		eff_color = new ipa_PeopleDetector::FaceRecognizer_PCA2D();
 		break;
 	}
 	default:
 	{
 		m_subs_meth = ipa_PeopleDetector::METH_FISHER;
-		eff_color = new ipa_PeopleDetector::FaceRecognizer_Fisherfaces();
 		break;
 	}
 	};
 
-	if(m_use_unknown_thresh)
-	{
-		eff_color->activate_unknown_treshold();
-	}
+	m_model_type = (use_float_model == true) ? CV_32FC1 : CV_64FC1;
+	m_gallery_index_probes = gallery_index_probes;
+	m_quantized_candidates = quantized_candidates;
+	m_parallel_matching = parallel_matching;
+	m_max_incremental_updates = max_incremental_updates;
+	m_export_xml_model = export_xml_model;
+
+	// coarse stage of the recognition cascade, a low resolution Eigenfaces model over the same training images
+	m_cascade_size = cascade_size;
+	m_cascade_feature_dim = cascade_feature_dim;
+	m_cascade_candidates = cascade_candidates;
 
 	FaceNormalizer::FNConfig fn_cfg;
 	fn_cfg.eq_ill = norm_illumination;
@@ -165,6 +497,7 @@ unsigned long ipa_PeopleDetector::FaceRecognizer::init(std::string data_director
 	//std::string storage_directory="/share/goa-tz/people_detection/eval/KinectIPA/";
 	std::string storage_directory = "/share/goa-tz/people_detection/eval/KinectIPA/";
 	face_normalizer_.init(classifier_directory, storage_directory, fn_cfg, 0, false, false);
+	m_probe_normalizers.init(classifier_directory, fn_cfg);
 
 	// load model
 	unsigned long return_value = loadRecognitionModel(identification_labels_to_recognize);
@@ -175,6 +508,37 @@ unsigned long ipa_PeopleDetector::FaceRecognizer::init(std::string data_director
 	return ipa_Utils::RET_OK;
 }
 
+ipa_PeopleDetector::FaceRecognizerBaseClass* ipa_PeopleDetector::FaceRecognizer::createColorRecognizer()
+{
+	ipa_PeopleDetector::FaceRecognizerBaseClass* eff_color = ipa_PeopleDetector::createRecognizer(m_subs_meth);
+
+	if (m_use_unknown_thresh)
+		eff_color->activate_unknown_treshold();
+	eff_color->set_model_type(m_model_type);
+	eff_color->set_gallery_index_probes(m_gallery_index_probes);
+	eff_color->set_quantized_candidates(m_quantized_candidates);
+	eff_color->set_parallel_matching(m_parallel_matching);
+	if (m_max_incremental_updates > 0)
+		eff_color->activate_incremental_updates();
+
+	return eff_color;
+}
+
+ipa_PeopleDetector::FaceRecognizer_Eigenfaces* ipa_PeopleDetector::FaceRecognizer::createCoarseRecognizer()
+{
+	if (m_cascade_size <= 0 || m_cascade_size >= m_norm_size || m_cascade_candidates <= 0)
+		return 0;
+
+	ipa_PeopleDetector::FaceRecognizer_Eigenfaces* eff_coarse = new ipa_PeopleDetector::FaceRecognizer_Eigenfaces();
+	if (m_use_unknown_thresh)
+		eff_coarse->activate_unknown_treshold();
+	eff_coarse->set_model_type(m_model_type);
+	if (m_max_incremental_updates > 0)
+		eff_coarse->activate_incremental_updates();
+
+	return eff_coarse;
+}
+
 unsigned long ipa_PeopleDetector::FaceRecognizer::initTraining(std::string data_directory, int norm_size, bool norm_illumination, bool norm_align, bool norm_extreme_illumination,
 		bool debug, std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps, bool use_depth)
 {
@@ -198,8 +562,8 @@ unsigned long ipa_PeopleDetector::FaceRecognizer::initTraining(std::string data_
 	std::string storage_directory = "/share/goa-tz/people_detection/eval/KinectIPA/";
 	face_normalizer_.init(classifier_directory, storage_directory, fn_cfg, 0, false, false);
 	// load model
-	m_current_label_set.clear(); // keep empty to load all available data
-	loadTrainingData(face_images, m_current_label_set);
+	std::vector<std::string> identification_labels; // keep empty to load all available data
+	loadTrainingData(face_images, identification_labels);
 
 	return ipa_Utils::RET_OK;
 }
@@ -226,6 +590,8 @@ unsigned long ipa_PeopleDetector::FaceRecognizer::addFace(cv::Mat& color_image,
 	face_images.push_back(roi_color);
 	face_depthmaps.push_back(roi_depth_xyz);
 	m_face_labels.push_back(label);
+	m_label_index[label].push_back(m_face_labels.size() - 1);
+	m_archive_records.push_back(-1);
 	dm_exist.push_back(true);
 
 	return ipa_Utils::RET_OK;
@@ -234,41 +600,163 @@ unsigned long ipa_PeopleDetector::FaceRecognizer::addFace(cv::Mat& color_image,
 
 unsigned long ipa_PeopleDetector::FaceRecognizer::updateFaceLabels(std::string old_label, std::string new_label)
 {
-	for (int i=0; i<(int)m_face_labels.size(); i++)
+	return updateFaceLabels(std::vector<std::string>(1, old_label), std::vector<std::string>(1, new_label));
+}
+
+unsigned long ipa_PeopleDetector::FaceRecognizer::updateFaceLabels(const std::vector<std::string>& old_labels, const std::vector<std::string>& new_labels)
+{
+	boost::lock_guard<boost::mutex> lock(m_data_mutex);
+
+	if (old_labels.size() != new_labels.size())
+	{
+		std::cout << "Error: FaceRecognizer::updateFaceLabels: " << old_labels.size() << " old labels but " << new_labels.size() << " new labels.\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
+
+	// the faces of a label are found through the label index, the updates are applied in the given order
+	for (int l = 0; l < (int)old_labels.size(); l++)
 	{
-		if (m_face_labels[i].compare(old_label) == 0)
-			m_face_labels[i] = new_label;
+		LabelIndex::iterator it = m_label_index.find(old_labels[l]);
+		if (it == m_label_index.end() || old_labels[l].compare(new_labels[l]) == 0)
+			continue;
+		std::vector<int> indices;
+		indices.swap(it->second);
+		m_label_index.erase(it);
+		for (int k = 0; k < (int)indices.size(); k++)
+			m_face_labels[indices[k]] = new_labels[l];
+
+		std::vector<int>& target = m_label_index[new_labels[l]];
+		std::vector<int> merged(target.size() + indices.size());
+		std::merge(target.begin(), target.end(), indices.begin(), indices.end(), merged.begin());
+		target.swap(merged);
 	}
 	return ipa_Utils::RET_OK;
 }
 
 unsigned long ipa_PeopleDetector::FaceRecognizer::updateFaceLabel(int index, std::string new_label)
 {
+	boost::lock_guard<boost::mutex> lock(m_data_mutex);
+
+	if (index < 0 || index >= (int)m_face_labels.size())
+	{
+		std::cout << "Error: FaceRecognizer::updateFaceLabel: There is no face with index " << index << ".\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
+
+	// move the face to the index entry of its new label
+	std::vector<int>& old_indices = m_label_index[m_face_labels[index]];
+	old_indices.erase(std::lower_bound(old_indices.begin(), old_indices.end(), index));
+	if (old_indices.size() == 0)
+		m_label_index.erase(m_face_labels[index]);
+	std::vector<int>& new_indices = m_label_index[new_label];
+	new_indices.insert(std::lower_bound(new_indices.begin(), new_indices.end(), index), index);
+
 	m_face_labels[index] = new_label;
 	return ipa_Utils::RET_OK;
 }
 
 unsigned long ipa_PeopleDetector::FaceRecognizer::deleteFaces(std::string label, std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps)
 {
-	for (int i=0; i<(int)m_face_labels.size(); i++)
+	return deleteFaces(std::vector<std::string>(1, label), face_images, face_depthmaps);
+}
+
+unsigned long ipa_PeopleDetector::FaceRecognizer::deleteFaces(const std::vector<std::string>& labels, std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps)
+{
+	boost::lock_guard<boost::mutex> lock(m_data_mutex);
+
+	std::vector<bool> remove(m_face_labels.size(), false);
+	int number_removed = 0;
+	for (int l = 0; l < (int)labels.size(); l++)
 	{
-		if (m_face_labels[i].compare(label) == 0)
+		LabelIndex::iterator it = m_label_index.find(labels[l]);
+		if (it == m_label_index.end())
+			continue;
+		for (int k = 0; k < (int)it->second.size(); k++)
 		{
-			m_face_labels.erase(m_face_labels.begin() + i);
-			face_images.erase(face_images.begin() + i);
-			i--;
+			if (remove[it->second[k]] == false)
+				number_removed++;
+			remove[it->second[k]] = true;
 		}
 	}
+	if (number_removed > 0)
+		removeFaces(remove, face_images, face_depthmaps);
+
+	std::cout << "INFO: FaceRecognizer::deleteFaces: " << number_removed << " faces of " << labels.size() << " labels deleted.\n" << std::endl;
 	return ipa_Utils::RET_OK;
 }
 
 unsigned long ipa_PeopleDetector::FaceRecognizer::deleteFace(int index, std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps)
 {
-	m_face_labels.erase(m_face_labels.begin() + index);
-	face_images.erase(face_images.begin() + index);
+	boost::lock_guard<boost::mutex> lock(m_data_mutex);
+
+	if (index < 0 || index >= (int)m_face_labels.size())
+	{
+		std::cout << "Error: FaceRecognizer::deleteFace: There is no face with index " << index << ".\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
+
+	std::vector<bool> remove(m_face_labels.size(), false);
+	remove[index] = true;
+	removeFaces(remove, face_images, face_depthmaps);
 	return ipa_Utils::RET_OK;
 }
 
+void ipa_PeopleDetector::FaceRecognizer::removeFaces(const std::vector<bool>& remove, std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps)
+{
+	// the parallel arrays are only compacted together if they describe the same faces
+	int number_faces = (int)m_face_labels.size();
+	bool images_aligned = ((int)face_images.size() == number_faces);
+	bool records_aligned = ((int)m_archive_records.size() == number_faces);
+	bool dm_aligned = ((int)dm_exist.size() == number_faces);
+
+	// one pass over all arrays, face_depthmaps holds the depth maps of the faces marked in dm_exist
+	int kept = 0, kept_depthmaps = 0, d = 0;
+	for (int i = 0; i < number_faces; i++)
+	{
+		bool has_depthmap = (dm_aligned == true && dm_exist[i] == true && d < (int)face_depthmaps.size());
+		if (remove[i] == false)
+		{
+			m_face_labels[kept] = m_face_labels[i];
+			if (images_aligned == true)
+				face_images[kept] = face_images[i];
+			if (records_aligned == true)
+				m_archive_records[kept] = m_archive_records[i];
+			if (dm_aligned == true)
+				dm_exist[kept] = dm_exist[i];
+			if (has_depthmap == true)
+				face_depthmaps[kept_depthmaps++] = face_depthmaps[d];
+			kept++;
+		}
+		if (has_depthmap == true)
+			d++;
+	}
+	// depth maps that are not covered by dm_exist stay
+	if (dm_aligned == true)
+	{
+		for (; d < (int)face_depthmaps.size(); d++)
+			face_depthmaps[kept_depthmaps++] = face_depthmaps[d];
+		face_depthmaps.resize(kept_depthmaps);
+		dm_exist.resize(kept);
+	}
+
+	m_face_labels.resize(kept);
+	if (images_aligned == true)
+		face_images.resize(kept);
+	if (records_aligned == true)
+		m_archive_records.resize(kept);
+	else
+		m_archive_records.clear();
+
+	rebuildLabelIndex();
+}
+
+void ipa_PeopleDetector::FaceRecognizer::rebuildLabelIndex()
+{
+	m_label_index.clear();
+	for (int i = 0; i < (int)m_face_labels.size(); i++)
+		m_label_index[m_face_labels[i]].push_back(i);
+}
+
 unsigned long ipa_PeopleDetector::FaceRecognizer::trainFaceRecognition(ipa_PeopleDetector::FaceRecognizerBaseClass* eff, std::vector<cv::Mat>& data, std::vector<int>& labels)
 {
 
@@ -291,297 +779,741 @@ unsigned long ipa_PeopleDetector::FaceRecognizer::trainFaceRecognition(ipa_Peopl
 
 unsigned long ipa_PeopleDetector::FaceRecognizer::trainRecognitionModel(std::vector<std::string>& identification_labels_to_train)
 {
-	// secure this function with a mutex
-	boost::lock_guard<boost::mutex> lock(m_data_mutex);
+	// only one training at a time, the recognition continues with the published model meanwhile
+	boost::lock_guard<boost::mutex> training_lock(m_training_mutex);
+
+	RecognitionModelPtr model;
+	unsigned long trained = trainNewModel(identification_labels_to_train, model);
+	if (trained == ipa_Utils::RET_OK)
+	{
+		setTrainingProgress(0.9, "saving model");
+		saveRecognitionModel(*model);
+		setActiveLabels(*model, model->label_set);
+		publishModel(model);
+	}
+	setTrainingProgress(1.0, (trained == ipa_Utils::RET_OK) ? "done" : "failed");
+	return trained;
+}
 
-	// load necessary data
+unsigned long ipa_PeopleDetector::FaceRecognizer::trainNewModel(std::vector<std::string>& identification_labels_to_train, RecognitionModelPtr& model)
+{
+	setTrainingProgress(0.1, "loading training data");
+	model.reset(new RecognitionModel);
 
+	// load necessary data, the training data is only locked while it is read
 	std::vector<cv::Mat> face_images;
-	loadTrainingData(face_images, identification_labels_to_train);
+	{
+		boost::lock_guard<boost::mutex> lock(m_data_mutex);
 
-	m_current_label_set = identification_labels_to_train;
+		loadTrainingData(face_images, identification_labels_to_train, true);
+		model->face_labels = m_face_labels;
 
-	m_label_num.clear();
-	for (unsigned int li = 0; li < m_face_labels.size(); li++)
+		// the archive stores the normalized faces, the training vector cache of previous versions is not used anymore
+		if (fs::is_regular_file((m_data_directory / "training_cache.bin").string()))
+			fs::remove((m_data_directory / "training_cache.bin").string());
+	}
+	model->label_set = identification_labels_to_train;
+
+	std::vector<int> label_num;
+	for (unsigned int li = 0; li < model->face_labels.size(); li++)
 	{
 		for (unsigned int lj = 0; lj < identification_labels_to_train.size(); lj++)
 		{
-			if (identification_labels_to_train[lj].compare(m_face_labels[li]) == 0)
-				m_label_num.push_back(lj);
+			if (identification_labels_to_train[lj].compare(model->face_labels[li]) == 0)
+				label_num.push_back(lj);
 		}
 	}
 
-	boost::filesystem::path path = m_data_directory;
-	boost::filesystem::path path_color = path / "rdata_color.xml";
+	if (face_images.size() == 0)
+	{
+		std::cout << "Error: FaceRecognizer::trainNewModel: no training data for the requested labels.\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
 
-	unsigned long trained;
-	if (face_images.size() > 0)
+	setTrainingProgress(0.3, "training recognition model");
+	model->color.reset(createColorRecognizer());
+	unsigned long trained = trainFaceRecognition(model->color.get(), face_images, label_num);
+
+	model->coarse.reset(createCoarseRecognizer());
+	if (model->coarse && trained == ipa_Utils::RET_OK)
 	{
-		trained = trainFaceRecognition(eff_color, face_images, m_label_num);
+		setTrainingProgress(0.7, "training coarse cascade stage");
+		std::vector<cv::Mat> coarse_images;
+		resizeToCascade(face_images, coarse_images);
+		int coarse_feature_dim = m_cascade_feature_dim;
+		if (!model->coarse->trainModel(coarse_images, label_num, coarse_feature_dim))
+		{
+			std::cout << "Error: FaceRecognizer::trainNewModel: coarse cascade stage could not be trained, the full model is used alone.\n" << std::endl;
+			model->coarse->trained_ = false;
+		}
 	}
+	model->incremental_updates = 0;
 
-	saveRecognitionModel();
 	return trained;
-
 }
 
-unsigned long ipa_PeopleDetector::FaceRecognizer::saveRecognitionModel()
+unsigned long ipa_PeopleDetector::FaceRecognizer::updateRecognitionModel(RecognitionModel& model, std::vector<std::string>& new_labels)
 {
-	boost::filesystem::path path = m_data_directory;
-	boost::filesystem::path complete = path / "rdata_color.xml";
+	// load the training images of the new persons only
+	std::vector<cv::Mat> face_images;
+	std::vector<std::string> new_face_labels;
+	{
+		boost::lock_guard<boost::mutex> lock(m_data_mutex);
+		loadTrainingData(face_images, new_labels, true);
+		new_face_labels = m_face_labels;
+	}
 
-	if (fs::is_directory(path.string()))
+	// new persons continue the numbering of the model labels
+	std::vector<int> label_num;
+	for (unsigned int li = 0; li < new_face_labels.size(); li++)
 	{
-		if (fs::is_regular_file(complete.string()))
+		for (unsigned int lj = 0; lj < new_labels.size(); lj++)
 		{
-			if (fs::remove(complete.string()) == false)
-			{
-				std::cout << "Error: FaceRecognizer::saveRecognitionModel: Cannot remove old recognizer data.\n" << std::endl;
-				return ipa_Utils::RET_FAILED;
-			}
+			if (new_labels[lj].compare(new_face_labels[li]) == 0)
+				label_num.push_back(model.label_set.size() + lj);
+		}
+	}
+
+	if (face_images.size() > 0)
+	{
+		setTrainingProgress(0.4, "updating recognition model");
+		std::vector<cv::Mat> in_vec;
+		for (unsigned int i = 0; i < face_images.size(); i++)
+		{
+			cv::Mat temp;
+			face_images[i].convertTo(temp, CV_64FC1);
+			in_vec.push_back(temp);
 		}
-		eff_color->saveModel(complete);
 
-		std::cout << "OPENING at " << complete.string() << std::endl;
-		cv::FileStorage fileStorage(complete.string(), cv::FileStorage::APPEND);
-		if (!fileStorage.isOpened())
+		if (!model.color->updateModel(in_vec, label_num))
 		{
-			std::cout << "Error: FaceRecognizer::saveRecognitionModel: Can't save training data.\n" << std::endl;
+			std::cout << "INFO: FaceRecognizer::updateRecognitionModel: model can not be updated incrementally.\n" << std::endl;
 			return ipa_Utils::RET_FAILED;
 		}
 
-		fileStorage << "string_labels" << "[";
-		for (int i = 0; i < m_face_labels.size(); i++)
+		// the coarse stage has to cover the same training images in the same order
+		if (model.coarse)
 		{
-			fileStorage << m_face_labels[i];
+			std::vector<cv::Mat> coarse_images;
+			resizeToCascade(in_vec, coarse_images);
+			if (model.coarse->trained_ == false || !model.coarse->updateModel(coarse_images, label_num))
+			{
+				std::cout << "INFO: FaceRecognizer::updateRecognitionModel: coarse cascade stage can not be updated incrementally.\n" << std::endl;
+				return ipa_Utils::RET_FAILED;
+			}
 		}
-		fileStorage << "]";
+		model.incremental_updates++;
+	}
 
-		fileStorage.release();
+	model.face_labels.insert(model.face_labels.end(), new_face_labels.begin(), new_face_labels.end());
+	model.label_set.insert(model.label_set.end(), new_labels.begin(), new_labels.end());
 
-		std::cout << "INFO: FaceRecognizer::saveRecognitionModel: recognizer data saved.\n" << std::endl;
-	}
-	else
-	{
-		std::cerr << "Error: FaceRecognizer::saveRecognitionModel: Path '" << path << "' is not a directory." << std::endl;
-		return ipa_Utils::RET_FAILED;
-	}
+	std::cout << "INFO: FaceRecognizer::updateRecognitionModel: " << face_images.size() << " images of " << new_labels.size() << " new persons added ("
+			<< model.incremental_updates << " updates since the last training).\n" << std::endl;
 
 	return ipa_Utils::RET_OK;
 }
 
-unsigned long ipa_PeopleDetector::FaceRecognizer::loadRecognitionModel(std::vector<std::string>& identification_labels_to_recognize)
+unsigned long ipa_PeopleDetector::FaceRecognizer::saveRecognitionModel()
 {
-	// secure this function with a mutex
-	boost::lock_guard<boost::mutex>* lock = new boost::lock_guard<boost::mutex>(m_data_mutex);
+	RecognitionModelPtr model = currentModel();
+	if (!model)
+	{
+		std::cout << "Error: FaceRecognizer::saveRecognitionModel: no model loaded.\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
+	return saveRecognitionModel(*model);
+}
 
-	// check whether currently trained data set corresponds with intentification_labels_to_recognize
+unsigned long ipa_PeopleDetector::FaceRecognizer::saveRecognitionModel(RecognitionModel& model)
+{
 	boost::filesystem::path path = m_data_directory;
-	boost::filesystem::path complete = path / "rdata_color.xml";
 
-	bool training_necessary = false;
-	std::vector<string> temp_face_labels;
 	if (fs::is_directory(path.string()))
 	{
-		cv::FileStorage fileStorage(complete.string(), cv::FileStorage::READ);
-		if (!fileStorage.isOpened())
+		// binary model file, it replaces the previous file atomically
+		ModelFileWriter writer(path / "rdata_color.bin");
+		model.color->writeModel(writer);
+		writer.addStrings("string_labels", model.face_labels);
+		writer.addStrings("label_set", model.label_set);
+		writer.addInt("incremental_updates", model.incremental_updates);
+		if (writer.write() == false)
 		{
-			std::cout << "Info: FaceRecognizer::loadRecognitionModel: Can't open " << complete.string() << ".\n" << std::endl;
-			training_necessary = true;
+			std::cout << "Error: FaceRecognizer::saveRecognitionModel: Can't save recognizer data.\n" << std::endl;
+			return ipa_Utils::RET_FAILED;
 		}
-		else
-		{
-			// load model labels
-			cv::FileNode fn = fileStorage["string_labels"];
-			cv::FileNodeIterator it = fn.begin(), it_end = fn.end();
-			int idx = 0;
-			m_current_label_set.clear();
-			for (; it != it_end; ++it, idx++)
-			{
-				temp_face_labels.push_back(*it);
-				bool new_label = true;
-				if (idx > 0)
-				{
-					for (int i = 0; i < m_current_label_set.size(); i++)
-					{
-						if (m_current_label_set[i].compare(*it) == 0)
-							new_label = false;
-					}
-				}
-				if (new_label)
-					m_current_label_set.push_back(*it);
-			}
-
-			// A vector containing all different labels from the training session exactly once, order of appearance matters! (m_current_label_set[i] stores the corresponding name to the average face coordinates in the face subspace in m_face_class_average_projections.rows(i))
-			bool same_data_set = true;
-			if (identification_labels_to_recognize.size() == 0 || m_current_label_set.size() != identification_labels_to_recognize.size())
-			{
-				same_data_set = false;
-			}
-			else
-			{
-				for (uint i = 0; i < identification_labels_to_recognize.size(); i++)
-				{
-					if (identification_labels_to_recognize[i].compare(m_current_label_set[i]) != 0)
-					{
-						same_data_set = false;
-						break;
-					}
-				}
-			}
 
-			if (same_data_set == true)
-			{
-				eff_color->loadModel(complete);
-				m_face_labels = temp_face_labels;
-				std::cout << "INFO: FaceRecognizer::loadRecognitionModel: recognizer data loaded.\n" << std::endl;
-			}
-			else
+		// coarse cascade stage, tagged with its resolution
+		boost::filesystem::path coarse_file = path / "rdata_coarse.bin";
+		if (model.coarse && model.coarse->trained_ == true)
+		{
+			ModelFileWriter coarse_writer(coarse_file);
+			model.coarse->writeModel(coarse_writer);
+			coarse_writer.addInt("cascade_size", m_cascade_size);
+			if (coarse_writer.write() == false)
 			{
-				training_necessary = true;
+				std::cout << "Error: FaceRecognizer::saveRecognitionModel: Can't save coarse cascade stage.\n" << std::endl;
+				return ipa_Utils::RET_FAILED;
 			}
-
-			fileStorage.release();
-			delete lock;
-			lock = 0;
 		}
+		else if (fs::is_regular_file(coarse_file.string()))
+			fs::remove(coarse_file.string());
+
+		// the gallery index and the quantized gallery are stored in the model files, their files of previous versions would be outdated now
+		const char* outdated_files[] = { "rdata_color_index.xml", "rdata_coarse_index.xml", "rdata_color_quantized.xml", "rdata_coarse_quantized.xml" };
+		for (int i = 0; i < 4; i++)
+			if (fs::is_regular_file((path / outdated_files[i]).string()))
+				fs::remove((path / outdated_files[i]).string());
+
+		// XML is only written as export format, outdated exports are removed so that they are not mistaken for the model
+		if (m_export_xml_model == true)
+			exportRecognitionModel(model);
+		else
+		{
+			if (fs::is_regular_file((path / "rdata_color.xml").string()))
+				fs::remove((path / "rdata_color.xml").string());
+			if (fs::is_regular_file((path / "rdata_coarse.xml").string()))
+				fs::remove((path / "rdata_coarse.xml").string());
+		}
+
+		std::cout << "INFO: FaceRecognizer::saveRecognitionModel: recognizer data saved.\n" << std::endl;
 	}
 	else
 	{
-		std::cerr << "Error: FaceRecognizer::loadRecognizerData: Path '" << path.string() << "' is not a directory." << std::endl;
+		std::cerr << "Error: FaceRecognizer::saveRecognitionModel: Path '" << path << "' is not a directory." << std::endl;
 		return ipa_Utils::RET_FAILED;
 	}
 
-	if (training_necessary == true)
-	{
-		// stored set differs from requested set -> recompute the model from training data
-		// release lock, trainRecognitionModel requests its own lock
-		if (lock != 0)
-			delete lock;
+	return ipa_Utils::RET_OK;
+}
 
-		unsigned long return_value = trainRecognitionModel(identification_labels_to_recognize);
-		if (return_value == ipa_Utils::RET_FAILED)
+unsigned long ipa_PeopleDetector::FaceRecognizer::exportRecognitionModel(RecognitionModel& model)
+{
+	boost::filesystem::path path = m_data_directory;
+	boost::filesystem::path complete = path / "rdata_color.xml";
+
+	if (fs::is_regular_file(complete.string()))
+	{
+		if (fs::remove(complete.string()) == false)
+		{
+			std::cout << "Error: FaceRecognizer::exportRecognitionModel: Cannot remove old recognizer data.\n" << std::endl;
 			return ipa_Utils::RET_FAILED;
+		}
+	}
+	model.color->saveModel(complete);
 
+	std::cout << "OPENING at " << complete.string() << std::endl;
+	cv::FileStorage fileStorage(complete.string(), cv::FileStorage::APPEND);
+	if (!fileStorage.isOpened())
+	{
+		std::cout << "Error: FaceRecognizer::exportRecognitionModel: Can't save training data.\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
 	}
 
-	if (m_debug == true)
+	fileStorage << "string_labels" << "[";
+	for (int i = 0; i < model.face_labels.size(); i++)
 	{
-		std::cout << "Current model set:" << std::endl;
-		for (int i = 0; i < (int)m_current_label_set.size(); i++)
-			std::cout << "   - " << m_current_label_set[i] << std::endl;
-		std::cout << std::endl;
+		fileStorage << model.face_labels[i];
+	}
+	fileStorage << "]";
+	fileStorage << "label_set" << "[";
+	for (int i = 0; i < model.label_set.size(); i++)
+	{
+		fileStorage << model.label_set[i];
 	}
+	fileStorage << "]";
+	fileStorage << "incremental_updates" << model.incremental_updates;
+
+	fileStorage.release();
+
+	boost::filesystem::path coarse_file = path / "rdata_coarse.xml";
+	if (model.coarse && model.coarse->trained_ == true)
+	{
+		model.coarse->saveModel(coarse_file);
+		cv::FileStorage coarseStorage(coarse_file.string(), cv::FileStorage::APPEND);
+		if (!coarseStorage.isOpened())
+		{
+			std::cout << "Error: FaceRecognizer::exportRecognitionModel: Can't save coarse cascade stage.\n" << std::endl;
+			return ipa_Utils::RET_FAILED;
+		}
+		coarseStorage << "cascade_size" << m_cascade_size;
+		coarseStorage.release();
+	}
+	else if (fs::is_regular_file(coarse_file.string()))
+		fs::remove(coarse_file.string());
 
 	return ipa_Utils::RET_OK;
 }
 
-unsigned long ipa_PeopleDetector::FaceRecognizer::recognizeFace(cv::Mat& color_image, std::vector<cv::Rect>& face_coordinates, std::vector<std::string>& identification_labels)
+unsigned long ipa_PeopleDetector::FaceRecognizer::loadRecognitionModel(std::vector<std::string>& identification_labels_to_recognize)
 {
-	// secure this function with a mutex
-	boost::lock_guard<boost::mutex> lock(m_data_mutex);
+	// only one training or loading at a time, the recognition continues with the published model meanwhile
+	boost::lock_guard<boost::mutex> training_lock(m_training_mutex);
+	setTrainingProgress(0.0, "reading stored model");
+
+	// check whether currently trained data set corresponds with intentification_labels_to_recognize
+	boost::filesystem::path path = m_data_directory;
 
-	if (eff_color->trained_ == false)
+	if (!fs::is_directory(path.string()))
 	{
-		std::cout << "Error: FaceRecognizer::recognizeFace: Load or train some identification model, first.\n" << std::endl;
+		std::cerr << "Error: FaceRecognizer::loadRecognizerData: Path '" << path.string() << "' is not a directory." << std::endl;
+		setTrainingProgress(1.0, "failed");
 		return ipa_Utils::RET_FAILED;
 	}
 
-	identification_labels.clear();
-
-	cv::Mat resized_8U1;
-	cv::Size resized_size(m_eigenvectors[0].size());
-	for (int i = 0; i < (int)face_coordinates.size(); i++)
+	bool training_necessary = false;
+	bool model_changed = false;
+	RecognitionModelPtr model(new RecognitionModel);
+	boost::shared_ptr<ModelFile> model_file;
+	if (readModelLabels(*model, model_file) != ipa_Utils::RET_OK)
 	{
-		cv::Rect face = face_coordinates[i];
-		cv::Size norm_size = cv::Size(m_norm_size, m_norm_size);
-		convertAndResize(color_image, resized_8U1, face, norm_size);
-
-		double DFFS;
-		resized_8U1.convertTo(resized_8U1, CV_64FC1);
-
-		cv::Mat coeff_arr;
-		//eff_color.projectToSubspace(resized_8U1,coeff_arr,DFFS);
-
-		if (m_debug)
-			std::cout << "distance to face space: " << DFFS << std::endl;
-		//TODO temporary turned off
-		if (0 == 1)
+		training_necessary = true;
+	}
+	else
+	{
+		// class numbers of the model, label_set[i] is the name of class i (the order of the training request, not the order of the stored faces)
+		std::vector<std::string>& label_set = model->label_set;
+
+		// the requested labels are compared as a set, a model serves any subset of its labels by masking the other model features
+		boost::unordered_set<std::string> stored_labels(label_set.begin(), label_set.end());
+		std::vector<std::string> missing_labels;
+		boost::unordered_set<std::string> requested_labels;
+		for (int i = 0; i < (int)identification_labels_to_recognize.size(); i++)
 		{
-			// no face
-			identification_labels.push_back("No face");
+			if (requested_labels.insert(identification_labels_to_recognize[i]).second == true && stored_labels.count(identification_labels_to_recognize[i]) == 0)
+				missing_labels.push_back(identification_labels_to_recognize[i]);
 		}
-		else
-		{
+		bool same_data_set = (identification_labels_to_recognize.size() > 0 && missing_labels.size() == 0);
+
+		// persons missing in the stored set can be added by an incremental update of the model
+		bool extended_data_set = (identification_labels_to_recognize.size() > 0 && missing_labels.size() > 0 && m_max_incremental_updates > 0
+				&& model->incremental_updates < m_max_incremental_updates);
 
-			int res_label;
-			eff_color->classifyImage(resized_8U1, res_label);
-			if (res_label == -1)
+		if (same_data_set == true)
+		{
+			// the recognizers of the published model are shared if it is the stored model, only the mask changes
+			RecognitionModelPtr published = currentModel();
+			if (published && published->color && published->color->trained_ == true && published->label_set == model->label_set
+					&& published->face_labels == model->face_labels)
 			{
-				identification_labels.push_back("Unknown Face");
+				model->color = published->color;
+				model->coarse = published->coarse;
+				std::cout << "INFO: FaceRecognizer::loadRecognitionModel: published recognizer data reused.\n" << std::endl;
 			}
 			else
 			{
-				identification_labels.push_back(m_current_label_set[res_label]);
+				setTrainingProgress(0.3, "loading recognition model");
+				if (loadStoredModel(*model, RecognitionModelPtr(), model_file) == ipa_Utils::RET_OK)
+					std::cout << "INFO: FaceRecognizer::loadRecognitionModel: recognizer data loaded.\n" << std::endl;
+				else
+					training_necessary = true;
 			}
 		}
+		else if (extended_data_set == true)
+		{
+			// the published model may keep intermediate training results that are lost by reloading it
+			setTrainingProgress(0.1, "loading recognition model");
+			if (loadStoredModel(*model, currentModel(), model_file) == ipa_Utils::RET_OK && updateRecognitionModel(*model, missing_labels) == ipa_Utils::RET_OK)
+				model_changed = true;
+			else
+				training_necessary = true;
+		}
+		else
+		{
+			training_necessary = true;
+		}
+	}
+
+	if (training_necessary == true)
+	{
+		// stored set differs from requested set -> recompute the model from training data
+		unsigned long return_value = trainNewModel(identification_labels_to_recognize, model);
+		if (return_value == ipa_Utils::RET_FAILED)
+		{
+			setTrainingProgress(1.0, "failed");
+			return ipa_Utils::RET_FAILED;
+		}
+	}
+
+	if (training_necessary == true || model_changed == true)
+	{
+		setTrainingProgress(0.9, "saving model");
+		saveRecognitionModel(*model);
+	}
+	setActiveLabels(*model, identification_labels_to_recognize);
+	identification_labels_to_recognize = model->active_labels;
+	{
+		boost::lock_guard<boost::mutex> lock(m_data_mutex);
+		m_face_labels = model->face_labels;
+		rebuildLabelIndex();
+		// the model labels do not refer to archive records, the next save rewrites the archive
+		m_archive_records.clear();
+	}
+	publishModel(model);
+	setTrainingProgress(1.0, "done");
+
+	if (m_debug == true)
+	{
+		std::cout << "Current model set:" << std::endl;
+		for (int i = 0; i < (int)model->active_labels.size(); i++)
+			std::cout << "   - " << model->active_labels[i] << std::endl;
+		if (model->active_rows.size() > 0)
+			std::cout << "(" << model->active_labels.size() << " of " << model->label_set.size() << " stored persons)" << std::endl;
+		std::cout << std::endl;
 	}
 
 	return ipa_Utils::RET_OK;
 }
 
-unsigned long ipa_PeopleDetector::FaceRecognizer::recognizeFace(cv::Mat& color_image, cv::Mat& depth_image, std::vector<cv::Rect>& face_coordinates,
-		std::vector<std::string>& identification_labels)
+void ipa_PeopleDetector::FaceRecognizer::setActiveLabels(RecognitionModel& model, const std::vector<std::string>& labels)
+{
+	// an empty request serves the whole model
+	boost::unordered_set<std::string> requested_labels(labels.begin(), labels.end());
+	if (requested_labels.size() == 0)
+		requested_labels.insert(model.label_set.begin(), model.label_set.end());
+
+	model.active_labels.clear();
+	for (int i = 0; i < (int)model.label_set.size(); i++)
+		if (requested_labels.count(model.label_set[i]) > 0)
+			model.active_labels.push_back(model.label_set[i]);
+
+	model.label_rows.clear();
+	for (int i = 0; i < (int)model.face_labels.size(); i++)
+		if (requested_labels.count(model.face_labels[i]) > 0)
+			model.label_rows[model.face_labels[i]].push_back(i);
+
+	model.active_rows.clear();
+	model.row_active.clear();
+	if (model.active_labels.size() == model.label_set.size())
+		return;
+
+	model.row_active.resize(model.face_labels.size(), false);
+	for (int i = 0; i < (int)model.face_labels.size(); i++)
+	{
+		if (requested_labels.count(model.face_labels[i]) > 0)
+		{
+			model.active_rows.push_back(i);
+			model.row_active[i] = true;
+		}
+	}
+}
+
+unsigned long ipa_PeopleDetector::FaceRecognizer::loadStoredModel(RecognitionModel& model, const RecognitionModelPtr& in_memory,
+		const boost::shared_ptr<ModelFile>& model_file)
+{
+	// recognizers of a published model are only read by the recognition, the copy is updated instead
+	bool model_in_memory = (in_memory && in_memory->color && in_memory->color->trained_ == true && in_memory->label_set == model.label_set
+			&& in_memory->face_labels == model.face_labels);
+	if (model_in_memory == true)
+	{
+		model.color.reset(in_memory->color->clone());
+		if (in_memory->coarse)
+			model.coarse.reset(static_cast<FaceRecognizer_Eigenfaces*>(in_memory->coarse->clone()));
+		model_in_memory = (model.color && (model.coarse || !in_memory->coarse));
+	}
+	if (model_in_memory == true)
+		return ipa_Utils::RET_OK;
+
+	// the binary model is used in place, the XML export is only parsed if no binary model exists
+	model.color.reset(createColorRecognizer());
+	if (model_file)
+	{
+		if (model.color->readModel(model_file) == false)
+			return ipa_Utils::RET_FAILED;
+	}
+	else
+	{
+		boost::filesystem::path complete = m_data_directory / "rdata_color.xml";
+		model.color->loadModel(complete);
+	}
+
+	model.coarse.reset(createCoarseRecognizer());
+	if (model.coarse)
+		return loadCoarseModel(*model.coarse);
+	return ipa_Utils::RET_OK;
+}
+
+unsigned long ipa_PeopleDetector::FaceRecognizer::readModelLabels(RecognitionModel& model, boost::shared_ptr<ModelFile>& model_file)
+{
+	model.face_labels.clear();
+	model.label_set.clear();
+	model.incremental_updates = 0;
+
+	// binary model file
+	model_file.reset(new ModelFile);
+	boost::filesystem::path binary_file = m_data_directory / "rdata_color.bin";
+	if (model_file->open(binary_file) == true)
+	{
+		if (model_file->getStrings("string_labels", model.face_labels) && model_file->getStrings("label_set", model.label_set)
+				&& model_file->getInt("incremental_updates", model.incremental_updates))
+			return checkModelLabels(model, binary_file);
+		std::cout << "Info: FaceRecognizer::readModelLabels: " << binary_file.string() << " contains no labels.\n" << std::endl;
+		model.face_labels.clear();
+		model.label_set.clear();
+		model.incremental_updates = 0;
+	}
+	model_file.reset();
+
+	// XML export or model of a previous version
+	boost::filesystem::path complete = m_data_directory / "rdata_color.xml";
+	cv::FileStorage fileStorage(complete.string(), cv::FileStorage::READ);
+	if (!fileStorage.isOpened())
+	{
+		std::cout << "Info: FaceRecognizer::readModelLabels: Can't open " << binary_file.string() << " or " << complete.string() << ".\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
+	cv::FileNode fn = fileStorage["string_labels"];
+	cv::FileNodeIterator it = fn.begin(), it_end = fn.end();
+	for (; it != it_end; ++it)
+		model.face_labels.push_back((std::string)*it);
+	fn = fileStorage["label_set"];
+	for (it = fn.begin(), it_end = fn.end(); it != it_end; ++it)
+		model.label_set.push_back((std::string)*it);
+	model.incremental_updates = (int)fileStorage["incremental_updates"];
+	fileStorage.release();
+
+	return checkModelLabels(model, complete);
+}
+
+unsigned long ipa_PeopleDetector::FaceRecognizer::checkModelLabels(RecognitionModel& model, const boost::filesystem::path& model_file)
+{
+	// models of previous versions do not store the class names, they can not be told from the order of the stored faces
+	boost::unordered_set<std::string> classes(model.label_set.begin(), model.label_set.end());
+	bool complete = (model.label_set.size() > 0 && classes.size() == model.label_set.size());
+	for (int i = 0; i < (int)model.face_labels.size() && complete == true; i++)
+		complete = (classes.count(model.face_labels[i]) > 0);
+	if (complete == false)
+	{
+		std::cout << "Info: FaceRecognizer::readModelLabels: " << model_file.string() << " does not store the names of its classes, the model is trained again.\n" << std::endl;
+		model.face_labels.clear();
+		model.label_set.clear();
+		model.incremental_updates = 0;
+		return ipa_Utils::RET_FAILED;
+	}
+	return ipa_Utils::RET_OK;
+}
+
+bool ipa_PeopleDetector::FaceRecognizer::startLoadingRecognitionModel(const std::vector<std::string>& identification_labels_to_recognize)
+{
+	boost::lock_guard<boost::mutex> lock(m_progress_mutex);
+	if (m_job_running == true)
+		return false;
+
+	// the previous job has finished already
+	if (m_training_thread != 0)
+	{
+		m_training_thread->join();
+		delete m_training_thread;
+	}
+	m_job_labels = identification_labels_to_recognize;
+	m_job_result = ipa_Utils::RET_FAILED;
+	m_job_running = true;
+	m_training_progress = 0.0;
+	m_training_status = "waiting";
+	m_training_thread = new boost::thread(boost::bind(&FaceRecognizer::loadingJob, this));
+	return true;
+}
+
+void ipa_PeopleDetector::FaceRecognizer::loadingJob()
+{
+	std::vector<std::string> identification_labels_to_recognize;
+	{
+		boost::lock_guard<boost::mutex> lock(m_progress_mutex);
+		identification_labels_to_recognize = m_job_labels;
+	}
+
+	unsigned long result = loadRecognitionModel(identification_labels_to_recognize);
+
+	boost::lock_guard<boost::mutex> lock(m_progress_mutex);
+	m_job_labels = identification_labels_to_recognize;
+	m_job_result = result;
+	m_job_running = false;
+}
+
+bool ipa_PeopleDetector::FaceRecognizer::isLoadingRecognitionModel()
+{
+	boost::lock_guard<boost::mutex> lock(m_progress_mutex);
+	return m_job_running;
+}
+
+unsigned long ipa_PeopleDetector::FaceRecognizer::finishLoadingRecognitionModel(std::vector<std::string>& identification_labels_to_recognize)
+{
+	boost::thread* training_thread = 0;
+	{
+		boost::lock_guard<boost::mutex> lock(m_progress_mutex);
+		training_thread = m_training_thread;
+		m_training_thread = 0;
+	}
+	if (training_thread == 0)
+		return ipa_Utils::RET_FAILED;
+
+	training_thread->join();
+	delete training_thread;
+
+	boost::lock_guard<boost::mutex> lock(m_progress_mutex);
+	identification_labels_to_recognize = m_job_labels;
+	return m_job_result;
+}
+
+void ipa_PeopleDetector::FaceRecognizer::getTrainingProgress(double& progress, std::string& status)
+{
+	boost::lock_guard<boost::mutex> lock(m_progress_mutex);
+	progress = m_training_progress;
+	status = m_training_status;
+}
+
+void ipa_PeopleDetector::FaceRecognizer::setTrainingProgress(double progress, const std::string& status)
+{
+	boost::lock_guard<boost::mutex> lock(m_progress_mutex);
+	m_training_progress = progress;
+	m_training_status = status;
+}
+
+ipa_PeopleDetector::RecognitionModelPtr ipa_PeopleDetector::FaceRecognizer::currentModel()
+{
+	boost::lock_guard<boost::mutex> lock(m_model_mutex);
+	return m_model;
+}
+
+void ipa_PeopleDetector::FaceRecognizer::publishModel(const RecognitionModelPtr& model)
+{
+	// the previous model is released with the last recognition that still uses it
+	boost::lock_guard<boost::mutex> lock(m_model_mutex);
+	m_model = model;
+}
+
+unsigned long ipa_PeopleDetector::FaceRecognizer::recognizeFaces(std::vector<cv::Mat>& color_images, std::vector<cv::Mat>& depth_images,
+		std::vector<std::vector<cv::Rect> >& face_coordinates, std::vector<std::vector<std::string> >& identification_labels)
 {
 	timeval t1, t2;
 	gettimeofday(&t1, NULL);
-	// secure this function with a mutex
-	boost::lock_guard<boost::mutex> lock(m_data_mutex);
+	// the published model is not modified, so recognitions run concurrently with each other and with a training
+	RecognitionModelPtr model = currentModel();
+	if (!model || model->color->trained_ == false)
+	{
+		std::cout << "Error: FaceRecognizer::recognizeFaces: Load or train some identification model, first.\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
+
+	// normalize the faces of all heads in the frame in parallel and classify them together
+	std::vector<std::pair<int, cv::Rect> > faces;
+	for (unsigned int i = 0; i < color_images.size(); i++)
+		for (unsigned int j = 0; j < face_coordinates[i].size(); j++)
+			faces.push_back(std::make_pair((int)i, face_coordinates[i][j]));
+	std::vector<cv::Mat> probes;
+	normalizeProbes(color_images, depth_images, faces, probes);
+
+	std::vector<std::string> labels;
+	classifyProbes(*model, probes, "Unknown", labels);
+
+	identification_labels.clear();
+	identification_labels.resize(face_coordinates.size());
+	int probe_index = 0;
+	for (unsigned int i = 0; i < color_images.size(); i++)
+		for (unsigned int j = 0; j < face_coordinates[i].size(); j++, probe_index++)
+			identification_labels[i].push_back(labels[probe_index]);
 
-	//int number_eigenvectors = m_eigenvectors.size();
-	if (eff_color->trained_ == false)
+	gettimeofday(&t2, NULL);
+	if (m_debug)
+		std::cout << "time =" << (t2.tv_usec - t1.tv_usec) / 1000.0 << std::endl;
+
+	return ipa_Utils::RET_OK;
+}
+
+unsigned long ipa_PeopleDetector::FaceRecognizer::verifyFaces(std::vector<cv::Mat>& color_images, std::vector<cv::Mat>& depth_images,
+		std::vector<std::vector<cv::Rect> >& face_coordinates, const std::string& verification_label, double verification_threshold,
+		std::vector<std::vector<std::string> >& identification_labels, std::vector<std::vector<double> >& distances)
+{
+	RecognitionModelPtr model = currentModel();
+	if (!model || model->color->trained_ == false)
 	{
-		std::cout << "Error: FaceRecognizer::recognizeFace: Load or train some identification model, first.\n" << std::endl;
+		std::cout << "Error: FaceRecognizer::verifyFaces: Load or train some identification model, first.\n" << std::endl;
 		return ipa_Utils::RET_FAILED;
 	}
+	// runs for every frame, the caller checks the label once with servesLabel and reports a missing label itself
+	boost::unordered_map<std::string, std::vector<int> >::const_iterator label_rows = model->label_rows.find(verification_label);
+	if (label_rows == model->label_rows.end())
+		return ipa_Utils::RET_FAILED;
+
+	std::vector<std::pair<int, cv::Rect> > faces;
+	for (unsigned int i = 0; i < color_images.size(); i++)
+		for (unsigned int j = 0; j < face_coordinates[i].size(); j++)
+			faces.push_back(std::make_pair((int)i, face_coordinates[i][j]));
+	std::vector<cv::Mat> probes;
+	normalizeProbes(color_images, depth_images, faces, probes);
+
+	// every face is only compared to the training images of the verified identity
+	std::vector<double> probe_distances(probes.size());
+	cv::parallel_for_(cv::Range(0, probes.size()), ProbeVerificationBody(*model, probes, label_rows->second, probe_distances));
 
 	identification_labels.clear();
+	identification_labels.resize(face_coordinates.size());
+	distances.clear();
+	distances.resize(face_coordinates.size());
+	int probe_index = 0;
+	for (unsigned int i = 0; i < color_images.size(); i++)
+	{
+		for (unsigned int j = 0; j < face_coordinates[i].size(); j++, probe_index++)
+		{
+			identification_labels[i].push_back((probe_distances[probe_index] < verification_threshold) ? verification_label : "Unknown");
+			distances[i].push_back(probe_distances[probe_index]);
+		}
+	}
+
+	return ipa_Utils::RET_OK;
+}
+
+bool ipa_PeopleDetector::FaceRecognizer::servesLabel(const std::string& label)
+{
+	RecognitionModelPtr model = currentModel();
+	return (model && model->color->trained_ == true && model->label_rows.find(label) != model->label_rows.end());
+}
 
-	//cv::Size resized_size(m_eigenvectors[0].size());
+unsigned long ipa_PeopleDetector::FaceRecognizer::recognizeFace(cv::Mat& color_image, std::vector<cv::Rect>& face_coordinates, std::vector<std::string>& identification_labels)
+{
+	// the published model is not modified, so recognitions run concurrently with each other and with a training
+	RecognitionModelPtr model = currentModel();
+	if (!model || model->color->trained_ == false)
+	{
+		std::cout << "Error: FaceRecognizer::recognizeFace: Load or train some identification model, first.\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
+
+	std::vector<cv::Mat> probes(face_coordinates.size());
+	cv::Size norm_size = cv::Size(m_norm_size, m_norm_size);
 	for (int i = 0; i < (int)face_coordinates.size(); i++)
 	{
 		cv::Rect face = face_coordinates[i];
-		//convertAndResize(depth_image, resized_8U1, face, resized_size);
-		cv::Mat color_crop = color_image(face);
-		cv::Mat depth_crop_xyz = depth_image(face);
+		convertAndResize(color_image, probes[i], face, norm_size);
+		probes[i].convertTo(probes[i], m_model_type);
+	}
 
-		cv::Mat DM_crop = cv::Mat::zeros(m_norm_size, m_norm_size, CV_8UC1);
-		cv::Size norm_size = cv::Size(m_norm_size, m_norm_size);
-		if (face_normalizer_.normalizeFace(color_crop, depth_crop_xyz, norm_size, DM_crop))
-			;
+	classifyProbes(*model, probes, "Unknown Face", identification_labels);
 
-		double DFFS;
-		cv::Mat temp;
-		color_crop.convertTo(color_crop, CV_64FC1);
+	return ipa_Utils::RET_OK;
+}
 
-		int res_label_color, res_label_depth;
-		std::string class_color;
+unsigned long ipa_PeopleDetector::FaceRecognizer::recognizeFace(cv::Mat& color_image, cv::Mat& depth_image, std::vector<cv::Rect>& face_coordinates,
+		std::vector<std::string>& identification_labels)
+{
+	timeval t1, t2;
+	gettimeofday(&t1, NULL);
+	// the published model is not modified, so recognitions run concurrently with each other and with a training
+	RecognitionModelPtr model = currentModel();
+	if (!model || model->color->trained_ == false)
+	{
+		std::cout << "Error: FaceRecognizer::recognizeFace: Load or train some identification model, first.\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
 
-		if (eff_color->trained_)
-		{
-			eff_color->classifyImage(color_crop, res_label_color);
-			if (res_label_color == -1)
-			{
-				class_color = "Unknown";
-			}
-			else
-			{
-				class_color = m_current_label_set[res_label_color];
-			}
-		}
+	std::vector<cv::Mat> color_images(1, color_image), depth_images(1, depth_image);
+	std::vector<std::pair<int, cv::Rect> > faces;
+	for (int i = 0; i < (int)face_coordinates.size(); i++)
+		faces.push_back(std::make_pair(0, face_coordinates[i]));
+	std::vector<cv::Mat> probes;
+	normalizeProbes(color_images, depth_images, faces, probes);
 
-		identification_labels.push_back(class_color);
-	}
+	classifyProbes(*model, probes, "Unknown", identification_labels);
 
 	gettimeofday(&t2, NULL);
 	if (m_debug)
@@ -590,337 +1522,476 @@ unsigned long ipa_PeopleDetector::FaceRecognizer::recognizeFace(cv::Mat& color_i
 	return ipa_Utils::RET_OK;
 }
 
-unsigned long ipa_PeopleDetector::FaceRecognizer::convertAndResize(cv::Mat& img, cv::Mat& resized, cv::Rect& face, cv::Size new_size)
+void ipa_PeopleDetector::FaceRecognizer::normalizeProbes(std::vector<cv::Mat>& color_images, std::vector<cv::Mat>& depth_images,
+		const std::vector<std::pair<int, cv::Rect> >& faces, std::vector<cv::Mat>& probes)
 {
-	resized = img(face);
-	cv::resize(resized, resized, new_size);
-
-	//cv::cvtColor(resized, resized, CV_BGR2GRAY);
-
-	return ipa_Utils::RET_OK;
+	probes.resize(faces.size());
+	cv::Size norm_size = cv::Size(m_norm_size, m_norm_size);
+	cv::parallel_for_(cv::Range(0, faces.size()), ProbeNormalizationBody(color_images, depth_images, faces, norm_size, m_model_type, m_probe_normalizers, probes));
 }
 
-unsigned long ipa_PeopleDetector::FaceRecognizer::saveTrainingData(std::vector<cv::Mat>& face_images)
+unsigned long ipa_PeopleDetector::FaceRecognizer::loadCoarseModel(FaceRecognizer_Eigenfaces& coarse)
 {
-	boost::filesystem::path path = m_data_directory;
-	boost::filesystem::path complete = path / "tdata.xml";
-	std::string img_ext = ".bmp";
+	coarse.trained_ = false;
 
-	if (fs::is_directory(complete))
+	// binary model file
+	boost::filesystem::path binary_file = m_data_directory / "rdata_coarse.bin";
+	boost::shared_ptr<ModelFile> model_file(new ModelFile);
+	int cascade_size = 0;
+	if (model_file->open(binary_file) == true && model_file->getInt("cascade_size", cascade_size) == true)
 	{
-		cv::FileStorage fileStorage(complete.string(), cv::FileStorage::WRITE);
-		if (!fileStorage.isOpened())
+		if (cascade_size != m_cascade_size)
 		{
-			std::cout << "Error: FaceRecognizer::saveTrainingData: Can't save training data.\n" << std::endl;
+			std::cout << "Info: FaceRecognizer::loadCoarseModel: coarse cascade stage was trained with " << cascade_size << "x" << cascade_size << " pixels.\n" << std::endl;
 			return ipa_Utils::RET_FAILED;
 		}
+		return (coarse.readModel(model_file) == true) ? ipa_Utils::RET_OK : ipa_Utils::RET_FAILED;
+	}
 
-		// store data
-		fileStorage << "number_entries" << (int)m_face_labels.size();
-		for (int i = 0; i < (int)m_face_labels.size(); i++)
-		{
-			// labels
-			std::ostringstream tag;
-			tag << "label_" << i;
-			fileStorage << tag.str().c_str() << m_face_labels[i].c_str();
+	// XML export or model of a previous version
+	boost::filesystem::path coarse_file = m_data_directory / "rdata_coarse.xml";
+	cv::FileStorage fileStorage(coarse_file.string(), cv::FileStorage::READ);
+	if (!fileStorage.isOpened())
+	{
+		std::cout << "Info: FaceRecognizer::loadCoarseModel: Can't open " << binary_file.string() << " or " << coarse_file.string() << ".\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
+	cascade_size = (int)fileStorage["cascade_size"];
+	fileStorage.release();
+	if (cascade_size != m_cascade_size)
+	{
+		std::cout << "Info: FaceRecognizer::loadCoarseModel: coarse cascade stage was trained with " << cascade_size << "x" << cascade_size << " pixels.\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
 
-			// face images
-			boost::filesystem::path img_path = path / "img" / (boost::lexical_cast<string>(i) + img_ext);
-			std::ostringstream img, shortname;
-			shortname << "img/" << i << img_ext;
-			std::ostringstream tag2;
-			tag2 << "image_" << i;
-			fileStorage << tag2.str().c_str() << shortname.str().c_str();
-			cv::imwrite(img_path.string(), face_images[i]);
-		}
+	coarse.loadModel(coarse_file);
+	return ipa_Utils::RET_OK;
+}
 
-		fileStorage.release();
+void ipa_PeopleDetector::FaceRecognizer::resizeToCascade(std::vector<cv::Mat>& images, std::vector<cv::Mat>& coarse_images)
+{
+	cv::Size cascade_size = cv::Size(m_cascade_size, m_cascade_size);
+	coarse_images.resize(images.size());
+	for (int i = 0; i < (int)images.size(); i++)
+	{
+		cv::Mat temp;
+		images[i].convertTo(temp, CV_64FC1);
+		cv::resize(temp, coarse_images[i], cascade_size, 0, 0, cv::INTER_AREA);
+	}
+}
 
-		std::cout << "INFO: FaceRecognizer::saveTrainingData: " << face_images.size() << " color images saved.\n" << std::endl;
+void ipa_PeopleDetector::FaceRecognizer::classifyProbes(RecognitionModel& model, std::vector<cv::Mat>& probes, const std::string& unknown_label,
+		std::vector<std::string>& identification_labels)
+{
+	// a model that serves a subset of its labels only compares the model features of the served labels
+	bool masked = (model.active_rows.size() > 0);
+	bool cascade = (model.coarse && model.coarse->trained_ == true);
+	std::vector<int> res_labels(probes.size());
+	if (cascade == true || masked == true)
+	{
+		// cascade: the coarse stage rejects unknown faces and selects the candidates, the full model only verifies them
+		std::vector<cv::Mat> coarse_probes;
+		if (cascade == true)
+			resizeToCascade(probes, coarse_probes);
+		cv::parallel_for_(cv::Range(0, probes.size()), ProbeClassificationBody(model, probes, coarse_probes, m_cascade_candidates, res_labels));
 	}
 	else
+		model.color->classifyImages(probes, res_labels);
+
+	identification_labels.clear();
+	for (int i = 0; i < (int)res_labels.size(); i++)
 	{
-		std::cerr << "Error: FaceRecognizer::saveTrainingData: Path '" << path << "' is not a directory." << std::endl;
-		return ipa_Utils::RET_FAILED;
+		if (res_labels[i] == -1)
+			identification_labels.push_back(unknown_label);
+		else
+			identification_labels.push_back(model.label_set[res_labels[i]]);
 	}
+}
+
+unsigned long ipa_PeopleDetector::FaceRecognizer::convertAndResize(cv::Mat& img, cv::Mat& resized, cv::Rect& face, cv::Size new_size)
+{
+	resized = img(face);
+	cv::resize(resized, resized, new_size);
+
+	//cv::cvtColor(resized, resized, CV_BGR2GRAY);
 
 	return ipa_Utils::RET_OK;
 }
 
+unsigned long ipa_PeopleDetector::FaceRecognizer::saveTrainingData(std::vector<cv::Mat>& face_images)
+{
+	boost::lock_guard<boost::mutex> lock(m_data_mutex);
+	return saveTrainingDataArchive(face_images, 0);
+}
+
 unsigned long ipa_PeopleDetector::FaceRecognizer::saveTrainingData(std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps)
+{
+	boost::lock_guard<boost::mutex> lock(m_data_mutex);
+	return saveTrainingDataArchive(face_images, &face_depthmaps);
+}
+
+unsigned long ipa_PeopleDetector::FaceRecognizer::saveTrainingDataArchive(std::vector<cv::Mat>& face_images, std::vector<cv::Mat>* face_depthmaps)
 {
 	boost::filesystem::path path = m_data_directory;
-	boost::filesystem::path complete = path / "tdata.xml";
-	std::string img_ext = ".bmp";
-	std::string dm_ext = ".xml";
+	if (!fs::is_directory(path.string()))
+	{
+		std::cerr << "Error: FaceRecognizer::saveTrainingData: Path '" << path << "' is not a directory." << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
 
-	if (fs::is_directory(path.string()))
+	// the journal is continued if the stored faces keep the order of their records and new faces follow at the end
+	int number_faces = (int)m_face_labels.size();
+	int first_new = number_faces;
+	bool incremental = (m_training_archive.isOpen() == true && (int)m_archive_records.size() == number_faces);
+	int last_record = -1;
+	for (int i = 0; i < number_faces && incremental == true; i++)
+	{
+		int record = m_archive_records[i];
+		if (record < 0)
+			first_new = std::min(first_new, i);
+		else if (first_new < number_faces || record <= last_record || record >= m_training_archive.numRecords() || m_training_archive.isLive(record) == false)
+			incremental = false;
+		else
+			last_record = record;
+	}
+	TrainingDataArchiveWriter writer;
+	if (incremental == true)
+		incremental = writer.openForAppend(m_training_archive);
+	if (incremental == false)
+		return rewriteTrainingDataArchive(face_images, face_depthmaps);
+
+	// deleted faces: stored records which are no longer referenced
+	int deleted = 0, relabeled = 0;
+	for (int i = 0, k = 0; i < m_training_archive.size(); i++)
 	{
-		cv::FileStorage fileStorage(complete.string(), cv::FileStorage::WRITE);
-		if (!fileStorage.isOpened())
+		int record = m_training_archive.record(i);
+		if (k < first_new && m_archive_records[k] == record)
+			k++;
+		else
 		{
-			std::cout << "Error: FaceRecognizer::saveTrainingData: Can't save training data.\n" << std::endl;
-			return ipa_Utils::RET_FAILED;
+			writer.remove(record);
+			deleted++;
 		}
+	}
 
-		// store data
-		fileStorage << "number_entries" << (int)m_face_labels.size();
-		for (int i = 0; i < (int)m_face_labels.size(); i++)
+	// changed labels
+	for (int i = 0; i < first_new; i++)
+	{
+		if (m_training_archive.recordLabel(m_archive_records[i]).compare(m_face_labels[i]) != 0)
 		{
-			// labels
-			std::ostringstream tag;
-			tag << "label_" << i;
-			fileStorage << tag.str().c_str() << m_face_labels[i].c_str();
+			writer.relabel(m_archive_records[i], m_face_labels[i]);
+			relabeled++;
+		}
+	}
 
-			// face images
-			boost::filesystem::path img_path = path / "img" / (boost::lexical_cast<string>(i) + img_ext);
-			std::ostringstream img, shortname_img, shortname_depth;
-			shortname_img << "img/" << i << img_ext;
-			std::ostringstream tag2, tag3;
-			tag2 << "image_" << i;
-			fileStorage << tag2.str().c_str() << shortname_img.str().c_str();
+	// new faces, face_depthmaps ends with the depth maps of the new faces
+	bool dm_aligned = ((int)dm_exist.size() == number_faces);
+	int new_depthmaps = 0;
+	for (int i = first_new; i < number_faces; i++)
+		if (dm_aligned == false || dm_exist[i] == true)
+			new_depthmaps++;
+	int j = (face_depthmaps != 0) ? std::max(0, (int)face_depthmaps->size() - new_depthmaps) : 0;
+	for (int i = first_new; i < number_faces; i++)
+	{
+		cv::Mat depthmap;
+		if (face_depthmaps != 0 && (dm_aligned == false || dm_exist[i] == true) && j < (int)face_depthmaps->size())
+		{
+			depthmap = (*face_depthmaps)[j];
+			j++;
+		}
+		m_archive_records[i] = writer.append(m_face_labels[i], face_images[i], depthmap);
+	}
 
-			if (dm_exist[i])
-			{
-				shortname_depth << "depth/" << i << dm_ext;
-				tag3 << "depthmap_" << i;
-				fileStorage << tag3.str().c_str() << shortname_depth.str().c_str();
-			}
-			cv::imwrite(img_path.string(), face_images[i]);
+	if (writer.commit() == false)
+	{
+		std::cout << "Error: FaceRecognizer::saveTrainingData: Can't save training data.\n" << std::endl;
+		m_archive_records.clear();
+		return ipa_Utils::RET_FAILED;
+	}
+
+	// periodic compaction: the journal is folded into the index when it grows beyond a quarter of the stored faces,
+	// the data of deleted faces is dropped when it outweighs the stored faces
+	const int min_compaction_entries = 64;
+	int stored_faces = m_training_archive.size();
+	bool reclaim_data = (m_training_archive.deletedRecords() > std::max(stored_faces, min_compaction_entries));
+	bool compact_index = (m_training_archive.journalEntries() > std::max(stored_faces / 4, min_compaction_entries));
+	if (reclaim_data == true || compact_index == true)
+	{
+		if (m_training_archive.compact(reclaim_data) == true)
+		{
+			for (int i = 0; i < number_faces; i++)
+				m_archive_records[i] = i;
 		}
+		else
+			m_archive_records.clear();
+	}
+
+	std::cout << "INFO: FaceRecognizer::saveTrainingData: " << number_faces - first_new << " new, " << relabeled << " relabeled and " << deleted << " deleted faces saved, "
+			<< number_faces << " faces stored.\n" << std::endl;
+
+	return ipa_Utils::RET_OK;
+}
 
-		fileStorage.release();
+unsigned long ipa_PeopleDetector::FaceRecognizer::rewriteTrainingDataArchive(std::vector<cv::Mat>& face_images, std::vector<cv::Mat>* face_depthmaps)
+{
+	boost::filesystem::path path = m_data_directory;
+	m_training_archive.close();
+	m_archive_records.clear();
+
+	TrainingDataArchiveWriter writer;
+	if (writer.create(path) == false)
+	{
+		std::cout << "Error: FaceRecognizer::saveTrainingData: Can't save training data.\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
 
-		int j = 0;
-		for (unsigned int i = 0; i < dm_exist.size(); i++)
+	// store data, face_depthmaps only contains the depth maps of the faces marked in dm_exist
+	int j = 0;
+	for (int i = 0; i < (int)m_face_labels.size(); i++)
+	{
+		cv::Mat depthmap;
+		if (face_depthmaps != 0 && i < (int)dm_exist.size() && dm_exist[i] && j < (int)face_depthmaps->size())
 		{
-			if (dm_exist[i])
-			{
-				// depth maps
-				boost::filesystem::path dm_path = path / "depth" / (boost::lexical_cast<string>(i) + ".xml");
-				cv::FileStorage fs(dm_path.string(), FileStorage::WRITE);
-				fs << "depthmap" << face_depthmaps[j];
-				fs.release();
-				j++;
-			}
+			depthmap = (*face_depthmaps)[j];
+			j++;
 		}
-		std::cout << "INFO: FaceRecognizer::saveTrainingData: " << face_images.size() << " color images and " << face_depthmaps.size() << " depth images saved.\n" << std::endl;
+		writer.append(m_face_labels[i], face_images[i], depthmap);
 	}
-	else
+
+	if (writer.commit() == false)
 	{
-		std::cerr << "Error: FaceRecognizer::saveTrainingData: Path '" << path << "' is not a directory." << std::endl;
+		std::cout << "Error: FaceRecognizer::saveTrainingData: Can't save training data.\n" << std::endl;
 		return ipa_Utils::RET_FAILED;
 	}
 
+	// the written faces are the records 0..n-1 of the new archive
+	if (m_training_archive.open(path) == true)
+	{
+		for (int i = 0; i < (int)m_face_labels.size(); i++)
+			m_archive_records.push_back(i);
+	}
+
+	std::cout << "INFO: FaceRecognizer::saveTrainingData: " << face_images.size() << " color images and " << j << " depth images saved.\n" << std::endl;
+
 	return ipa_Utils::RET_OK;
 }
 
-unsigned long ipa_PeopleDetector::FaceRecognizer::loadTrainingData(std::vector<cv::Mat>& face_images, std::vector<std::string>& identification_labels_to_train)
+unsigned long ipa_PeopleDetector::FaceRecognizer::loadTrainingDataArchive(std::vector<cv::Mat>& face_images, std::vector<cv::Mat>* face_depthmaps,
+		std::vector<std::string>& identification_labels_to_train, bool training_vectors)
 {
-	bool use_all_data = false;
-	if (identification_labels_to_train.size() == 0)
-		use_all_data = true;
+	TrainingDataArchive& archive = m_training_archive;
+	m_archive_records.clear();
+	if (archive.open(m_data_directory) == false)
+	{
+		std::cout << "Error: FaceRecognizer::loadTrainingDataArchive: Can't open the training data archive in " << m_data_directory.string() << ".\n" << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
 
-	boost::filesystem::path path = m_data_directory;
-	boost::filesystem::path complete = path / "tdata.xml";
+	// labels
+	std::vector<std::string> entry_labels(archive.size());
+	for (int i = 0; i < archive.size(); i++)
+		entry_labels[i] = archive.label(i);
+	std::vector<int> selected;
+	selectTrainingEntries(entry_labels, identification_labels_to_train, selected);
 
-	if (fs::is_directory(path.string()))
+	// the stored images are already normalized, they are copied out of the mapping and resized in parallel
+	cv::Size norm_size = cv::Size(m_norm_size, m_norm_size);
+	int number_selected = (int)selected.size();
+	std::vector<cv::Mat> images(number_selected), depthmaps(number_selected);
+	cv::parallel_for_(cv::Range(0, number_selected), ArchiveImageBody(archive, selected, norm_size, training_vectors, face_depthmaps != 0, images, depthmaps));
+
+	m_face_labels.clear();
+	m_face_labels.reserve(number_selected);
+	m_archive_records.reserve(number_selected);
+	face_images.clear();
+	face_images.reserve(number_selected);
+	if (face_depthmaps != 0)
+		dm_exist.clear();
+	for (int k = 0; k < number_selected; k++)
 	{
-		cv::FileStorage fileStorage(complete.string(), cv::FileStorage::READ);
-		if (!fileStorage.isOpened())
+		if (images[k].empty())
 		{
-			std::cout << "Error: FaceRecognizer::loadTrainingData: Can't open " << complete.string() << ".\n" << std::endl;
-			return ipa_Utils::RET_OK;
+			std::cerr << "Error: FaceRecognizer::loadTrainingDataArchive: Can't read face " << selected[k] << ".\n" << std::endl;
+			continue;
 		}
+		m_face_labels.push_back(entry_labels[selected[k]]);
+		m_archive_records.push_back(archive.record(selected[k]));
 
-		// labels
-		m_face_labels.clear();
-		face_images.clear();
-		cv::Size norm_size = cv::Size(m_norm_size, m_norm_size);
-		int number_entries = (int)fileStorage["number_entries"];
-		for (int i = 0; i < number_entries; i++)
+		// the face normalizer is not thread-safe, depth maps are normalized one after another
+		if (face_depthmaps != 0)
 		{
-			// labels
-			std::ostringstream tag_label;
-			tag_label << "label_" << i;
-			std::string label = (std::string)fileStorage[tag_label.str().c_str()];
-			// look up this label in the list of unique labels identification_labels_to_train
-			bool class_exists = false;
-			for (int j = 0; j < (int)identification_labels_to_train.size(); j++)
+			if (!depthmaps[k].empty())
 			{
-				if (!identification_labels_to_train[j].compare(label))
-					class_exists = true;
-			}
-			// if it does not appear in the list either append it (use all data option) or neglect this piece of data
-			if (class_exists == false)
-			{
-				if (use_all_data == true)
-				{
-					// append this label to the list of labels
-					identification_labels_to_train.push_back(label);
-				}
-				else
-				{
-					// skip this data because it does not contain one of the desired labels
-					continue;
-				}
+				cv::Mat dm_temp;
+				face_normalizer_.normalizeFace(images[k], depthmaps[k], norm_size, dm_temp);
+				face_depthmaps->push_back(dm_temp);
+				dm_exist.push_back(true);
 			}
-			m_face_labels.push_back(label);
-
-			// face images
-			std::ostringstream tag_image;
-			tag_image << "image_" << i;
-			boost::filesystem::path path = m_data_directory / (std::string)fileStorage[tag_image.str().c_str()];
-			cv::Mat temp = cv::imread(path.string(), -1);
-			cv::resize(temp, temp, cv::Size(m_norm_size, m_norm_size));
-			//face_normalizer_.normalizeFace(temp,norm_size);
-			face_images.push_back(temp);
+			else
+				dm_exist.push_back(false);
+			cv::resize(images[k], images[k], norm_size);
 		}
+		face_images.push_back(images[k]);
+	}
 
-		// clean identification_labels_to_train -> only keep those labels that appear in the training data
-		for (int j = 0; j < (int)identification_labels_to_train.size(); j++)
-		{
-			bool class_exists = false;
-			for (int k = 0; k < (int)m_face_labels.size(); k++)
-			{
-				if (identification_labels_to_train[j].compare(m_face_labels[k]) == 0)
-					class_exists = true;
-			}
-			if (class_exists == false)
-			{
-				identification_labels_to_train.erase(identification_labels_to_train.begin() + j);
-				j--;
-			}
-		}
+	if (face_depthmaps == 0)
+		dm_exist.assign(m_face_labels.size(), false);
+	rebuildLabelIndex();
 
-		// set next free filename
-		// filename_ = number_face_images;
+	// only keep those labels that appear in the training data
+	removeMissingLabels(m_face_labels, identification_labels_to_train);
 
-		fileStorage.release();
+	std::cout << "INFO: FaceRecognizer::loadTrainingDataArchive: " << face_images.size() << " of " << archive.size() << " faces loaded.\n" << std::endl;
+	return ipa_Utils::RET_OK;
+}
 
-		std::cout << "INFO: FaceRecognizer::loadTrainingData: " << number_entries << " color images loaded.\n" << std::endl;
-	}
-	else
+unsigned long ipa_PeopleDetector::FaceRecognizer::loadTrainingData(std::vector<cv::Mat>& face_images, std::vector<std::string>& identification_labels_to_train, bool training_vectors)
+{
+	boost::filesystem::path path = m_data_directory;
+
+	// packed archive, the image directory of tdata.xml is only read if the data has not been converted yet
+	if (TrainingDataArchive::exists(path) == true)
+		return loadTrainingDataArchive(face_images, 0, identification_labels_to_train, training_vectors);
+
+	if (!fs::is_directory(path.string()))
 	{
 		std::cerr << "Error: FaceRecognizer::loadTrainingData: Path '" << path << "' is not a directory." << std::endl;
 		return ipa_Utils::RET_FAILED;
 	}
 
+	// labels
+	std::vector<std::string> entry_labels;
+	std::vector<boost::filesystem::path> image_files;
+	if (readTrainingDataIndex(path, entry_labels, image_files, 0) == false)
+	{
+		std::cout << "Error: FaceRecognizer::loadTrainingData: Can't open " << (path / "tdata.xml").string() << ".\n" << std::endl;
+		return ipa_Utils::RET_OK;
+	}
+	std::vector<int> selected;
+	selectTrainingEntries(entry_labels, identification_labels_to_train, selected);
+
+	// face images, decoded in parallel
+	int number_selected = (int)selected.size();
+	std::vector<boost::filesystem::path> selected_files(number_selected), no_depth_files;
+	for (int k = 0; k < number_selected; k++)
+		selected_files[k] = image_files[selected[k]];
+	std::vector<cv::Mat> images(number_selected), no_depthmaps;
+	cv::parallel_for_(cv::Range(0, number_selected), ImageFileBody(selected_files, no_depth_files, cv::Size(m_norm_size, m_norm_size), images, no_depthmaps));
+
+	m_face_labels.clear();
+	m_face_labels.reserve(number_selected);
+	face_images.clear();
+	face_images.reserve(number_selected);
+	for (int k = 0; k < number_selected; k++)
+	{
+		if (images[k].empty())
+		{
+			std::cerr << "Error: FaceRecognizer::loadTrainingData: Can't read " << selected_files[k].string() << ".\n" << std::endl;
+			continue;
+		}
+		if (training_vectors == true)
+			images[k].convertTo(images[k], CV_64FC1);
+		m_face_labels.push_back(entry_labels[selected[k]]);
+		face_images.push_back(images[k]);
+	}
+	dm_exist.assign(m_face_labels.size(), false);
+	rebuildLabelIndex();
+
+	// clean identification_labels_to_train -> only keep those labels that appear in the training data
+	removeMissingLabels(m_face_labels, identification_labels_to_train);
+
+	// the faces are not stored in an archive yet
+	m_training_archive.close();
+	m_archive_records.assign(m_face_labels.size(), -1);
+
+	std::cout << "INFO: FaceRecognizer::loadTrainingData: " << face_images.size() << " of " << entry_labels.size() << " color images loaded.\n" << std::endl;
+
 	return ipa_Utils::RET_OK;
 }
 
 unsigned long ipa_PeopleDetector::FaceRecognizer::loadTrainingData(std::vector<cv::Mat>& face_images, std::vector<cv::Mat>& face_depthmaps,
 		std::vector<std::string>& identification_labels_to_train)
 {
-	bool use_all_data = false;
+	boost::filesystem::path path = m_data_directory;
+
+	// packed archive, the image directory of tdata.xml is only read if the data has not been converted yet
+	if (TrainingDataArchive::exists(path) == true)
+		return loadTrainingDataArchive(face_images, &face_depthmaps, identification_labels_to_train, false);
+
 	dm_exist.clear();
-	if (identification_labels_to_train.size() == 0)
-		use_all_data = true;
+	if (!fs::is_directory(path.string()))
+	{
+		std::cerr << "Error: FaceRecognizer::loadTrainingData: Path '" << path << "' is not a directory." << std::endl;
+		return ipa_Utils::RET_FAILED;
+	}
 
-	boost::filesystem::path path = m_data_directory;
-	boost::filesystem::path complete = path / "tdata.xml";
+	// labels
+	std::vector<std::string> entry_labels;
+	std::vector<boost::filesystem::path> image_files, depth_files;
+	if (readTrainingDataIndex(path, entry_labels, image_files, &depth_files) == false)
+	{
+		std::cout << "Error: FaceRecognizer::loadTrainingData: Can't open " << (path / "tdata.xml").string() << ".\n" << std::endl;
+		return ipa_Utils::RET_OK;
+	}
+	std::vector<int> selected;
+	selectTrainingEntries(entry_labels, identification_labels_to_train, selected);
 
-	if (fs::is_directory(path.string()))
+	// face images and depth maps, decoded in parallel
+	int number_selected = (int)selected.size();
+	std::vector<boost::filesystem::path> selected_files(number_selected), selected_depth_files(number_selected);
+	for (int k = 0; k < number_selected; k++)
+	{
+		selected_files[k] = image_files[selected[k]];
+		selected_depth_files[k] = depth_files[selected[k]];
+	}
+	cv::Size norm_size = cv::Size(m_norm_size, m_norm_size);
+	std::vector<cv::Mat> images(number_selected), xyz_maps(number_selected);
+	cv::parallel_for_(cv::Range(0, number_selected), ImageFileBody(selected_files, selected_depth_files, norm_size, images, xyz_maps));
+
+	m_face_labels.clear();
+	m_face_labels.reserve(number_selected);
+	face_images.clear();
+	face_images.reserve(number_selected);
+	for (int k = 0; k < number_selected; k++)
 	{
-		cv::FileStorage fileStorage(complete.string(), cv::FileStorage::READ);
-		if (!fileStorage.isOpened())
+		if (images[k].empty())
 		{
-			std::cout << "Error: FaceRecognizer::loadTrainingData: Can't open " << complete.string() << ".\n" << std::endl;
-			return ipa_Utils::RET_OK;
+			std::cerr << "Error: FaceRecognizer::loadTrainingData: Can't read " << selected_files[k].string() << ".\n" << std::endl;
+			continue;
 		}
+		m_face_labels.push_back(entry_labels[selected[k]]);
 
-		// labels
-		m_face_labels.clear();
-		face_images.clear();
-		cv::Size norm_size = cv::Size(m_norm_size, m_norm_size);
-		int number_entries = (int)fileStorage["number_entries"];
-		for (int i = 0; i < number_entries; i++)
+		// the face normalizer is not thread-safe, depth maps are normalized one after another
+		if (!xyz_maps[k].empty())
 		{
-			// labels
-			std::ostringstream tag_label;
-			tag_label << "label_" << i;
-			std::string label = (std::string)fileStorage[tag_label.str().c_str()];
-			// look up this label in the list of unique labels identification_labels_to_train
-			bool class_exists = false;
-			for (int j = 0; j < (int)identification_labels_to_train.size(); j++)
-			{
-				if (!identification_labels_to_train[j].compare(label))
-					class_exists = true;
-			}
-			// if it does not appear in the list either append it (use all data option) or neglect this piece of data
-			if (class_exists == false)
-			{
-				if (use_all_data == true)
-				{
-					// append this label to the list of labels
-					identification_labels_to_train.push_back(label);
-				}
-				else
-				{
-					// skip this data because it does not contain one of the desired labels
-					continue;
-				}
-			}
-			m_face_labels.push_back(label);
-
-			// face images
-			std::ostringstream tag_image, tag_dm;
-			tag_image << "image_" << i;
-			tag_dm << "depthmap_" << i;
-			boost::filesystem::path img_path = m_data_directory / (std::string)fileStorage[tag_image.str().c_str()];
-			boost::filesystem::path dm_path = m_data_directory / (std::string)fileStorage[tag_dm.str().c_str()];
-			cv::Mat temp = cv::imread(img_path.string(), -1);
-
-			if (dm_path.string().compare(m_data_directory.string()))
-			{
-				cv::Mat xyz_temp, dm_temp;
-				cv::FileStorage fs(dm_path.string(), FileStorage::READ);
-				fs["depthmap"] >> xyz_temp;
-				face_normalizer_.normalizeFace(temp, xyz_temp, norm_size, dm_temp);
-				face_depthmaps.push_back(dm_temp);
-				dm_exist.push_back(true);
-				fs.release();
-			}
-			else
-			{
-				dm_exist.push_back(false);
-			}
-
-			cv::resize(temp, temp, cv::Size(m_norm_size, m_norm_size));
-			face_images.push_back(temp);
+			cv::Mat dm_temp;
+			face_normalizer_.normalizeFace(images[k], xyz_maps[k], norm_size, dm_temp);
+			face_depthmaps.push_back(dm_temp);
+			dm_exist.push_back(true);
 		}
-
-		// clean identification_labels_to_train -> only keep those labels that appear in the training data
-		for (int j = 0; j < (int)identification_labels_to_train.size(); j++)
+		else
 		{
-			bool class_exists = false;
-			for (int k = 0; k < (int)m_face_labels.size(); k++)
-			{
-				if (identification_labels_to_train[j].compare(m_face_labels[k]) == 0)
-					class_exists = true;
-			}
-			if (class_exists == false)
-			{
-				identification_labels_to_train.erase(identification_labels_to_train.begin() + j);
-				j--;
-			}
+			dm_exist.push_back(false);
 		}
 
-		// set next free filename
-		// filename_ = number_face_images;
+		cv::resize(images[k], images[k], norm_size);
+		face_images.push_back(images[k]);
+	}
 
-		fileStorage.release();
+	rebuildLabelIndex();
 
-		std::cout << "INFO: FaceRecognizer::loadTrainingData: " << number_entries << " images loaded (" << face_images.size() << " color images and " << face_depthmaps.size() << " depth images).\n" << std::endl;
-	}
-	else
-	{
-		std::cerr << "Error: FaceRecognizer::loadTrainingData: Path '" << path << "' is not a directory." << std::endl;
-		return ipa_Utils::RET_FAILED;
-	}
+	// clean identification_labels_to_train -> only keep those labels that appear in the training data
+	removeMissingLabels(m_face_labels, identification_labels_to_train);
+
+	// the faces are not stored in an archive yet
+	m_training_archive.close();
+	m_archive_records.assign(m_face_labels.size(), -1);
+
+	std::cout << "INFO: FaceRecognizer::loadTrainingData: " << entry_labels.size() << " images loaded (" << face_images.size() << " color images and " << face_depthmaps.size() << " depth images).\n" << std::endl;
 
 	return ipa_Utils::RET_OK;
 }
+
 void ipa_PeopleDetector::FaceRecognizer::assertDirectories(boost::filesystem::path& data_directory)
 {
 
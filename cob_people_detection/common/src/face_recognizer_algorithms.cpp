@@ -1,5 +1,208 @@
 #include<cob_people_detection/face_recognizer_algorithms.h>
 
+namespace
+{
+/// Squared Euclidean distance of two contiguous arrays, accumulated in double precision.
+template<typename T>
+inline double sqDistance(const T* a, const T* b, int n)
+{
+	double d0 = 0.0, d1 = 0.0;
+	int i = 0;
+	for (; i <= n - 2; i += 2)
+	{
+		double t0 = (double)a[i] - (double)b[i];
+		double t1 = (double)a[i + 1] - (double)b[i + 1];
+		d0 += t0 * t0;
+		d1 += t1 * t1;
+	}
+	for (; i < n; i++)
+	{
+		double t = (double)a[i] - (double)b[i];
+		d0 += t * t;
+	}
+	return d0 + d1;
+}
+
+/// Evaluates a range of row blocks of the pairwise distance matrix for the unknown threshold.
+/// Every block is computed with one GEMM against all features and reduced to the largest
+/// intra-class distance D and the nearest inter-class distance P per class.
+class ThresholdBlockBody: public cv::ParallelLoopBody
+{
+public:
+	ThresholdBlockBody(const cv::Mat& data, const cv::Mat& sq_norms, const std::vector<int>& labels, int num_classes, int block_rows, bool squared,
+			std::vector<std::vector<double> >& P, std::vector<std::vector<double> >& D) :
+		data_(data), sq_norms_(sq_norms), labels_(labels), num_classes_(num_classes), block_rows_(block_rows), squared_(squared), P_(P), D_(D)
+	{
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		const double* sq_norms = sq_norms_.ptr<double>(0);
+		for (int b = range.start; b < range.end; b++)
+		{
+			int r_begin = b * block_rows_;
+			int r_end = std::min(r_begin + block_rows_, data_.rows);
+			cv::Mat gram;
+			cv::gemm(data_.rowRange(r_begin, r_end), data_, 1.0, cv::Mat(), 0.0, gram, cv::GEMM_2_T);
+
+			std::vector<double>& P = P_[b];
+			std::vector<double>& D = D_[b];
+			P.assign(num_classes_, std::numeric_limits<double>::max());
+			D.assign(num_classes_, std::numeric_limits<double>::min());
+			for (int i = r_begin; i < r_end; i++)
+			{
+				const double* g = gram.ptr<double>(i - r_begin);
+				int label = labels_[i];
+				for (int n = 0; n < data_.rows; n++)
+				{
+					if (n == i)
+						continue;
+					double dist = std::max(0.0, sq_norms[i] + sq_norms[n] - 2.0 * g[n]);
+					if (squared_ == false)
+						dist = sqrt(dist);
+					if (labels_[n] == label)
+						D[label] = std::max(dist, D[label]);
+					else
+						P[label] = std::min(dist, P[label]);
+				}
+			}
+		}
+	}
+
+protected:
+	const cv::Mat& data_;
+	const cv::Mat& sq_norms_;
+	const std::vector<int>& labels_;
+	int num_classes_;
+	int block_rows_;
+	bool squared_;
+	std::vector<std::vector<double> >& P_;
+	std::vector<std::vector<double> >& D_;
+};
+
+/// Nearest model feature and minimal squared distance to every class within one shard of the gallery.
+struct ShardMinimum
+{
+	int index;
+	double sq_dist;
+	std::vector<double> class_min_sq_dist;
+};
+
+/// Matches a range of gallery shards against one probe. Every shard writes only to its own
+/// ShardMinimum, so the tasks need no synchronization.
+class ShardMatchBody: public cv::ParallelLoopBody
+{
+public:
+	ShardMatchBody(ipa_PeopleDetector::FaceRecognizerBaseClass& recognizer, const cv::Mat& probe, const std::vector<int>& labels, int num_classes,
+			int num_features, int shard_rows, std::vector<ShardMinimum>& minima) :
+		recognizer_(recognizer), probe_(probe), labels_(labels), num_classes_(num_classes), num_features_(num_features), shard_rows_(shard_rows),
+				minima_(minima)
+	{
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		std::vector<double> sq_distances(shard_rows_);
+		for (int s = range.start; s < range.end; s++)
+		{
+			int r_begin = s * shard_rows_;
+			int r_end = std::min(r_begin + shard_rows_, num_features_);
+			recognizer_.calcShardDistances(probe_, r_begin, r_end, &sq_distances[0]);
+
+			ShardMinimum& minimum = minima_[s];
+			minimum.index = r_begin;
+			minimum.sq_dist = std::numeric_limits<double>::max();
+			minimum.class_min_sq_dist.assign(num_classes_, std::numeric_limits<double>::max());
+			for (int r = r_begin; r < r_end; r++)
+			{
+				double sq_dist = sq_distances[r - r_begin];
+				if (sq_dist < minimum.sq_dist)
+				{
+					minimum.index = r;
+					minimum.sq_dist = sq_dist;
+				}
+				double& class_min = minimum.class_min_sq_dist[labels_[r]];
+				class_min = std::min(class_min, sq_dist);
+			}
+		}
+	}
+
+protected:
+	ipa_PeopleDetector::FaceRecognizerBaseClass& recognizer_;
+	const cv::Mat& probe_;
+	const std::vector<int>& labels_;
+	int num_classes_;
+	int num_features_;
+	int shard_rows_;
+	std::vector<ShardMinimum>& minima_;
+};
+}
+
+bool ipa_PeopleDetector::FaceRecognizerBaseClass::matchShards(const cv::Mat& probe, int num_features, size_t feature_bytes, int& min_index, double& min_sq_dist,
+		std::vector<double>& class_min_sq_dist)
+{
+	if (parallel_matching_ == false || num_features == 0)
+		return false;
+
+	int shard_rows = std::max(1, (int)(match_shard_bytes / std::max(feature_bytes, (size_t)1)));
+	int num_shards = (num_features + shard_rows - 1) / shard_rows;
+	if (num_shards < 2)
+		return false;
+
+	std::vector<ShardMinimum> minima(num_shards);
+	cv::parallel_for_(cv::Range(0, num_shards), ShardMatchBody(*this, probe, model_label_vec_, num_classes_, num_features, shard_rows, minima));
+
+	// merge in shard order, ties are resolved like in the sequential search
+	min_index = 0;
+	min_sq_dist = std::numeric_limits<double>::max();
+	class_min_sq_dist.assign(num_classes_, std::numeric_limits<double>::max());
+	for (int s = 0; s < num_shards; s++)
+	{
+		if (minima[s].sq_dist < min_sq_dist)
+		{
+			min_index = minima[s].index;
+			min_sq_dist = minima[s].sq_dist;
+		}
+		for (int c = 0; c < num_classes_; c++)
+			class_min_sq_dist[c] = std::min(class_min_sq_dist[c], minima[s].class_min_sq_dist[c]);
+	}
+
+	return true;
+}
+
+ipa_PeopleDetector::FaceRecognizerBaseClass* ipa_PeopleDetector::createRecognizer(Method method)
+{
+	switch (method)
+	{
+	case METH_EIGEN:
+		return new FaceRecognizer_Eigenfaces();
+	case METH_LDA2D:
+		return new FaceRecognizer_LDA2D();
+	case METH_PCA2D:
+		return new FaceRecognizer_PCA2D();
+	default:
+		return new FaceRecognizer_Fisherfaces();
+	}
+}
+
+bool ipa_PeopleDetector::parseMethod(const std::string& name, Method& method)
+{
+	if (name == "FISHER")
+		method = METH_FISHER;
+	else if (name == "EIGEN")
+		method = METH_EIGEN;
+	else if (name == "LDA2D")
+		method = METH_LDA2D;
+	else if (name == "PCA2D")
+		method = METH_PCA2D;
+	else
+	{
+		method = NONE;
+		return false;
+	}
+	return true;
+}
+
 bool ipa_PeopleDetector::FaceRecognizerBaseClass::input_param_check(std::vector<cv::Mat>& imgs, std::vector<int>& labels, int& target_dim)
 {
 	if (imgs.size() != labels.size())
@@ -13,45 +216,182 @@ bool ipa_PeopleDetector::FaceRecognizerBaseClass::input_param_check(std::vector<
 	//if(target_dim>imgs.size()) return false;
 
 }
-void ipa_PeopleDetector::FaceRecognizer1D::calc_threshold(cv::Mat& data, double& thresh)
+void ipa_PeopleDetector::FaceRecognizerBaseClass::classifyImages(std::vector<cv::Mat>& probe_mats, std::vector<int>& max_prob_indices)
+{
+	max_prob_indices.resize(probe_mats.size());
+	for (int i = 0; i < (int)probe_mats.size(); i++)
+		classifyImage(probe_mats[i], max_prob_indices[i]);
+}
+
+void ipa_PeopleDetector::FaceRecognizerBaseClass::calcThresholdGram(cv::Mat& data, bool squared, double factor, double& thresh)
 {
 	thresh = std::numeric_limits<double>::max();
-	std::vector<double> P(num_classes_, std::numeric_limits<double>::max());
-	std::vector<double> D(num_classes_, std::numeric_limits<double>::min());
-	std::vector<double> Phi(num_classes_, std::numeric_limits<double>::max());
+	if (data.rows == 0)
+		return;
+
+	cv::Mat data_arr = data;
+	if (data_arr.type() != CV_64FC1)
+		data.convertTo(data_arr, CV_64FC1);
+
+	cv::Mat sq_norms = cv::Mat(1, data_arr.rows, CV_64FC1);
+	for (int r = 0; r < data_arr.rows; r++)
+	{
+		cv::Mat row = data_arr.row(r);
+		sq_norms.at<double>(r) = row.dot(row);
+	}
 
-	for (int i = 0; i < data.rows; i++)
+	int block_rows = std::max(1, std::min(data_arr.rows, threshold_block_elements / data_arr.rows));
+	int num_blocks = (data_arr.rows + block_rows - 1) / block_rows;
+	std::vector<std::vector<double> > P(num_blocks), D(num_blocks);
+	cv::parallel_for_(cv::Range(0, num_blocks), ThresholdBlockBody(data_arr, sq_norms, model_label_vec_, num_classes_, block_rows, squared, P, D));
+
+	// merge the per-block extrema
+	std::vector<double> P_all(num_classes_, std::numeric_limits<double>::max());
+	std::vector<double> D_all(num_classes_, std::numeric_limits<double>::min());
+	for (int b = 0; b < num_blocks; b++)
 	{
-		cv::Mat i_row = data.row(i);
-		for (int n = 0; n < data.rows; n++)
+		for (int c = 0; c < num_classes_; c++)
 		{
-			if (n == i)
-				continue;
-			cv::Mat n_row = data.row(n);
-			double dist = cv::norm(i_row, n_row, cv::NORM_L2);
-			if (model_label_vec_[n] == model_label_vec_[i])
-			{
-				D[model_label_vec_[i]] = std::max(dist, D[model_label_vec_[i]]);
-			}
-			else
-			{
-				P[model_label_vec_[i]] = std::min(dist, P[model_label_vec_[i]]);
-			}
+			P_all[c] = std::min(P_all[c], P[b][c]);
+			D_all[c] = std::max(D_all[c], D[b][c]);
 		}
 	}
 
 	// if only one class - P =D
 	if (num_classes_ == 1)
 	{
-		P[0] = D[0];
+		P_all[0] = D_all[0];
 	}
 
 	for (int c = 0; c < num_classes_; c++)
 	{
-		thresh = std::min(thresh, (P[c] + D[c]) * 0.5);
+		thresh = std::min(thresh, (P_all[c] + D_all[c]) * factor);
 	}
 	std::cout << "THRESH for db: " << thresh << std::endl;
+}
+
+bool ipa_PeopleDetector::FaceRecognizerBaseClass::appendLabels(std::vector<int>& label_vec)
+{
+	// every class up to the largest new label has to be present afterwards
+	int new_num_classes = num_classes_;
+	for (int i = 0; i < (int)label_vec.size(); i++)
+	{
+		if (label_vec[i] < 0)
+			return false;
+		new_num_classes = std::max(new_num_classes, label_vec[i] + 1);
+	}
+	std::vector<bool> class_present(new_num_classes, false);
+	for (int c = 0; c < num_classes_; c++)
+		class_present[c] = true;
+	for (int i = 0; i < (int)label_vec.size(); i++)
+		class_present[label_vec[i]] = true;
+	for (int c = 0; c < new_num_classes; c++)
+	{
+		if (class_present[c] == false)
+		{
+			std::cout << "[FaceRecognizerAlgorithm] Labels of the update do not continue the model labels." << std::endl;
+			return false;
+		}
+	}
+
+	model_label_vec_.insert(model_label_vec_.end(), label_vec.begin(), label_vec.end());
+	num_classes_ = new_num_classes;
+	return true;
+}
+
+void ipa_PeopleDetector::FaceRecognizerBaseClass::readGalleryIndex(const ModelFile& model_file, int num_features, int dim)
+{
+	bool complete = true;
+	if (gallery_index_probes_ > 0)
+		complete = gallery_index_.read(model_file, num_features, dim) && complete;
+	else
+		gallery_index_.clear();
+	if (quantized_candidates_ > 0)
+		complete = quantized_gallery_.read(model_file, num_features, dim) && complete;
+	else
+		quantized_gallery_.clear();
+
+	if (complete == false)
+		buildGalleryIndex();
+}
+
+void ipa_PeopleDetector::FaceRecognizerBaseClass::writeGalleryIndex(ModelFileWriter& writer)
+{
+	gallery_index_.write(writer);
+	quantized_gallery_.write(writer);
+}
+
+void ipa_PeopleDetector::FaceRecognizerBaseClass::loadGalleryIndex(cv::FileStorage& fs, int num_features, int dim)
+{
+	bool complete = true;
+	if (gallery_index_probes_ > 0)
+		complete = gallery_index_.load(fs["gallery_index"], num_features, dim) && complete;
+	else
+		gallery_index_.clear();
+	if (quantized_candidates_ > 0)
+		complete = quantized_gallery_.load(fs["quantized_gallery"], num_features, dim) && complete;
+	else
+		quantized_gallery_.clear();
+
+	if (complete == false)
+		buildGalleryIndex();
+}
+
+void ipa_PeopleDetector::FaceRecognizerBaseClass::saveGalleryIndex(cv::FileStorage& fs)
+{
+	gallery_index_.save(fs);
+	quantized_gallery_.save(fs);
+}
+
+void ipa_PeopleDetector::FaceRecognizerBaseClass::classifyCandidates(cv::Mat& probe_mat, const std::vector<int>& rows, int& max_prob_index)
+{
+	cv::Mat classification_probabilities;
+	classifyRestricted(probe_mat, &rows, max_prob_index, classification_probabilities);
+}
+
+double ipa_PeopleDetector::FaceRecognizerBaseClass::verifyCandidates(cv::Mat& probe_mat, const std::vector<int>& rows)
+{
+	int minDIFSindex;
+	double minDIFS;
+	cv::Mat classification_probabilities;
+	matchRestricted(probe_mat, &rows, minDIFSindex, minDIFS, classification_probabilities);
 
+	// relative to the unknown threshold, so one verification threshold fits all methods and galleries
+	if (unknown_thresh_ <= 0.0)
+		return minDIFS;
+	return minDIFS / unknown_thresh_;
+}
+
+bool ipa_PeopleDetector::FaceRecognizerBaseClass::selectCandidates(cv::Mat& probe, const std::vector<int>* rows, std::vector<int>& candidates)
+{
+	// candidates given by the caller, e.g. a coarse recognition stage
+	if (rows != 0 && rows->size() > 0)
+	{
+		candidates = *rows;
+		return true;
+	}
+
+	// coarse selection of the nearest index cells
+	candidates.clear();
+	bool use_index = (gallery_index_probes_ > 0 && gallery_index_.search(probe, gallery_index_probes_, candidates));
+
+	// pre-selection with the quantized features, restricted to the index cells if available
+	if (quantized_candidates_ > 0)
+	{
+		std::vector<int> shortlist;
+		if (quantized_gallery_.search(probe, quantized_candidates_, (use_index == true) ? &candidates : 0, shortlist))
+		{
+			candidates.swap(shortlist);
+			return true;
+		}
+	}
+
+	return use_index;
+}
+
+void ipa_PeopleDetector::FaceRecognizer1D::calc_threshold(cv::Mat& data, double& thresh)
+{
+	calcThresholdGram(data, false, 0.5, thresh);
 }
 
 void ipa_PeopleDetector::FaceRecognizer1D::model_data_mat(std::vector<cv::Mat>& input_data, cv::Mat& data_mat)
@@ -86,61 +426,284 @@ void ipa_PeopleDetector::FaceRecognizer1D::classifyImage(cv::Mat& probe_mat, int
 }
 void ipa_PeopleDetector::FaceRecognizer1D::classifyImage(cv::Mat& probe_mat, int& max_prob_index, cv::Mat& classification_probabilities)
 {
+	classifyRestricted(probe_mat, 0, max_prob_index, classification_probabilities);
+}
 
+void ipa_PeopleDetector::FaceRecognizer1D::classifyRestricted(cv::Mat& probe_mat, const std::vector<int>* rows, int& max_prob_index, cv::Mat& classification_probabilities)
+{
+	double minDIFS;
+	int minDIFSindex;
+	matchRestricted(probe_mat, rows, minDIFSindex, minDIFS, classification_probabilities);
+	max_prob_index = (int)model_label_vec_[minDIFSindex];
+
+	//check whether unknown threshold is exceeded
+	if (use_unknown_thresh_)
+	{
+		if (!is_known(minDIFS, unknown_thresh_))
+			max_prob_index = -1;
+	}
+	return;
+}
+
+void ipa_PeopleDetector::FaceRecognizer1D::matchRestricted(cv::Mat& probe_mat, const std::vector<int>* rows, int& minDIFSindex, double& minDIFS,
+		cv::Mat& classification_probabilities)
+{
 	//project query mat to feature space
-	cv::Mat feature_arr = cv::Mat(1, target_dim_, CV_64FC1);
+	cv::Mat feature_arr = cv::Mat(1, target_dim_, projection_mat_.type());
 	// conversion from matrix format to array
 	cv::Mat probe_arr = cv::Mat(1, probe_mat.total(), probe_mat.type());
 	SubspaceAnalysis::mat2arr(probe_mat, probe_arr);
+	if (probe_arr.type() != projection_mat_.type())
+		probe_arr.convertTo(probe_arr, projection_mat_.type());
 
 	extractFeatures(probe_arr, projection_mat_, feature_arr);
 
 	//calculate distance in face space DIFS
-	double minDIFS;
-	cv::Mat minDIFScoeffs;
-	int minDIFSindex;
-	calcDIFS(feature_arr, minDIFSindex, minDIFS, classification_probabilities);
-	max_prob_index = (int)model_label_vec_[minDIFSindex];
+	calcDIFS(feature_arr, rows, minDIFSindex, minDIFS, classification_probabilities);
+}
 
-	//check whether unknown threshold is exceeded
-	if (use_unknown_thresh_)
+void ipa_PeopleDetector::FaceRecognizer1D::classifyImages(std::vector<cv::Mat>& probe_mats, std::vector<int>& max_prob_indices)
+{
+	max_prob_indices.resize(probe_mats.size());
+	if (probe_mats.size() == 0)
+		return;
+
+	// stack all probes as rows of one data matrix
+	cv::Mat probe_arr = cv::Mat(probe_mats.size(), probe_mats[0].total(), projection_mat_.type());
+	for (int i = 0; i < (int)probe_mats.size(); i++)
 	{
+		cv::Mat dst_row = probe_arr.row(i);
+		probe_mats[i].reshape(1, 1).convertTo(dst_row, projection_mat_.type());
+	}
+
+	//project all probes to feature space with one GEMM
+	cv::Mat feature_arr;
+	extractFeatures(probe_arr, projection_mat_, feature_arr);
+
+	//calculate distances in face space DIFS for all probes at once, unless the index or the quantized gallery narrow down the search
+	//or the gallery is matched in parallel shards per probe
+	bool use_candidates = useCandidates() || parallel_matching_;
+	cv::Mat sq_distances;
+	if (use_candidates == false)
+		calcSquaredDistances(feature_arr, sq_distances);
+
+	cv::Mat classification_probabilities;
+	for (int i = 0; i < (int)probe_mats.size(); i++)
+	{
+		double minDIFS;
+		int minDIFSindex;
+		if (use_candidates == true)
+		{
+			cv::Mat feature_row = feature_arr.row(i);
+			calcDIFS(feature_row, minDIFSindex, minDIFS, classification_probabilities);
+		}
+		else
+			reduceDistances(sq_distances.ptr<double>(i), 0, model_features_.rows, minDIFSindex, minDIFS, classification_probabilities);
+		max_prob_indices[i] = (int)model_label_vec_[minDIFSindex];
+
+		//check whether unknown threshold is exceeded
+		if (use_unknown_thresh_)
+		{
+			if (!is_known(minDIFS, unknown_thresh_))
+				max_prob_indices[i] = -1;
+		}
+	}
+}
+
+bool ipa_PeopleDetector::FaceRecognizer1D::rankCandidates(cv::Mat& probe_mat, int num_candidates, std::vector<int>& rows)
+{
+	//project query mat to feature space
+	cv::Mat probe_arr;
+	probe_mat.reshape(1, 1).convertTo(probe_arr, projection_mat_.type());
+	cv::Mat feature_arr;
+	extractFeatures(probe_arr, projection_mat_, feature_arr);
+
+	cv::Mat sq_distances;
+	calcSquaredDistances(feature_arr, sq_distances);
+	const double* sq_dist = sq_distances.ptr<double>(0);
+
+	std::vector<std::pair<double, int> > ranking(model_features_.rows);
+	for (int r = 0; r < model_features_.rows; r++)
+		ranking[r] = std::make_pair(sq_dist[r], r);
+	num_candidates = std::min(num_candidates, (int)ranking.size());
+	std::partial_sort(ranking.begin(), ranking.begin() + num_candidates, ranking.end());
+
+	rows.resize(num_candidates);
+	for (int i = 0; i < num_candidates; i++)
+		rows[i] = ranking[i].second;
+
+	//check whether unknown threshold is exceeded already in the coarse space
+	if (use_unknown_thresh_ && num_candidates > 0)
+	{
+		double minDIFS = sqrt(ranking[0].first);
 		if (!is_known(minDIFS, unknown_thresh_))
-			max_prob_index = -1;
+		{
+			rows.clear();
+			return false;
+		}
 	}
-	return;
+	return true;
 }
 
 void ipa_PeopleDetector::FaceRecognizer1D::calcDIFS(cv::Mat& probe_mat, int& minDIFSindex, double& minDIFS, cv::Mat& probabilities)
 {
+	calcDIFS(probe_mat, 0, minDIFSindex, minDIFS, probabilities);
+}
 
-	double norm;
-	minDIFS = std::numeric_limits<float>::max();
-	probabilities = cv::Mat(1, num_classes_, CV_64FC1);
-	probabilities *= std::numeric_limits<float>::max();
-	for (int r = 0; r < model_features_.rows; r++)
+void ipa_PeopleDetector::FaceRecognizer1D::calcDIFS(cv::Mat& probe_mat, const std::vector<int>* rows, int& minDIFSindex, double& minDIFS, cv::Mat& probabilities)
+{
+	// approximate search: only the given rows or the candidates of the index cells or the quantized gallery are compared in full precision
+	std::vector<int> candidates;
+	if (selectCandidates(probe_mat, rows, candidates))
+	{
+		std::vector<double> sq_distances;
+		calcSquaredDistances(probe_mat, candidates, sq_distances);
+		reduceDistances(&sq_distances[0], &candidates[0], candidates.size(), minDIFSindex, minDIFS, probabilities);
+		return;
+	}
+
+	// exact search, split into shards that are matched in parallel if activated
+	double min_sq_dist;
+	std::vector<double> class_min_sq_dist;
+	if (matchShards(probe_mat, model_features_.rows, model_features_.cols * model_features_.elemSize(), minDIFSindex, min_sq_dist, class_min_sq_dist))
+	{
+		minDIFS = sqrt(min_sq_dist);
+		classProbabilities(class_min_sq_dist, probabilities);
+		return;
+	}
+
+	cv::Mat sq_distances;
+	calcSquaredDistances(probe_mat, sq_distances);
+	reduceDistances(sq_distances.ptr<double>(0), 0, model_features_.rows, minDIFSindex, minDIFS, probabilities);
+
+	return;
+}
+
+void ipa_PeopleDetector::FaceRecognizer1D::calcShardDistances(const cv::Mat& probe, int begin, int end, double* sq_distances)
+{
+	// -2*p*G^T for the shard, the shard is small enough to stay in the cache of the worker
+	cv::Mat shard_distances;
+	cv::gemm(probe, model_features_.rowRange(begin, end), -2.0, cv::Mat(), 0.0, shard_distances, cv::GEMM_2_T);
+	if (shard_distances.type() != CV_64FC1)
+		shard_distances.convertTo(shard_distances, CV_64FC1);
+
+	double probe_sq_norm = probe.dot(probe);
+	const double* model_sq_norms = model_sq_norms_.ptr<double>(0);
+	const double* shard_dist = shard_distances.ptr<double>(0);
+	for (int r = begin; r < end; r++)
+		sq_distances[r - begin] = std::max(0.0, shard_dist[r - begin] + probe_sq_norm + model_sq_norms[r]);
+}
+
+void ipa_PeopleDetector::FaceRecognizer1D::calcSquaredDistances(cv::Mat& probe_row, const std::vector<int>& rows, std::vector<double>& sq_distances)
+{
+	double probe_sq_norm = probe_row.dot(probe_row);
+	const double* model_sq_norms = model_sq_norms_.ptr<double>(0);
+	sq_distances.resize(rows.size());
+	for (int i = 0; i < (int)rows.size(); i++)
 	{
-		cv::Mat model_mat = model_features_.row(r);
+		int r = rows[i];
+		sq_distances[i] = std::max(0.0, probe_sq_norm + model_sq_norms[r] - 2.0 * probe_row.dot(model_features_.row(r)));
+	}
+}
 
-		//calculate L2 norm between probe amd all model mats
-		norm = cv::norm(probe_mat, model_mat, cv::NORM_L2);
+void ipa_PeopleDetector::FaceRecognizer1D::calcSquaredDistances(cv::Mat& probe_mat, cv::Mat& sq_distances)
+{
+	// -2*p*G^T for all probes and model features at once, computed in model precision
+	cv::gemm(probe_mat, model_features_, -2.0, cv::Mat(), 0.0, sq_distances, cv::GEMM_2_T);
+	if (sq_distances.type() != CV_64FC1)
+		sq_distances.convertTo(sq_distances, CV_64FC1);
 
+	const double* model_sq_norms = model_sq_norms_.ptr<double>(0);
+	for (int i = 0; i < sq_distances.rows; i++)
+	{
+		cv::Mat probe_row = probe_mat.row(i);
+		double probe_sq_norm = probe_row.dot(probe_row);
+		double* sq_dist = sq_distances.ptr<double>(i);
+		// clamp at zero, the expansion may turn out slightly negative for (nearly) identical vectors
+		for (int r = 0; r < sq_distances.cols; r++)
+			sq_dist[r] = std::max(0.0, sq_dist[r] + probe_sq_norm + model_sq_norms[r]);
+	}
+}
+
+void ipa_PeopleDetector::FaceRecognizer1D::reduceDistances(const double* sq_distances, const int* rows, int count, int& minDIFSindex, double& minDIFS,
+		cv::Mat& probabilities)
+{
+	double min_sq_dist = std::numeric_limits<double>::max();
+	minDIFSindex = 0;
+	std::vector<double> class_min_sq_dist(num_classes_, std::numeric_limits<double>::max());
+	for (int i = 0; i < count; i++)
+	{
+		int r = (rows != 0) ? rows[i] : i;
 		// update minimum distance and index if required
-		if (norm < minDIFS)
+		if (sq_distances[i] < min_sq_dist)
 		{
 			minDIFSindex = r;
-			minDIFS = norm;
+			min_sq_dist = sq_distances[i];
 		}
 		//calculate cost for classification to every class in database
+		double& class_min = class_min_sq_dist[model_label_vec_[r]];
+		class_min = std::min(class_min, sq_distances[i]);
 	}
+	minDIFS = sqrt(min_sq_dist);
 
-	//process class_cost
-	double min_cost, max_cost;
-	probabilities = 1 / (probabilities.mul(probabilities));
-	cv::minMaxLoc(probabilities, &min_cost, &max_cost, 0, 0);
-	probabilities /= max_cost;
+	classProbabilities(class_min_sq_dist, probabilities);
+}
 
-	return;
+void ipa_PeopleDetector::FaceRecognizer1D::classProbabilities(const std::vector<double>& class_min_sq_dist, cv::Mat& probabilities)
+{
+	//process class_cost: probabilities are proportional to 1/distance^2
+	probabilities = cv::Mat(1, num_classes_, CV_64FC1);
+	double max_prob = 0.0;
+	for (int c = 0; c < num_classes_; c++)
+	{
+		double p = 1.0 / std::max(class_min_sq_dist[c], std::numeric_limits<double>::epsilon());
+		probabilities.at<double>(c) = p;
+		max_prob = std::max(max_prob, p);
+	}
+	if (max_prob > 0.0)
+		probabilities /= max_prob;
+}
+
+void ipa_PeopleDetector::FaceRecognizer1D::convertModel()
+{
+	projection_mat_.convertTo(projection_mat_, model_type_);
+	eigenvalues_.convertTo(eigenvalues_, model_type_);
+	average_arr_.convertTo(average_arr_, model_type_);
+	model_features_.convertTo(model_features_, model_type_);
+	calcModelNorms();
+}
+
+void ipa_PeopleDetector::FaceRecognizer1D::buildGalleryIndex()
+{
+	if (gallery_index_probes_ > 0)
+		gallery_index_.build(model_features_);
+	else
+		gallery_index_.clear();
+
+	if (quantized_candidates_ > 0)
+		quantized_gallery_.build(model_features_);
+	else
+		quantized_gallery_.clear();
+}
+
+void ipa_PeopleDetector::FaceRecognizer1D::calcModelNorms()
+{
+	model_sq_norms_ = cv::Mat(1, model_features_.rows, CV_64FC1);
+	for (int r = 0; r < model_features_.rows; r++)
+	{
+		cv::Mat model_row = model_features_.row(r);
+		model_sq_norms_.at<double>(r) = model_row.dot(model_row);
+	}
+}
+
+void ipa_PeopleDetector::FaceRecognizer1D::detachModel()
+{
+	// cv::Mat copies share their data, updates write into some of the matrices in place
+	projection_mat_ = projection_mat_.clone();
+	eigenvalues_ = eigenvalues_.clone();
+	average_arr_ = average_arr_.clone();
+	model_features_ = model_features_.clone();
+	model_sq_norms_ = model_sq_norms_.clone();
 }
 
 void ipa_PeopleDetector::FaceRecognizer2D::classifyImage(cv::Mat& probe_mat, int& max_prob_index)
@@ -149,6 +712,28 @@ void ipa_PeopleDetector::FaceRecognizer2D::classifyImage(cv::Mat& probe_mat, int
 	classifyImage(probe_mat, max_prob_index, classification_probabilities);
 }
 void ipa_PeopleDetector::FaceRecognizer2D::classifyImage(cv::Mat& probe_mat, int& max_prob_index, cv::Mat& classification_probabilities)
+{
+	classifyRestricted(probe_mat, 0, max_prob_index, classification_probabilities);
+}
+
+void ipa_PeopleDetector::FaceRecognizer2D::classifyRestricted(cv::Mat& probe_mat, const std::vector<int>* rows, int& max_prob_index, cv::Mat& classification_probabilities)
+{
+	double minDIFS;
+	int minDIFSindex;
+	matchRestricted(probe_mat, rows, minDIFSindex, minDIFS, classification_probabilities);
+	max_prob_index = (int)model_label_vec_[minDIFSindex];
+
+	//check whether unknown threshold is exceeded
+	if (use_unknown_thresh_)
+	{
+		if (!is_known(minDIFS, unknown_thresh_))
+			max_prob_index = -1;
+	}
+	return;
+}
+
+void ipa_PeopleDetector::FaceRecognizer2D::matchRestricted(cv::Mat& probe_mat, const std::vector<int>* rows, int& minDIFSindex, double& minDIFS,
+		cv::Mat& classification_probabilities)
 {
 	//if((int)probe_mat.rows!=(int)source_dim_.height || (int)probe_mat.cols !=(int)source_dim_.width)
 	//    {
@@ -158,122 +743,199 @@ void ipa_PeopleDetector::FaceRecognizer2D::classifyImage(cv::Mat& probe_mat, int
 	//project query mat to feature space
 
 	cv::Mat feature_mat;
-	extractFeatures(probe_mat, projection_mat_, feature_mat);
+	if (probe_mat.type() != projection_mat_.type())
+	{
+		cv::Mat probe_model_type;
+		probe_mat.convertTo(probe_model_type, projection_mat_.type());
+		extractFeatures(probe_model_type, projection_mat_, feature_mat);
+	}
+	else
+		extractFeatures(probe_mat, projection_mat_, feature_mat);
 
 	//calculate distance in face space DIFS
-	double minDIFS;
-	cv::Mat minDIFScoeffs;
-	int minDIFSindex;
-	calcDIFS(feature_mat, minDIFSindex, minDIFS, classification_probabilities);
-	max_prob_index = (int)model_label_vec_[minDIFSindex];
+	calcDIFS(feature_mat, rows, minDIFSindex, minDIFS, classification_probabilities);
+}
 
-	//check whether unknown threshold is exceeded
-	if (use_unknown_thresh_)
+void ipa_PeopleDetector::FaceRecognizer2D::classifyImages(std::vector<cv::Mat>& probe_mats, std::vector<int>& max_prob_indices)
+{
+	max_prob_indices.resize(probe_mats.size());
+	if (probe_mats.size() == 0)
+		return;
+
+	//project all probes to feature space with one GEMM
+	std::vector<cv::Mat> feature_mats;
+	extractFeatures(probe_mats, projection_mat_, feature_mats);
+
+	cv::Mat classification_probabilities;
+	for (int i = 0; i < (int)probe_mats.size(); i++)
 	{
-		if (!is_known(minDIFS, unknown_thresh_))
-			max_prob_index = -1;
+		double minDIFS;
+		int minDIFSindex;
+		calcDIFS(feature_mats[i], minDIFSindex, minDIFS, classification_probabilities);
+		max_prob_indices[i] = (int)model_label_vec_[minDIFSindex];
+
+		//check whether unknown threshold is exceeded
+		if (use_unknown_thresh_)
+		{
+			if (!is_known(minDIFS, unknown_thresh_))
+				max_prob_indices[i] = -1;
+		}
 	}
-	return;
 }
+
 void ipa_PeopleDetector::FaceRecognizer2D::extractFeatures(std::vector<cv::Mat>& src_vec, cv::Mat& proj_mat, std::vector<cv::Mat>& coeff_mat_vec)
 {
-	//calculate coefficients
+	coeff_mat_vec.resize(src_vec.size());
+	if (src_vec.size() == 0)
+		return;
+
+	// stack all images vertically, the projection of the stack holds the coefficients of each image in a block of consecutive rows
+	int rows = src_vec[0].rows;
+	cv::Mat src_stack = cv::Mat(src_vec.size() * rows, src_vec[0].cols, proj_mat.type());
 	for (int i = 0; i < src_vec.size(); i++)
 	{
-		cv::Mat src_mat = cv::Mat(src_vec[0].rows, src_vec[0].cols, CV_64FC1);
-		src_vec[i].convertTo(src_mat, CV_64FC1);
-		cv::Mat coeff_mat = cv::Mat(src_mat.rows, src_mat.cols, CV_64FC1);
-		cv::gemm(src_mat, proj_mat, 1.0, cv::Mat(), 0.0, coeff_mat, cv::GEMM_2_T);
-		coeff_mat_vec[i] = coeff_mat;
+		cv::Mat dst_block = src_stack.rowRange(i * rows, (i + 1) * rows);
+		src_vec[i].convertTo(dst_block, proj_mat.type());
 	}
+
+	//calculate coefficients of all images with one GEMM
+	cv::Mat coeff_stack;
+	cv::gemm(src_stack, proj_mat, 1.0, cv::Mat(), 0.0, coeff_stack, cv::GEMM_2_T);
+	for (int i = 0; i < src_vec.size(); i++)
+		coeff_mat_vec[i] = coeff_stack.rowRange(i * rows, (i + 1) * rows);
 }
 void ipa_PeopleDetector::FaceRecognizer2D::extractFeatures(cv::Mat& src_mat, cv::Mat& proj_mat, cv::Mat& coeff_mat)
 {
 
-	coeff_mat = cv::Mat(target_dim_, target_dim_, CV_64FC1);
+	coeff_mat = cv::Mat(target_dim_, target_dim_, proj_mat.type());
 	cv::gemm(src_mat, proj_mat, 1.0, cv::Mat(), 0.0, coeff_mat, cv::GEMM_2_T);
 }
 
+void ipa_PeopleDetector::FaceRecognizer2D::calcShardDistances(const cv::Mat& probe, int begin, int end, double* sq_distances)
+{
+	for (int m = begin; m < end; m++)
+		sq_distances[m - begin] = sqFrobeniusDistance(probe, m);
+}
+
+double ipa_PeopleDetector::FaceRecognizer2D::sqFrobeniusDistance(const cv::Mat& probe, int m)
+{
+	int n = model_tensor_.cols;
+	if (model_tensor_.type() == CV_32FC1)
+		return sqDistance(probe.ptr<float>(0), model_tensor_.ptr<float>(m), n);
+	return sqDistance(probe.ptr<double>(0), model_tensor_.ptr<double>(m), n);
+}
+
 void ipa_PeopleDetector::FaceRecognizer2D::calcDIFS(cv::Mat& probe_mat, int& minDIFSindex, double& minDIFS, cv::Mat& probabilities)
 {
-	minDIFS = std::numeric_limits<double>::max();
-	probabilities = cv::Mat(1, num_classes_, CV_32FC1);
-	probabilities *= std::numeric_limits<float>::max();
-	for (int m = 0; m < model_features_.size(); m++)
+	calcDIFS(probe_mat, 0, minDIFSindex, minDIFS, probabilities);
+}
+
+void ipa_PeopleDetector::FaceRecognizer2D::calcDIFS(cv::Mat& probe_mat, const std::vector<int>* rows, int& minDIFSindex, double& minDIFS, cv::Mat& probabilities)
+{
+	// the fused distance kernel expects a continuous probe in model precision
+	cv::Mat probe = probe_mat;
+	if (!probe.isContinuous() || probe.type() != model_tensor_.type())
 	{
-		// subtract matrices
-		cv::Mat work_mat;
-		cv::subtract(probe_mat, model_features_[m], work_mat);
-		cv::pow(work_mat, 2, work_mat);
-		cv::Mat tmp_vec = cv::Mat::zeros(1, probe_mat.cols, CV_64FC1);
-		cv::reduce(work_mat, tmp_vec, 0, CV_REDUCE_SUM);
+		probe = cv::Mat();
+		probe_mat.convertTo(probe, model_tensor_.type());
+	}
 
-		cv::Scalar norm = cv::sum(tmp_vec);
+	// approximate search (index cells, quantized gallery) with re-ranking in full precision, exhaustive search otherwise
+	std::vector<int> candidates;
+	bool use_candidates = selectCandidates(probe, rows, candidates);
+	int num_candidates = (use_candidates == true) ? candidates.size() : model_features_.size();
+
+	minDIFS = std::numeric_limits<double>::max();
+	minDIFSindex = 0;
+	std::vector<double> class_min_dist(num_classes_, std::numeric_limits<double>::max());
+	// exact search, split into shards that are matched in parallel if activated
+	bool sharded = (use_candidates == false && matchShards(probe, model_tensor_.rows, model_tensor_.cols * model_tensor_.elemSize(), minDIFSindex, minDIFS,
+			class_min_dist));
+	for (int k = 0; k < num_candidates && sharded == false; k++)
+	{
+		int m = (use_candidates == true) ? candidates[k] : k;
+		double dist = sqFrobeniusDistance(probe, m);
 
-		if ((double)norm[0] < minDIFS)
+		if (dist < minDIFS)
 		{
 			minDIFSindex = m;
-			minDIFS = (double)norm[0];
+			minDIFS = dist;
 		}
 		//calculate cost for classification to every class in database
-		probabilities.at<float>(model_label_vec_[m]) = std::min(probabilities.at<float>(model_label_vec_[m]), (float)norm[0]);
+		double& class_min = class_min_dist[model_label_vec_[m]];
+		class_min = std::min(class_min, dist);
 	}
 
 	//process class_cost
-	double min_cost, max_cost;
-	probabilities = 1 / (probabilities.mul(probabilities));
-	cv::minMaxLoc(probabilities, &min_cost, &max_cost, 0, 0);
-	probabilities /= max_cost;
+	probabilities = cv::Mat(1, num_classes_, CV_64FC1);
+	double max_prob = 0.0;
+	for (int c = 0; c < num_classes_; c++)
+	{
+		double p = 1.0 / std::max(class_min_dist[c] * class_min_dist[c], std::numeric_limits<double>::epsilon());
+		probabilities.at<double>(c) = p;
+		max_prob = std::max(max_prob, p);
+	}
+	if (max_prob > 0.0)
+		probabilities /= max_prob;
 
 	return;
 }
 
 void ipa_PeopleDetector::FaceRecognizer2D::calc_threshold(std::vector<cv::Mat>& data, double& thresh)
 {
-	thresh = std::numeric_limits<double>::max();
-	std::vector<double> P(num_classes_, std::numeric_limits<double>::max());
-	std::vector<double> D(num_classes_, std::numeric_limits<double>::min());
-	std::vector<double> Phi(num_classes_, std::numeric_limits<double>::max());
+	if (data.size() == 0)
+		return;
 
+	// the squared Frobenius distance of the feature matrices equals the squared Euclidean distance of the flattened features
+	cv::Mat data_arr = cv::Mat(data.size(), data[0].total(), CV_64FC1);
 	for (int i = 0; i < data.size(); i++)
 	{
-		for (int n = 0; n < data.size(); n++)
-		{
-			if (n == i)
-				continue;
-
-			// subtract matrices
-			cv::Mat work_mat = cv::Mat(data[0].rows, data[0].cols, CV_64FC1);
-			cv::subtract(data[i], data[n], work_mat);
-			cv::pow(work_mat, 2, work_mat);
-			//cv::sqrt(work_mat,work_mat);
-			cv::Mat tmp_vec = cv::Mat::zeros(1, data[i].cols, CV_64FC1);
-			cv::reduce(work_mat, tmp_vec, 0, CV_REDUCE_SUM);
-
-			cv::Scalar temp = cv::sum(tmp_vec);
-			double dist = temp.val[0];
-			if (model_label_vec_[n] == model_label_vec_[i])
-			{
-				D[model_label_vec_[i]] = std::max(dist, D[model_label_vec_[i]]);
-			}
-			else
-			{
-				P[model_label_vec_[i]] = std::min(dist, P[model_label_vec_[i]]);
-			}
-		}
+		cv::Mat dst_row = data_arr.row(i);
+		data[i].reshape(1, 1).convertTo(dst_row, CV_64FC1);
 	}
+	calcThresholdGram(data_arr, true, 0.2, thresh);
+}
 
-	// if only one class - P =D
-	if (num_classes_ == 1)
+void ipa_PeopleDetector::FaceRecognizer2D::buildGalleryIndex()
+{
+	// the Frobenius distance of the feature matrices equals the Euclidean distance of the rows of the gallery tensor
+	if (gallery_index_probes_ > 0)
+		gallery_index_.build(model_tensor_);
+	else
+		gallery_index_.clear();
+
+	if (quantized_candidates_ > 0)
+		quantized_gallery_.build(model_tensor_);
+	else
+		quantized_gallery_.clear();
+}
+
+void ipa_PeopleDetector::FaceRecognizer2D::convertModel()
+{
+	projection_mat_.convertTo(projection_mat_, model_type_);
+	eigenvalues_.convertTo(eigenvalues_, model_type_);
+	average_mat_.convertTo(average_mat_, model_type_);
+	packModelFeatures();
+}
+
+void ipa_PeopleDetector::FaceRecognizer2D::packModelFeatures()
+{
+	if (model_features_.size() == 0)
 	{
-		P[0] = D[0];
+		model_tensor_.release();
+		return;
 	}
 
-	for (int c = 0; c < num_classes_; c++)
+	int rows = model_features_[0].rows;
+	cv::Mat tensor = cv::Mat(model_features_.size(), model_features_[0].total(), model_type_);
+	for (int i = 0; i < model_features_.size(); i++)
 	{
-		thresh = std::min(thresh, (P[c] + D[c]) * 0.2);
+		cv::Mat dst_row = tensor.row(i);
+		model_features_[i].reshape(1, 1).convertTo(dst_row, model_type_);
 	}
-	std::cout << "THRESH for db: " << thresh << std::endl;
+	model_tensor_ = tensor;
+	for (int i = 0; i < model_features_.size(); i++)
+		model_features_[i] = model_tensor_.row(i).reshape(1, rows);
 }
 
 bool ipa_PeopleDetector::FaceRecognizer1D::loadModel(boost::filesystem::path& model_file)
@@ -295,12 +957,17 @@ bool ipa_PeopleDetector::FaceRecognizer1D::loadModel(boost::filesystem::path& mo
 	cv::FileNodeIterator it = fn.begin(), it_end = fn.end();
 	int idx = 0;
 	model_label_vec_.resize(model_features_.rows);
+	num_classes_ = 0;
 	for (; it != it_end; ++it, idx++)
 	{
 		model_label_vec_[idx] = (int)(*it);
+		num_classes_ = std::max(num_classes_, model_label_vec_[idx] + 1);
 	}
 
 	target_dim_ = model_features_.cols;
+	convertModel();
+	loadGalleryIndex(fs, model_features_.rows, model_features_.cols);
+	mapped_model_.reset();
 	trained_ = true;
 
 }
@@ -322,8 +989,58 @@ bool ipa_PeopleDetector::FaceRecognizer1D::saveModel(boost::filesystem::path& mo
 		fs << model_label_vec_[i];
 	}
 	fs << "]";
+	saveGalleryIndex(fs);
 	fs.release();
+}
+
+void ipa_PeopleDetector::FaceRecognizer1D::writeModel(ModelFileWriter& writer)
+{
+	std::cout << "FaceRecognizer1D::writeModel() to " << writer.path().string() << std::endl;
+	writer.addInt("recognizer_1d", 1);
+	writer.addMat("projection_matrix", projection_mat_);
+	writer.addMat("eigenvalues", eigenvalues_);
+	writer.addDouble("unknown_threshold", unknown_thresh_);
+	writer.addMat("average_image", average_arr_);
+	writer.addMat("model_features", model_features_);
+	writer.addMat("model_sq_norms", model_sq_norms_);
+	writer.addMat("numeric_labels", cv::Mat(model_label_vec_, true));
+	writeGalleryIndex(writer);
+}
+
+bool ipa_PeopleDetector::FaceRecognizer1D::readModel(const boost::shared_ptr<ModelFile>& model_file)
+{
+	std::cout << "FaceRecognizer1D::readModel() from " << model_file->path().string() << std::endl;
+	cv::Mat labels;
+	if (!model_file->contains("recognizer_1d") || !model_file->getMat("projection_matrix", projection_mat_) || !model_file->getMat("eigenvalues", eigenvalues_)
+			|| !model_file->getDouble("unknown_threshold", unknown_thresh_) || !model_file->getMat("average_image", average_arr_)
+			|| !model_file->getMat("model_features", model_features_) || !model_file->getMat("numeric_labels", labels)
+			|| (int)labels.total() != model_features_.rows || (labels.total() > 0 && labels.type() != CV_32SC1))
+	{
+		std::cout << "FaceRecognizer1D::readModel() " << model_file->path().string() << " does not contain a 1D model" << std::endl;
+		trained_ = false;
+		return false;
+	}
+	mapped_model_ = model_file;
+
+	model_label_vec_.assign((int*)labels.data, (int*)labels.data + labels.total());
+	num_classes_ = 0;
+	for (int i = 0; i < (int)model_label_vec_.size(); i++)
+		num_classes_ = std::max(num_classes_, model_label_vec_[i] + 1);
+	target_dim_ = model_features_.cols;
 
+	// matrices of the model type stay in the mapping, the norms only have to be recomputed after a conversion
+	cv::Mat model_sq_norms;
+	bool convert = (projection_mat_.type() != model_type_ || model_features_.type() != model_type_);
+	if (convert == false && model_file->getMat("model_sq_norms", model_sq_norms) && (int)model_sq_norms.total() == model_features_.rows)
+		model_sq_norms_ = model_sq_norms;
+	else
+		convert = true;
+	if (convert == true)
+		convertModel();
+
+	readGalleryIndex(*model_file, model_features_.rows, model_features_.cols);
+	trained_ = true;
+	return true;
 }
 
 bool ipa_PeopleDetector::FaceRecognizer2D::loadModel(boost::filesystem::path& model_file)
@@ -340,6 +1057,7 @@ bool ipa_PeopleDetector::FaceRecognizer2D::loadModel(boost::filesystem::path& mo
 	//fs["average_image"]>>average_mat_;
 
 	//load model features
+	model_features_.clear();
 	cv::FileNode fnm = fs["model_features"];
 	cv::FileNodeIterator itm = fnm.begin(), itm_end = fnm.end();
 	int idm = 0;
@@ -355,12 +1073,17 @@ bool ipa_PeopleDetector::FaceRecognizer2D::loadModel(boost::filesystem::path& mo
 	cv::FileNodeIterator it = fn.begin(), it_end = fn.end();
 	int idx = 0;
 	model_label_vec_.resize(model_features_.size());
+	num_classes_ = 0;
 	for (; it != it_end; ++it, idx++)
 	{
 		model_label_vec_[idx] = (int)(*it);
+		num_classes_ = std::max(num_classes_, model_label_vec_[idx] + 1);
 	}
 
 	target_dim_ = model_features_[0].cols;
+	convertModel();
+	loadGalleryIndex(fs, model_tensor_.rows, model_tensor_.cols);
+	mapped_model_.reset();
 	trained_ = true;
 
 }
@@ -387,9 +1110,63 @@ bool ipa_PeopleDetector::FaceRecognizer2D::saveModel(boost::filesystem::path& mo
 		fs << model_label_vec_[i];
 	}
 	fs << "]";
+	saveGalleryIndex(fs);
 	fs.release();
+}
+
+void ipa_PeopleDetector::FaceRecognizer2D::writeModel(ModelFileWriter& writer)
+{
+	std::cout << "FaceRecognizer2D::writeModel() to " << writer.path().string() << std::endl;
+	writer.addInt("recognizer_2d", 1);
+	writer.addMat("projection_matrix", projection_mat_);
+	writer.addMat("eigenvalues", eigenvalues_);
+	writer.addDouble("unknown_threshold", unknown_thresh_);
+	writer.addMat("average_image", average_mat_);
+	// the gallery is stored as the contiguous tensor, one flattened feature matrix per row
+	writer.addInt("feature_rows", (model_features_.size() > 0) ? model_features_[0].rows : 0);
+	writer.addMat("model_tensor", model_tensor_);
+	writer.addMat("numeric_labels", cv::Mat(model_label_vec_, true));
+	writeGalleryIndex(writer);
+}
+
+bool ipa_PeopleDetector::FaceRecognizer2D::readModel(const boost::shared_ptr<ModelFile>& model_file)
+{
+	std::cout << "FaceRecognizer2D::readModel() from " << model_file->path().string() << std::endl;
+	cv::Mat labels, tensor;
+	int feature_rows = 0;
+	if (!model_file->contains("recognizer_2d") || !model_file->getMat("projection_matrix", projection_mat_) || !model_file->getMat("eigenvalues", eigenvalues_)
+			|| !model_file->getDouble("unknown_threshold", unknown_thresh_) || !model_file->getMat("average_image", average_mat_)
+			|| !model_file->getInt("feature_rows", feature_rows) || !model_file->getMat("model_tensor", tensor) || !model_file->getMat("numeric_labels", labels)
+			|| tensor.rows == 0 || feature_rows <= 0 || tensor.cols % feature_rows != 0 || (int)labels.total() != tensor.rows || labels.type() != CV_32SC1)
+	{
+		std::cout << "FaceRecognizer2D::readModel() " << model_file->path().string() << " does not contain a 2D model" << std::endl;
+		trained_ = false;
+		return false;
+	}
+	mapped_model_ = model_file;
+
+	model_label_vec_.assign((int*)labels.data, (int*)labels.data + labels.total());
+	num_classes_ = 0;
+	for (int i = 0; i < (int)model_label_vec_.size(); i++)
+		num_classes_ = std::max(num_classes_, model_label_vec_[i] + 1);
+
+	// the feature matrices refer to the rows of the mapped tensor unless it has to be converted
+	projection_mat_.convertTo(projection_mat_, model_type_);
+	eigenvalues_.convertTo(eigenvalues_, model_type_);
+	average_mat_.convertTo(average_mat_, model_type_);
+	if (tensor.type() != model_type_)
+		tensor.convertTo(tensor, model_type_);
+	model_tensor_ = tensor;
+	model_features_.resize(model_tensor_.rows);
+	for (int i = 0; i < model_tensor_.rows; i++)
+		model_features_[i] = model_tensor_.row(i).reshape(1, feature_rows);
+	target_dim_ = model_features_[0].cols;
 
+	readGalleryIndex(*model_file, model_tensor_.rows, model_tensor_.cols);
+	trained_ = true;
+	return true;
 }
+
 bool ipa_PeopleDetector::FaceRecognizer_Eigenfaces::trainModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec, int& target_dim)
 {
 
@@ -428,12 +1205,54 @@ bool ipa_PeopleDetector::FaceRecognizer_Eigenfaces::trainModel(std::vector<cv::M
 	extractFeatures(model_data_arr, projection_mat_, model_features_);
 
 	calc_threshold(model_features_, unknown_thresh_);
+	convertModel();
+	buildGalleryIndex();
 
 	// set FaceRecognizer to trained
 	this->trained_ = true;
 	return true;
 }
 
+bool ipa_PeopleDetector::FaceRecognizer_Eigenfaces::updateModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec)
+{
+	if (!trained_ || img_vec.size() == 0 || img_vec.size() != label_vec.size())
+		return false;
+	if ((int)img_vec[0].total() != projection_mat_.cols || eigenvalues_.total() != projection_mat_.rows)
+		return false;
+	if (!appendLabels(label_vec))
+		return false;
+
+	std::cout << "Updating Eigenfaces with " << img_vec.size() << " images" << std::endl;
+	cv::Mat new_data_arr = cv::Mat(img_vec.size(), img_vec[0].total(), CV_64FC1);
+	model_data_mat(img_vec, new_data_arr);
+
+	// merge the new images into the eigenspace, the subspace dimension is kept
+	SubspaceAnalysis::IPCA IPCA(projection_mat_, eigenvalues_, average_arr_, model_features_.rows);
+	IPCA.update(new_data_arr, target_dim_);
+	IPCA.updateFeatures(model_features_);
+
+	//Assign model to member variables
+	projection_mat_ = IPCA.eigenvecs;
+	eigenvalues_ = IPCA.eigenvals;
+	average_arr_ = IPCA.mean;
+
+	cv::Mat new_features;
+	extractFeatures(new_data_arr, projection_mat_, new_features);
+	model_features_.push_back(new_features);
+
+	calc_threshold(model_features_, unknown_thresh_);
+	convertModel();
+	buildGalleryIndex();
+	return true;
+}
+
+ipa_PeopleDetector::FaceRecognizerBaseClass* ipa_PeopleDetector::FaceRecognizer_Eigenfaces::clone() const
+{
+	FaceRecognizer_Eigenfaces* copy = new FaceRecognizer_Eigenfaces(*this);
+	copy->detachModel();
+	return copy;
+}
+
 bool ipa_PeopleDetector::FaceRecognizer_Fisherfaces::trainModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec, int& target_dim)
 {
 	input_param_check(img_vec, label_vec, target_dim);
@@ -483,6 +1302,14 @@ bool ipa_PeopleDetector::FaceRecognizer_Fisherfaces::trainModel(std::vector<cv::
 
 	extractFeatures(model_data_arr, P_PCA, model_features_PCA);
 
+	// keep the PCA stage for incremental updates
+	if (use_incremental_updates_)
+	{
+		pca_projection_ = P_PCA;
+		pca_eigenvalues_ = PCA.eigenvals;
+		pca_features_ = model_features_PCA;
+	}
+
 	//perform LDA
 	LDA = SubspaceAnalysis::LDA(model_features_PCA, model_label_vec_, num_classes_, target_dim_);
 	P_LDA = LDA.eigenvecs;
@@ -498,12 +1325,162 @@ bool ipa_PeopleDetector::FaceRecognizer_Fisherfaces::trainModel(std::vector<cv::
 	extractFeatures(model_data_arr, projection_mat_, model_features_);
 
 	calc_threshold(model_features_, unknown_thresh_);
+	convertModel();
+	buildGalleryIndex();
 
 	// set FaceRecognizer to trained
 	this->trained_ = true;
 	return true;
 }
 
+bool ipa_PeopleDetector::FaceRecognizer_Fisherfaces::updateModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec)
+{
+	// the PCA stage is only available if incremental updates were activated for the training
+	if (!trained_ || pca_projection_.empty() || img_vec.size() == 0 || img_vec.size() != label_vec.size())
+		return false;
+	if ((int)img_vec[0].total() != pca_projection_.cols)
+		return false;
+	if (!appendLabels(label_vec))
+		return false;
+
+	std::cout << "Updating Fisherfaces with " << img_vec.size() << " images" << std::endl;
+	cv::Mat new_data_arr = cv::Mat(img_vec.size(), img_vec[0].total(), CV_64FC1);
+	model_data_mat(img_vec, new_data_arr);
+
+	// incremental PCA, the dimension follows the rule of the training
+	int target_dim_PCA = model_label_vec_.size() - num_classes_;
+	if (target_dim_PCA < 1)
+		target_dim_PCA = num_classes_;
+	SubspaceAnalysis::IPCA IPCA(pca_projection_, pca_eigenvalues_, average_arr_, pca_features_.rows);
+	IPCA.update(new_data_arr, target_dim_PCA);
+	IPCA.updateFeatures(pca_features_);
+	pca_projection_ = IPCA.eigenvecs;
+	pca_eigenvalues_ = IPCA.eigenvals;
+	average_arr_ = IPCA.mean;
+
+	cv::Mat new_features_PCA;
+	extractFeatures(new_data_arr, pca_projection_, new_features_PCA);
+	pca_features_.push_back(new_features_PCA);
+
+	// LDA is solved again in the low dimensional PCA space
+	target_dim_ = num_classes_ - 1;
+	SubspaceAnalysis::LDA LDA(pca_features_, model_label_vec_, num_classes_, target_dim_);
+	cv::Mat P_LDA = LDA.eigenvecs;
+
+	// combine projection matrices, the model features follow from the PCA features
+	cv::gemm(P_LDA, pca_projection_, 1.0, cv::Mat(), 0.0, projection_mat_);
+	eigenvalues_ = LDA.eigenvals;
+	cv::gemm(pca_features_, P_LDA, 1.0, cv::Mat(), 0.0, model_features_, cv::GEMM_2_T);
+
+	calc_threshold(model_features_, unknown_thresh_);
+	convertModel();
+	buildGalleryIndex();
+	return true;
+}
+
+ipa_PeopleDetector::FaceRecognizerBaseClass* ipa_PeopleDetector::FaceRecognizer_Fisherfaces::clone() const
+{
+	FaceRecognizer_Fisherfaces* copy = new FaceRecognizer_Fisherfaces(*this);
+	copy->detachModel();
+	return copy;
+}
+
+void ipa_PeopleDetector::FaceRecognizer_Fisherfaces::detachModel()
+{
+	FaceRecognizer1D::detachModel();
+	pca_projection_ = pca_projection_.clone();
+	pca_eigenvalues_ = pca_eigenvalues_.clone();
+	pca_features_ = pca_features_.clone();
+}
+
+bool ipa_PeopleDetector::FaceRecognizer_Fisherfaces::saveModel(boost::filesystem::path& model_file)
+{
+	FaceRecognizer1D::saveModel(model_file);
+	if (pca_projection_.empty())
+		return true;
+
+	cv::FileStorage fs(model_file.string(), cv::FileStorage::APPEND);
+	if (!fs.isOpened())
+	{
+		std::cout << "FaceRecognizer_Fisherfaces::saveModel() can not append the PCA stage to " << model_file.string() << std::endl;
+		return false;
+	}
+	fs << "pca_projection" << pca_projection_;
+	fs << "pca_eigenvalues" << pca_eigenvalues_;
+	fs << "pca_features" << pca_features_;
+	fs.release();
+	return true;
+}
+
+bool ipa_PeopleDetector::FaceRecognizer_Fisherfaces::loadModel(boost::filesystem::path& model_file)
+{
+	FaceRecognizer1D::loadModel(model_file);
+
+	pca_projection_.release();
+	pca_eigenvalues_.release();
+	pca_features_.release();
+	if (use_incremental_updates_)
+	{
+		cv::FileStorage fs(model_file.string(), cv::FileStorage::READ);
+		fs["pca_projection"] >> pca_projection_;
+		fs["pca_eigenvalues"] >> pca_eigenvalues_;
+		fs["pca_features"] >> pca_features_;
+	}
+	checkPCAStage(model_file.string());
+	return trained_;
+}
+
+void ipa_PeopleDetector::FaceRecognizer_Fisherfaces::writeModel(ModelFileWriter& writer)
+{
+	FaceRecognizer1D::writeModel(writer);
+
+	// the PCA stage is only kept for incremental updates, it is stored so that the updates continue after a restart
+	if (pca_projection_.empty())
+		return;
+	writer.addMat("pca_projection", pca_projection_);
+	writer.addMat("pca_eigenvalues", pca_eigenvalues_);
+	writer.addMat("pca_features", pca_features_);
+}
+
+bool ipa_PeopleDetector::FaceRecognizer_Fisherfaces::readModel(const boost::shared_ptr<ModelFile>& model_file)
+{
+	pca_projection_.release();
+	pca_eigenvalues_.release();
+	pca_features_.release();
+	if (FaceRecognizer1D::readModel(model_file) == false)
+		return false;
+
+	// updateModel replaces and extends the PCA stage, so it is copied out of the mapping
+	cv::Mat projection, eigenvalues, features;
+	if (use_incremental_updates_ && model_file->getMat("pca_projection", projection) && model_file->getMat("pca_eigenvalues", eigenvalues)
+			&& model_file->getMat("pca_features", features))
+	{
+		pca_projection_ = projection.clone();
+		pca_eigenvalues_ = eigenvalues.clone();
+		pca_features_ = features.clone();
+	}
+	checkPCAStage(model_file->path().string());
+	return true;
+}
+
+void ipa_PeopleDetector::FaceRecognizer_Fisherfaces::checkPCAStage(const std::string& model_file)
+{
+	if (!use_incremental_updates_)
+		return;
+
+	bool valid = (!pca_projection_.empty() && pca_projection_.type() == CV_64FC1 && pca_projection_.cols == (int)average_arr_.total()
+			&& (int)pca_eigenvalues_.total() == pca_projection_.rows && pca_eigenvalues_.type() == CV_64FC1 && pca_features_.type() == CV_64FC1
+			&& pca_features_.rows == (int)model_label_vec_.size() && pca_features_.cols == pca_projection_.rows);
+	if (valid == false)
+	{
+		// models saved without incremental updates or by previous versions
+		std::cout << "FaceRecognizer_Fisherfaces: " << model_file << " contains no PCA stage, the next update requires a full training" << std::endl;
+		pca_projection_.release();
+		pca_eigenvalues_.release();
+		pca_features_.release();
+	}
+}
+
 bool ipa_PeopleDetector::FaceRecognizer_PCA2D::trainModel(std::vector<cv::Mat>& img_vec, std::vector<int>& label_vec, int& target_dim)
 {
 
@@ -536,6 +1513,8 @@ bool ipa_PeopleDetector::FaceRecognizer_PCA2D::trainModel(std::vector<cv::Mat>&
 
 	extractFeatures(img_vec, projection_mat_, model_features_);
 	calc_threshold(model_features_, unknown_thresh_);
+	convertModel();
+	buildGalleryIndex();
 
 	// set FaceRecognizer to trained
 	this->trained_ = true;
@@ -586,6 +1565,8 @@ bool ipa_PeopleDetector::FaceRecognizer_LDA2D::trainModel(std::vector<cv::Mat>&
 
 	extractFeatures(img_vec, projection_mat_, model_features_);
 	calc_threshold(model_features_, unknown_thresh_);
+	convertModel();
+	buildGalleryIndex();
 
 	// set FaceRecognizer to trained
 	this->trained_ = true;
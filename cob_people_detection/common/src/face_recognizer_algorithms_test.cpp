@@ -378,40 +378,15 @@ int main(int argc, const char *argv[])
 	// timeval t1,t2,t3,t4;
 	// gettimeofday(&t1,NULL);
 
-	switch (method)
-	{
-	case ipa_PeopleDetector::METH_EIGEN:
-	{
-		EFF = new ipa_PeopleDetector::FaceRecognizer_Eigenfaces();
-		break;
-	}
-	case ipa_PeopleDetector::METH_FISHER:
-	{
-		EFF = new ipa_PeopleDetector::FaceRecognizer_Fisherfaces();
-		break;
-	}
-	case ipa_PeopleDetector::METH_PCA2D:
-	{
-		EFF = new ipa_PeopleDetector::FaceRecognizer_PCA2D();
-		break;
-	}
-	case ipa_PeopleDetector::METH_LDA2D:
-	{
-		EFF = new ipa_PeopleDetector::FaceRecognizer_LDA2D();
-		break;
-	}
-	default:
-	{
-		EFF = new ipa_PeopleDetector::FaceRecognizer_Eigenfaces();
-		break;
-	}
-	}
+	EFF = ipa_PeopleDetector::createRecognizer(method);
 	std::cout << EFF->trained_ << std::endl;
 	boost::timer t;
 
 	boost::filesystem::path rpath = "/home/goa-tz/.ros/test.xml";
 	//EFF->loadModel(rpath);
 	std::cout << "loaded" << std::endl;
+	// trainModel condenses the labels in place, keep the original ones for the float32 model
+	std::vector<int> label_vec_float = label_vec;
 	EFF->trainModel(img_vec, label_vec, ss_dim);
 	//EFF->activate_unknown_treshold();
 	//gettimeofday(&t2,NULL);jj
@@ -440,6 +415,7 @@ int main(int argc, const char *argv[])
 
 	//restart timer
 	t.restart();
+	std::vector<int> classification_results(probe_mat_vec.size());
 	for (int i = 0; i < probe_mat_vec.size(); i++)
 	{
 		cv::Mat probe = probe_mat_vec[i];
@@ -466,6 +442,7 @@ int main(int argc, const char *argv[])
 		//}
 
 		//Output to classified file
+		classification_results[i] = c_EFF;
 		os << c_EFF << "\n";
 		probabilities_os << probabilities << "\n";
 	}
@@ -475,6 +452,25 @@ int main(int argc, const char *argv[])
 	os.close();
 	std::cout << "EFF classified" << std::endl;
 
+	// accuracy regression check: a float32 model has to reproduce the top-1 results of the double model
+	ipa_PeopleDetector::FaceRecognizerBaseClass* EFF_float = ipa_PeopleDetector::createRecognizer(method);
+	EFF_float->set_model_type(CV_32FC1);
+	t.restart();
+	EFF_float->trainModel(img_vec, label_vec_float, ss_dim);
+	std::cout << ">>>>>>>>>>float32 training time = " << t.elapsed() << std::endl;
+	t.restart();
+	std::vector<int> classification_results_float;
+	EFF_float->classifyImages(probe_mat_vec, classification_results_float);
+	std::cout << ">>>>>>>>>>float32 recognition time = " << t.elapsed() << std::endl;
+	int identical_results = 0;
+	for (int i = 0; i < probe_mat_vec.size(); i++)
+	{
+		if (classification_results_float[i] == classification_results[i])
+			identical_results++;
+	}
+	std::cout << "float32 model: " << identical_results << " of " << probe_mat_vec.size() << " top-1 results identical to double model" << std::endl;
+	delete EFF_float;
+
 	cv::Mat m1_evec, m1_eval, m1_avg, m1_pmd;
 
 	//EFF->getModel(m1_evec,m1_eval,m1_avg,m1_pmd);
@@ -498,5 +494,12 @@ int main(int argc, const char *argv[])
 
 
 	EFF->saveModel(rpath);
+	delete EFF;
+
+	if (identical_results != (int)probe_mat_vec.size())
+	{
+		std::cerr << "ERROR: float32 model changes top-1 results" << std::endl;
+		return 1;
+	}
 	return 0;
 }
@@ -0,0 +1,135 @@
+#include<cob_people_detection/face_recognizer_algorithms.h>
+#include<opencv/cv.h>
+#include<iostream>
+#include<vector>
+#include<stdlib.h>
+
+// Compares the accuracy and the recognition time of the full recognition model with the
+// coarse-to-fine cascade (low resolution Eigenfaces candidates verified by the full model)
+// on synthetic face images.
+//
+// usage: face_rec_cascade_benchmark [method] [cascade size] [cascade candidates] [persons] [images per person]
+//   method: FISHER, EIGEN, LDA2D or PCA2D
+
+// noisy image of a person, the base faces are smooth so that they are still distinguishable at low resolution
+cv::Mat sampleFace(cv::RNG& rng, const cv::Mat& base_face)
+{
+	cv::Mat noise = cv::Mat(base_face.size(), CV_64FC1);
+	rng.fill(noise, cv::RNG::NORMAL, 0.0, 25.0);
+	return base_face + noise;
+}
+
+int main(int argc, const char *argv[])
+{
+	std::string method_name = "EIGEN";
+	int cascade_size = 32;
+	int cascade_candidates = 20;
+	int num_persons = 100;
+	int images_per_person = 10;
+	if (argc > 1)
+		method_name = argv[1];
+	if (argc > 2)
+		cascade_size = atoi(argv[2]);
+	if (argc > 3)
+		cascade_candidates = atoi(argv[3]);
+	if (argc > 4)
+		num_persons = atoi(argv[4]);
+	if (argc > 5)
+		images_per_person = std::max(2, atoi(argv[5]));
+
+	ipa_PeopleDetector::Method method;
+	if (ipa_PeopleDetector::parseMethod(method_name, method) == false)
+	{
+		std::cout << "ERROR: invalid method " << method_name << " - use FISHER, EIGEN, LDA2D or PCA2D" << std::endl;
+		return 1;
+	}
+
+	const cv::Size norm_size(100, 100);
+	const cv::Size coarse_size(cascade_size, cascade_size);
+	int ss_dim = 10;
+	int coarse_dim = 5;
+	const int probes_per_person = 3;
+	cv::RNG rng(0);
+
+	// gallery and probes
+	std::vector<cv::Mat> img_vec, coarse_vec, probe_vec;
+	std::vector<int> label_vec, probe_labels;
+	for (int p = 0; p < num_persons; p++)
+	{
+		cv::Mat seed = cv::Mat(8, 8, CV_64FC1);
+		rng.fill(seed, cv::RNG::UNIFORM, 0.0, 255.0);
+		cv::Mat base_face;
+		cv::resize(seed, base_face, norm_size, 0, 0, cv::INTER_CUBIC);
+		for (int i = 0; i < images_per_person; i++)
+		{
+			img_vec.push_back(sampleFace(rng, base_face));
+			label_vec.push_back(p);
+		}
+		for (int i = 0; i < probes_per_person; i++)
+		{
+			probe_vec.push_back(sampleFace(rng, base_face));
+			probe_labels.push_back(p);
+		}
+	}
+	for (int i = 0; i < (int)img_vec.size(); i++)
+	{
+		cv::Mat coarse;
+		cv::resize(img_vec[i], coarse, coarse_size, 0, 0, cv::INTER_AREA);
+		coarse_vec.push_back(coarse);
+	}
+
+	ipa_PeopleDetector::FaceRecognizerBaseClass* recognizer = ipa_PeopleDetector::createRecognizer(method);
+	ipa_PeopleDetector::FaceRecognizer_Eigenfaces coarse_recognizer;
+	recognizer->trainModel(img_vec, label_vec, ss_dim);
+	coarse_recognizer.trainModel(coarse_vec, label_vec, coarse_dim);
+
+	// full model
+	int full_correct = 0;
+	int64 t_full = cv::getTickCount();
+	for (int i = 0; i < (int)probe_vec.size(); i++)
+	{
+		int label;
+		recognizer->classifyImage(probe_vec[i], label);
+		if (label == probe_labels[i])
+			full_correct++;
+	}
+	double full_time = (cv::getTickCount() - t_full) / cv::getTickFrequency();
+
+	// cascade, including the downscaling of the probes
+	int cascade_correct = 0;
+	int coarse_hits = 0;
+	std::vector<int> candidates;
+	int64 t_cascade = cv::getTickCount();
+	for (int i = 0; i < (int)probe_vec.size(); i++)
+	{
+		cv::Mat coarse_probe;
+		cv::resize(probe_vec[i], coarse_probe, coarse_size, 0, 0, cv::INTER_AREA);
+		int label = -1;
+		if (coarse_recognizer.rankCandidates(coarse_probe, cascade_candidates, candidates) == true)
+		{
+			for (int c = 0; c < (int)candidates.size(); c++)
+			{
+				if (label_vec[candidates[c]] == probe_labels[i])
+				{
+					coarse_hits++;
+					break;
+				}
+			}
+			recognizer->classifyCandidates(probe_vec[i], candidates, label);
+		}
+		if (label == probe_labels[i])
+			cascade_correct++;
+	}
+	double cascade_time = (cv::getTickCount() - t_cascade) / cv::getTickFrequency();
+
+	int num_probes = probe_vec.size();
+	std::cout << "method " << method_name << ", " << img_vec.size() << " gallery images, " << num_probes << " probes" << std::endl;
+	std::cout << "cascade " << cascade_size << "x" << cascade_size << ", " << coarse_dim << " dimensions, " << cascade_candidates << " candidates" << std::endl;
+	std::cout << "\taccuracy\ttime per probe [ms]" << std::endl;
+	std::cout << "full\t" << (double)full_correct / num_probes << "\t" << 1000.0 * full_time / num_probes << std::endl;
+	std::cout << "cascade\t" << (double)cascade_correct / num_probes << "\t" << 1000.0 * cascade_time / num_probes << std::endl;
+	std::cout << "coarse stage recall\t" << (double)coarse_hits / num_probes << std::endl;
+
+	delete recognizer;
+	return 0;
+}
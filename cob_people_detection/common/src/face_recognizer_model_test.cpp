@@ -0,0 +1,102 @@
+#include<cob_people_detection/face_recognizer.h>
+#include<cob_people_detection/training_data_archive.h>
+#include<opencv/cv.h>
+#include<iostream>
+#include<vector>
+#include <boost/filesystem.hpp>
+
+// Regression check for the class names of a stored recognition model: a model is trained for a request
+// whose order differs from the order of the stored faces, loaded again by a second recognizer and
+// has to report the same names for the faces of every person.
+//
+// usage: face_rec_model_test
+
+/// Exposes the classification of normalized faces with the published model.
+class ModelTestRecognizer: public ipa_PeopleDetector::FaceRecognizer
+{
+public:
+	std::string classify(const cv::Mat& face)
+	{
+		ipa_PeopleDetector::RecognitionModelPtr model = currentModel();
+		if (!model)
+			return "";
+		std::vector<cv::Mat> probes(1);
+		face.convertTo(probes[0], CV_64FC1);
+		std::vector<std::string> labels;
+		classifyProbes(*model, probes, "Unknown", labels);
+		return labels[0];
+	}
+};
+
+// noisy image of a person
+cv::Mat sampleFace(cv::RNG& rng, const cv::Mat& base_face)
+{
+	cv::Mat noise = cv::Mat(base_face.size(), CV_64FC1);
+	rng.fill(noise, cv::RNG::NORMAL, 0.0, 10.0);
+	cv::Mat face;
+	cv::Mat(base_face + noise).convertTo(face, CV_8UC1);
+	return face;
+}
+
+int main(int argc, const char *argv[])
+{
+	const int norm_size = 100;
+	const int images_per_person = 10;
+	cv::RNG rng(0);
+
+	boost::filesystem::path directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("face_rec_model_test_%%%%%%%%");
+	boost::filesystem::path data_directory = directory / "training_data";
+	boost::filesystem::create_directories(data_directory);
+
+	// the faces of A are stored before the faces of B
+	std::vector<std::string> persons;
+	persons.push_back("A");
+	persons.push_back("B");
+	std::vector<cv::Mat> base_faces, probes;
+	ipa_PeopleDetector::TrainingDataArchiveWriter writer;
+	writer.create(data_directory);
+	for (int p = 0; p < (int)persons.size(); p++)
+	{
+		cv::Mat seed = cv::Mat(8, 8, CV_64FC1);
+		rng.fill(seed, cv::RNG::UNIFORM, 0.0, 255.0);
+		cv::Mat base_face;
+		cv::resize(seed, base_face, cv::Size(norm_size, norm_size), 0, 0, cv::INTER_CUBIC);
+		for (int i = 0; i < images_per_person; i++)
+			writer.append(persons[p], sampleFace(rng, base_face), cv::Mat());
+		probes.push_back(sampleFace(rng, base_face));
+	}
+	if (writer.commit() == false)
+	{
+		std::cerr << "ERROR: can not write the training data to " << data_directory.string() << std::endl;
+		return 1;
+	}
+
+	// train for the request B, A and load the stored model again for A, B
+	std::vector<std::string> train_request, load_request;
+	train_request.push_back("B");
+	train_request.push_back("A");
+	load_request.push_back("A");
+	load_request.push_back("B");
+	ModelTestRecognizer trained, loaded;
+	std::string directory_name = directory.string() + "/";
+	trained.init(directory_name, norm_size, false, false, false, 0, false, train_request, 1, 10, false, false);
+	loaded.init(directory_name, norm_size, false, false, false, 0, false, load_request, 1, 10, false, false);
+
+	int errors = 0;
+	for (int p = 0; p < (int)persons.size(); p++)
+	{
+		std::string trained_label = trained.classify(probes[p]);
+		std::string loaded_label = loaded.classify(probes[p]);
+		std::cout << persons[p] << ": trained model " << trained_label << ", loaded model " << loaded_label << std::endl;
+		if (trained_label != persons[p] || loaded_label != persons[p])
+			errors++;
+	}
+
+	boost::filesystem::remove_all(directory);
+	if (errors > 0)
+	{
+		std::cerr << "ERROR: the stored model reports wrong names for " << errors << " persons" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include<cob_people_detection/face_recognizer_algorithms.h>
+#include<opencv/cv.h>
+#include<iostream>
+#include<vector>
+#include<stdlib.h>
+
+// Measures the training time of a recognition method (including the unknown threshold)
+// against the gallery size on synthetic face images.
+//
+// usage: face_rec_training_benchmark [method] [max gallery size] [images per person]
+//   method: FISHER, EIGEN, LDA2D or PCA2D
+
+int main(int argc, const char *argv[])
+{
+	std::string method_name = "EIGEN";
+	int max_gallery_size = 1600;
+	int images_per_person = 10;
+	if (argc > 1)
+		method_name = argv[1];
+	if (argc > 2)
+		max_gallery_size = atoi(argv[2]);
+	if (argc > 3)
+		images_per_person = std::max(2, atoi(argv[3]));
+
+	ipa_PeopleDetector::Method method;
+	if (ipa_PeopleDetector::parseMethod(method_name, method) == false)
+	{
+		std::cout << "ERROR: invalid method " << method_name << " - use FISHER, EIGEN, LDA2D or PCA2D" << std::endl;
+		return 1;
+	}
+
+	const cv::Size norm_size(100, 100);
+	int ss_dim = 10;
+	cv::RNG rng(0);
+
+	std::cout << "method " << method_name << ", " << images_per_person << " images per person" << std::endl;
+	std::cout << "gallery size\ttraining time [s]" << std::endl;
+	for (int gallery_size = 100; gallery_size <= max_gallery_size; gallery_size *= 2)
+	{
+		// every person is a random base face with per-image noise
+		std::vector<cv::Mat> img_vec;
+		std::vector<int> label_vec;
+		cv::Mat base_face = cv::Mat(norm_size, CV_64FC1);
+		for (int i = 0; i < gallery_size; i++)
+		{
+			if (i % images_per_person == 0)
+				rng.fill(base_face, cv::RNG::UNIFORM, 0.0, 255.0);
+			cv::Mat noise = cv::Mat(norm_size, CV_64FC1);
+			rng.fill(noise, cv::RNG::NORMAL, 0.0, 20.0);
+			img_vec.push_back(base_face + noise);
+			label_vec.push_back(i / images_per_person);
+		}
+
+		ipa_PeopleDetector::FaceRecognizerBaseClass* recognizer = ipa_PeopleDetector::createRecognizer(method);
+		int64 t = cv::getTickCount();
+		recognizer->trainModel(img_vec, label_vec, ss_dim);
+		std::cout << gallery_size << "\t" << (cv::getTickCount() - t) / cv::getTickFrequency() << std::endl;
+		delete recognizer;
+	}
+
+	return 0;
+}
@@ -0,0 +1,149 @@
+#include<cob_people_detection/gallery_index.h>
+
+#include<algorithm>
+#include<math.h>
+
+ipa_PeopleDetector::GalleryIndex::GalleryIndex() :
+	num_features_(0)
+{
+}
+
+void ipa_PeopleDetector::GalleryIndex::clear()
+{
+	centroids_.release();
+	lists_.clear();
+	num_features_ = 0;
+}
+
+void ipa_PeopleDetector::GalleryIndex::build(const cv::Mat& features)
+{
+	clear();
+	if (features.rows < min_gallery_size)
+		return;
+
+	// k-means works on single precision data
+	cv::Mat data;
+	features.convertTo(data, CV_32FC1);
+
+	int num_lists = (int)(sqrt((double)features.rows) + 0.5);
+	cv::Mat assignments;
+	cv::kmeans(data, num_lists, assignments, cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 20, 1e-3), 1, cv::KMEANS_PP_CENTERS,
+			centroids_);
+
+	lists_.resize(num_lists);
+	for (int r = 0; r < assignments.rows; r++)
+		lists_[assignments.at<int>(r)].push_back(r);
+	num_features_ = features.rows;
+
+	std::cout << "GalleryIndex::build() " << num_features_ << " features in " << num_lists << " lists" << std::endl;
+}
+
+bool ipa_PeopleDetector::GalleryIndex::search(const cv::Mat& probe, int num_probes, std::vector<int>& candidates) const
+{
+	candidates.clear();
+	if (empty() || num_probes <= 0 || num_probes >= (int)lists_.size())
+		return false;
+
+	cv::Mat probe_row;
+	probe.reshape(1, 1).convertTo(probe_row, CV_32FC1);
+
+	// rank the lists by the distance of their centroids to the probe
+	std::vector<std::pair<double, int> > centroid_distances(centroids_.rows);
+	for (int c = 0; c < centroids_.rows; c++)
+		centroid_distances[c] = std::make_pair(cv::norm(probe_row, centroids_.row(c), cv::NORM_L2SQR), c);
+	std::partial_sort(centroid_distances.begin(), centroid_distances.begin() + num_probes, centroid_distances.end());
+
+	for (int p = 0; p < num_probes; p++)
+	{
+		const std::vector<int>& list = lists_[centroid_distances[p].second];
+		candidates.insert(candidates.end(), list.begin(), list.end());
+	}
+
+	return candidates.size() > 0;
+}
+
+cv::Mat ipa_PeopleDetector::GalleryIndex::assignments() const
+{
+	cv::Mat assignments = cv::Mat::zeros(num_features_, 1, CV_32SC1);
+	for (int l = 0; l < (int)lists_.size(); l++)
+		for (int i = 0; i < (int)lists_[l].size(); i++)
+			assignments.at<int>(lists_[l][i]) = l;
+	return assignments;
+}
+
+bool ipa_PeopleDetector::GalleryIndex::assign(const cv::Mat& centroids, const cv::Mat& assignments, int num_features, int dim)
+{
+	clear();
+	if ((int)assignments.total() != num_features || (assignments.total() > 0 && assignments.type() != CV_32SC1))
+	{
+		std::cout << "GalleryIndex::assign() index does not match the model" << std::endl;
+		return false;
+	}
+
+	// an index of a model with a different feature dimension would compare probes and centroids of different sizes
+	if (centroids.rows == 0 || centroids.cols != dim || centroids.type() != CV_32FC1)
+	{
+		std::cout << "GalleryIndex::assign() centroids do not match the feature dimension of the model" << std::endl;
+		return false;
+	}
+
+	// the centroids are copied, so the index does not refer to a mapped model file
+	centroids_ = centroids.clone();
+	lists_.resize(centroids_.rows);
+	cv::Mat assignment_col = assignments.isContinuous() ? assignments : assignments.clone();
+	const int* assignment = (const int*)assignment_col.data;
+	for (int idx = 0; idx < num_features; idx++)
+	{
+		if (assignment[idx] < 0 || assignment[idx] >= (int)lists_.size())
+		{
+			clear();
+			return false;
+		}
+		lists_[assignment[idx]].push_back(idx);
+	}
+	num_features_ = num_features;
+
+	return true;
+}
+
+void ipa_PeopleDetector::GalleryIndex::write(ModelFileWriter& writer) const
+{
+	if (empty())
+		return;
+
+	// the list assignment of every feature is stored, the lists are rebuilt on reading
+	writer.addMat("gallery_index_centroids", centroids_);
+	writer.addMat("gallery_index_assignments", assignments());
+}
+
+bool ipa_PeopleDetector::GalleryIndex::read(const ModelFile& model_file, int num_features, int dim)
+{
+	clear();
+	cv::Mat centroids, assignments;
+	if (!model_file.getMat("gallery_index_centroids", centroids) || !model_file.getMat("gallery_index_assignments", assignments))
+		return false;
+	return assign(centroids, assignments, num_features, dim);
+}
+
+void ipa_PeopleDetector::GalleryIndex::save(cv::FileStorage& fs) const
+{
+	if (empty())
+		return;
+
+	fs << "gallery_index" << "{";
+	fs << "centroids" << centroids_;
+	fs << "assignments" << assignments();
+	fs << "}";
+}
+
+bool ipa_PeopleDetector::GalleryIndex::load(const cv::FileNode& node, int num_features, int dim)
+{
+	clear();
+	if (node.empty())
+		return false;
+
+	cv::Mat centroids, assignments;
+	node["centroids"] >> centroids;
+	node["assignments"] >> assignments;
+	return assign(centroids, assignments, num_features, dim);
+}
@@ -0,0 +1,97 @@
+#include<cob_people_detection/subspace_analysis.h>
+#include<opencv/cv.h>
+#include<iostream>
+#include<vector>
+#include<stdlib.h>
+
+// Compares the training time of the LDA variants with the Cholesky based symmetric solver and
+// with the previous solver (decomposition of S_intra^-1*S_inter) on synthetic data. The agreement
+// column is |cos| of the angle between the leading discriminant directions of both solvers.
+//
+// usage: face_rec_lda_benchmark [max dimension] [classes] [samples per class] [ss_dim]
+
+double leadingDirectionAgreement(const cv::Mat& a, const cv::Mat& b)
+{
+	cv::Mat a_row = a.row(0), b_row = b.row(0);
+	return fabs(a_row.dot(b_row)) / (cv::norm(a_row) * cv::norm(b_row));
+}
+
+int main(int argc, const char *argv[])
+{
+	int max_dim = 800;
+	int num_classes = 40;
+	int samples_per_class = 10;
+	int ss_dim = 10;
+	if (argc > 1)
+		max_dim = atoi(argv[1]);
+	if (argc > 2)
+		num_classes = std::max(2, atoi(argv[2]));
+	if (argc > 3)
+		samples_per_class = std::max(2, atoi(argv[3]));
+	if (argc > 4)
+		ss_dim = std::max(1, atoi(argv[4]));
+
+	cv::RNG rng(0);
+	std::vector<int> label_vec;
+	for (int i = 0; i < num_classes * samples_per_class; i++)
+		label_vec.push_back(i / samples_per_class);
+
+	// LDA on feature vectors, e.g. in PCA space for Fisherfaces (the within-class scatter has full rank
+	// only if there are more samples than dimensions, the solvers have to cope with both cases)
+	std::cout << "LDA: " << num_classes << " classes, " << samples_per_class << " samples per class, ss_dim " << ss_dim << std::endl;
+	std::cout << "dimension\tcholesky [s]\tinverse [s]\tagreement" << std::endl;
+	for (int dim = 50; dim <= max_dim; dim *= 2)
+	{
+		cv::Mat data = cv::Mat(label_vec.size(), dim, CV_64FC1);
+		cv::Mat class_center = cv::Mat(1, dim, CV_64FC1);
+		for (int i = 0; i < data.rows; i++)
+		{
+			if (i % samples_per_class == 0)
+				rng.fill(class_center, cv::RNG::UNIFORM, -10.0, 10.0);
+			cv::Mat data_row = data.row(i);
+			rng.fill(data_row, cv::RNG::NORMAL, 0.0, 5.0);
+			data_row += class_center;
+		}
+
+		int64 t_cholesky = cv::getTickCount();
+		SubspaceAnalysis::LDA lda_cholesky(data, label_vec, num_classes, ss_dim, SubspaceAnalysis::LDA_SOLVER_CHOLESKY);
+		double time_cholesky = (cv::getTickCount() - t_cholesky) / cv::getTickFrequency();
+
+		int64 t_inverse = cv::getTickCount();
+		SubspaceAnalysis::LDA lda_inverse(data, label_vec, num_classes, ss_dim, SubspaceAnalysis::LDA_SOLVER_INVERSE);
+		double time_inverse = (cv::getTickCount() - t_inverse) / cv::getTickFrequency();
+
+		std::cout << dim << "\t" << time_cholesky << "\t" << time_inverse << "\t" << leadingDirectionAgreement(lda_cholesky.eigenvecs, lda_inverse.eigenvecs)
+				<< std::endl;
+	}
+
+	// LDA2D on image matrices
+	std::cout << std::endl << "LDA2D: " << num_classes << " classes, " << samples_per_class << " samples per class, ss_dim " << ss_dim << std::endl;
+	std::cout << "image size\tcholesky [s]\tinverse [s]\tagreement" << std::endl;
+	for (int size = 25; size <= std::min(max_dim, 200); size *= 2)
+	{
+		std::vector<cv::Mat> img_vec;
+		cv::Mat class_center = cv::Mat(size, size, CV_64FC1);
+		for (int i = 0; i < (int)label_vec.size(); i++)
+		{
+			if (i % samples_per_class == 0)
+				rng.fill(class_center, cv::RNG::UNIFORM, 0.0, 255.0);
+			cv::Mat img = cv::Mat(size, size, CV_64FC1);
+			rng.fill(img, cv::RNG::NORMAL, 0.0, 20.0);
+			img_vec.push_back(img + class_center);
+		}
+
+		int64 t_cholesky = cv::getTickCount();
+		SubspaceAnalysis::LDA2D lda_cholesky(img_vec, label_vec, num_classes, ss_dim, SubspaceAnalysis::LDA_SOLVER_CHOLESKY);
+		double time_cholesky = (cv::getTickCount() - t_cholesky) / cv::getTickFrequency();
+
+		int64 t_inverse = cv::getTickCount();
+		SubspaceAnalysis::LDA2D lda_inverse(img_vec, label_vec, num_classes, ss_dim, SubspaceAnalysis::LDA_SOLVER_INVERSE);
+		double time_inverse = (cv::getTickCount() - t_inverse) / cv::getTickFrequency();
+
+		std::cout << size << "x" << size << "\t" << time_cholesky << "\t" << time_inverse << "\t"
+				<< leadingDirectionAgreement(lda_cholesky.eigenvecs, lda_inverse.eigenvecs) << std::endl;
+	}
+
+	return 0;
+}
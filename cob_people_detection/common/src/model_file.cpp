@@ -0,0 +1,257 @@
+#include<cob_people_detection/model_file.h>
+
+#include<fstream>
+#include<cstring>
+
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+const char ipa_PeopleDetector::ModelFile::magic[4] = { 'F', 'R', 'M', 'F' };
+
+ipa_PeopleDetector::ModelFile::ModelFile() :
+	data_(0), size_(0)
+{
+}
+
+ipa_PeopleDetector::ModelFile::~ModelFile()
+{
+	close();
+}
+
+void ipa_PeopleDetector::ModelFile::close()
+{
+	if (data_ != 0)
+		munmap(data_, size_);
+	data_ = 0;
+	size_ = 0;
+	sections_.clear();
+}
+
+bool ipa_PeopleDetector::ModelFile::open(const boost::filesystem::path& model_file)
+{
+	close();
+	path_ = model_file;
+
+	int fd = ::open(model_file.string().c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(Header))
+	{
+		::close(fd);
+		return false;
+	}
+
+	// private writable mapping: the model matrices can be used like ordinary matrices, modified pages are copied
+	size_ = file_stat.st_size;
+	void* mapping = mmap(0, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		std::cout << "ModelFile::open() can not map " << model_file.string() << std::endl;
+		size_ = 0;
+		return false;
+	}
+	data_ = (uchar*)mapping;
+
+	const Header* header = (const Header*)data_;
+	if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != version || header->byte_order != byte_order_tag || header->file_size != size_
+			|| sizeof(Header) + (uint64_t)header->num_sections * sizeof(Section) > size_)
+	{
+		std::cout << "ModelFile::open() " << model_file.string() << " is no model file of version " << version << " or is damaged" << std::endl;
+		close();
+		return false;
+	}
+
+	const Section* table = (const Section*)(data_ + sizeof(Header));
+	for (uint32_t s = 0; s < header->num_sections; s++)
+	{
+		const Section& section = table[s];
+		bool valid = (section.name[section_name_length - 1] == 0 && section.rows >= 0 && section.cols >= 0 && section.offset % section_alignment == 0
+				&& section.offset <= size_ && section.bytes <= size_ - section.offset);
+		if (valid == true)
+			valid = (section.bytes == (uint64_t)section.rows * section.cols * CV_ELEM_SIZE(section.type));
+		if (valid == false)
+		{
+			std::cout << "ModelFile::open() section " << s << " of " << model_file.string() << " is damaged" << std::endl;
+			close();
+			return false;
+		}
+		sections_.push_back(&section);
+	}
+
+	return true;
+}
+
+const ipa_PeopleDetector::ModelFile::Section* ipa_PeopleDetector::ModelFile::find(const std::string& name) const
+{
+	for (int s = 0; s < (int)sections_.size(); s++)
+	{
+		if (name.compare(sections_[s]->name) == 0)
+			return sections_[s];
+	}
+	return 0;
+}
+
+bool ipa_PeopleDetector::ModelFile::contains(const std::string& name) const
+{
+	return find(name) != 0;
+}
+
+bool ipa_PeopleDetector::ModelFile::getMat(const std::string& name, cv::Mat& mat) const
+{
+	const Section* section = find(name);
+	if (section == 0)
+		return false;
+
+	if (section->bytes == 0)
+		mat.release();
+	else
+		mat = cv::Mat(section->rows, section->cols, section->type, data_ + section->offset);
+	return true;
+}
+
+bool ipa_PeopleDetector::ModelFile::getInt(const std::string& name, int& value) const
+{
+	cv::Mat mat;
+	if (!getMat(name, mat) || mat.type() != CV_32SC1 || mat.total() != 1)
+		return false;
+	value = mat.at<int>(0);
+	return true;
+}
+
+bool ipa_PeopleDetector::ModelFile::getDouble(const std::string& name, double& value) const
+{
+	cv::Mat mat;
+	if (!getMat(name, mat) || mat.type() != CV_64FC1 || mat.total() != 1)
+		return false;
+	value = mat.at<double>(0);
+	return true;
+}
+
+bool ipa_PeopleDetector::ModelFile::getStrings(const std::string& name, std::vector<std::string>& strings) const
+{
+	cv::Mat mat;
+	if (!getMat(name, mat) || (mat.total() > 0 && mat.type() != CV_8UC1))
+		return false;
+
+	strings.clear();
+	const char* text = (const char*)mat.data;
+	size_t length = mat.total();
+	if (length > 0 && text[length - 1] != 0)
+		return false;
+	for (size_t start = 0; start < length;)
+	{
+		strings.push_back(std::string(text + start));
+		start += strings.back().size() + 1;
+	}
+	return true;
+}
+
+bool ipa_PeopleDetector::ModelFile::isModelFile(const boost::filesystem::path& model_file)
+{
+	std::ifstream file(model_file.string().c_str(), std::ios::in | std::ios::binary);
+	char file_magic[4];
+	file.read(file_magic, sizeof(file_magic));
+	return file.good() && std::memcmp(file_magic, magic, sizeof(magic)) == 0;
+}
+
+ipa_PeopleDetector::ModelFileWriter::ModelFileWriter(const boost::filesystem::path& model_file) :
+	path_(model_file)
+{
+}
+
+void ipa_PeopleDetector::ModelFileWriter::addMat(const std::string& name, const cv::Mat& mat)
+{
+	names_.push_back(name);
+	mats_.push_back(mat.isContinuous() ? mat : mat.clone());
+}
+
+void ipa_PeopleDetector::ModelFileWriter::addInt(const std::string& name, int value)
+{
+	addMat(name, cv::Mat(1, 1, CV_32SC1, cv::Scalar(value)));
+}
+
+void ipa_PeopleDetector::ModelFileWriter::addDouble(const std::string& name, double value)
+{
+	addMat(name, cv::Mat(1, 1, CV_64FC1, cv::Scalar(value)));
+}
+
+void ipa_PeopleDetector::ModelFileWriter::addStrings(const std::string& name, const std::vector<std::string>& strings)
+{
+	size_t length = 0;
+	for (int i = 0; i < (int)strings.size(); i++)
+		length += strings[i].size() + 1;
+
+	cv::Mat text = cv::Mat::zeros(1, (int)length, CV_8UC1);
+	size_t start = 0;
+	for (int i = 0; i < (int)strings.size(); i++)
+	{
+		std::memcpy(text.data + start, strings[i].c_str(), strings[i].size());
+		start += strings[i].size() + 1;
+	}
+	addMat(name, text);
+}
+
+bool ipa_PeopleDetector::ModelFileWriter::write()
+{
+	// section table
+	ModelFile::Header header;
+	std::memcpy(header.magic, ModelFile::magic, sizeof(header.magic));
+	header.version = ModelFile::version;
+	header.byte_order = ModelFile::byte_order_tag;
+	header.num_sections = names_.size();
+
+	std::vector<ModelFile::Section> table(names_.size());
+	uint64_t offset = sizeof(ModelFile::Header) + table.size() * sizeof(ModelFile::Section);
+	for (int s = 0; s < (int)table.size(); s++)
+	{
+		if ((int)names_[s].size() >= ModelFile::section_name_length)
+		{
+			std::cout << "ModelFileWriter::write() section name " << names_[s] << " is too long" << std::endl;
+			return false;
+		}
+		std::memset(&table[s], 0, sizeof(ModelFile::Section));
+		std::strncpy(table[s].name, names_[s].c_str(), ModelFile::section_name_length - 1);
+		table[s].rows = mats_[s].rows;
+		table[s].cols = mats_[s].cols;
+		table[s].type = mats_[s].type();
+		offset = (offset + ModelFile::section_alignment - 1) / ModelFile::section_alignment * ModelFile::section_alignment;
+		table[s].offset = offset;
+		table[s].bytes = mats_[s].total() * mats_[s].elemSize();
+		offset += table[s].bytes;
+	}
+	header.file_size = offset;
+
+	// write to a temporary file first so that a reader never sees a partially written model
+	boost::filesystem::path tmp_file = path_.string() + ".tmp";
+	std::ofstream file(tmp_file.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "ModelFileWriter::write() can not write " << tmp_file.string() << std::endl;
+		return false;
+	}
+	file.write((const char*)&header, sizeof(header));
+	if (table.size() > 0)
+		file.write((const char*)&table[0], table.size() * sizeof(ModelFile::Section));
+	uint64_t position = sizeof(ModelFile::Header) + table.size() * sizeof(ModelFile::Section);
+	const char padding[ModelFile::section_alignment] = { 0 };
+	for (int s = 0; s < (int)table.size(); s++)
+	{
+		file.write(padding, table[s].offset - position);
+		file.write((const char*)mats_[s].data, table[s].bytes);
+		position = table[s].offset + table[s].bytes;
+	}
+	file.close();
+	if (!file.good())
+	{
+		std::cout << "ModelFileWriter::write() writing " << tmp_file.string() << " failed" << std::endl;
+		boost::filesystem::remove(tmp_file);
+		return false;
+	}
+
+	boost::filesystem::rename(tmp_file, path_);
+	return true;
+}
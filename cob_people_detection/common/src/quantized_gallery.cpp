@@ -0,0 +1,199 @@
+#include<cob_people_detection/quantized_gallery.h>
+
+#include<algorithm>
+
+#ifdef __SSE2__
+#include<emmintrin.h>
+#endif
+
+ipa_PeopleDetector::QuantizedGallery::QuantizedGallery() :
+	dim_(0)
+{
+}
+
+void ipa_PeopleDetector::QuantizedGallery::clear()
+{
+	codes_.release();
+	offset_.release();
+	step_.release();
+	weights_.clear();
+	dim_ = 0;
+}
+
+void ipa_PeopleDetector::QuantizedGallery::build(const cv::Mat& features)
+{
+	clear();
+	if (features.rows == 0)
+		return;
+
+	cv::Mat data;
+	features.convertTo(data, CV_64FC1);
+	dim_ = data.cols;
+
+	// per-dimension range
+	cv::reduce(data, offset_, 0, CV_REDUCE_MIN, CV_64F);
+	cv::Mat max_arr;
+	cv::reduce(data, max_arr, 0, CV_REDUCE_MAX, CV_64F);
+	step_ = (max_arr - offset_) / 255.0;
+
+	int padded_dim = (dim_ + 7) / 8 * 8;
+	codes_ = cv::Mat::zeros(data.rows, padded_dim, CV_8UC1);
+	std::vector<uchar> codes;
+	for (int r = 0; r < data.rows; r++)
+	{
+		quantize(data.row(r), codes);
+		std::copy(codes.begin(), codes.end(), codes_.ptr<uchar>(r));
+	}
+	calcWeights();
+
+	std::cout << "QuantizedGallery::build() " << codes_.rows << " features with " << dim_ << " dimensions" << std::endl;
+}
+
+void ipa_PeopleDetector::QuantizedGallery::calcWeights()
+{
+	double max_sq_step = 0.0;
+	for (int d = 0; d < dim_; d++)
+		max_sq_step = std::max(max_sq_step, step_.at<double>(d) * step_.at<double>(d));
+
+	// 7 bit weights keep weight*difference (|difference|<=255) within 16 bit
+	weights_.assign(codes_.cols, 0);
+	for (int d = 0; d < dim_ && max_sq_step > 0.0; d++)
+		weights_[d] = (short)cvRound(128.0 * step_.at<double>(d) * step_.at<double>(d) / max_sq_step);
+}
+
+void ipa_PeopleDetector::QuantizedGallery::quantize(const cv::Mat& probe, std::vector<uchar>& codes) const
+{
+	cv::Mat probe_row;
+	probe.reshape(1, 1).convertTo(probe_row, CV_64FC1);
+	const double* p = probe_row.ptr<double>(0);
+	const double* offset = offset_.ptr<double>(0);
+	const double* step = step_.ptr<double>(0);
+
+	codes.assign(codes_.cols, 0);
+	for (int d = 0; d < dim_; d++)
+	{
+		if (step[d] > 0.0)
+			codes[d] = cv::saturate_cast<uchar>((p[d] - offset[d]) / step[d]);
+	}
+}
+
+int64 ipa_PeopleDetector::QuantizedGallery::weightedSqDistance(const uchar* a, const uchar* b, const short* weights, int n)
+{
+	int64 dist = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	int d = 0;
+	while (d < n)
+	{
+		// a lane accumulates at most 2*128*255^2 per block of 8 dimensions, flush before the 32 bit lanes overflow
+		__m128i acc = _mm_setzero_si128();
+		int block_end = std::min(n, d + 512);
+		for (; d < block_end; d += 8)
+		{
+			__m128i a16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(a + d)), zero);
+			__m128i b16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(b + d)), zero);
+			__m128i diff = _mm_sub_epi16(a16, b16);
+			__m128i weighted = _mm_mullo_epi16(diff, _mm_loadu_si128((const __m128i*)(weights + d)));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(diff, weighted));
+		}
+		int lanes[4];
+		_mm_storeu_si128((__m128i*)lanes, acc);
+		dist += (int64)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+#else
+	for (int d = 0; d < n; d++)
+	{
+		int diff = (int)a[d] - (int)b[d];
+		dist += (int64)weights[d] * diff * diff;
+	}
+#endif
+	return dist;
+}
+
+bool ipa_PeopleDetector::QuantizedGallery::search(const cv::Mat& probe, int num_candidates, const std::vector<int>* rows, std::vector<int>& candidates) const
+{
+	int num_rows = (rows != 0) ? rows->size() : codes_.rows;
+	if (empty() || num_candidates <= 0 || num_candidates >= num_rows || (int)probe.total() != dim_)
+		return false;
+
+	std::vector<uchar> probe_codes;
+	quantize(probe, probe_codes);
+
+	std::vector<std::pair<int64, int> > distances(num_rows);
+	for (int i = 0; i < num_rows; i++)
+	{
+		int r = (rows != 0) ? (*rows)[i] : i;
+		distances[i] = std::make_pair(weightedSqDistance(&probe_codes[0], codes_.ptr<uchar>(r), &weights_[0], codes_.cols), r);
+	}
+	std::partial_sort(distances.begin(), distances.begin() + num_candidates, distances.end());
+
+	candidates.resize(num_candidates);
+	for (int i = 0; i < num_candidates; i++)
+		candidates[i] = distances[i].second;
+
+	return true;
+}
+
+bool ipa_PeopleDetector::QuantizedGallery::assign(const cv::Mat& codes, const cv::Mat& offset, const cv::Mat& step, int num_features, int dim)
+{
+	clear();
+	if (codes.rows != num_features || codes.type() != CV_8UC1 || codes.cols % 8 != 0 || codes.cols < dim || (int)offset.total() != dim
+			|| offset.type() != CV_64FC1 || (int)step.total() != dim || step.type() != CV_64FC1)
+	{
+		std::cout << "QuantizedGallery::assign() gallery does not match the model" << std::endl;
+		return false;
+	}
+
+	// the data is copied, so the gallery does not refer to a mapped model file
+	codes_ = codes.clone();
+	offset_ = offset.reshape(1, 1).clone();
+	step_ = step.reshape(1, 1).clone();
+	dim_ = dim;
+	calcWeights();
+
+	return true;
+}
+
+void ipa_PeopleDetector::QuantizedGallery::write(ModelFileWriter& writer) const
+{
+	if (empty())
+		return;
+
+	writer.addMat("quantized_codes", codes_);
+	writer.addMat("quantized_offset", offset_);
+	writer.addMat("quantized_step", step_);
+}
+
+bool ipa_PeopleDetector::QuantizedGallery::read(const ModelFile& model_file, int num_features, int dim)
+{
+	clear();
+	cv::Mat codes, offset, step;
+	if (!model_file.getMat("quantized_codes", codes) || !model_file.getMat("quantized_offset", offset) || !model_file.getMat("quantized_step", step))
+		return false;
+	return assign(codes, offset, step, num_features, dim);
+}
+
+void ipa_PeopleDetector::QuantizedGallery::save(cv::FileStorage& fs) const
+{
+	if (empty())
+		return;
+
+	fs << "quantized_gallery" << "{";
+	fs << "offset" << offset_;
+	fs << "step" << step_;
+	fs << "codes" << codes_;
+	fs << "}";
+}
+
+bool ipa_PeopleDetector::QuantizedGallery::load(const cv::FileNode& node, int num_features, int dim)
+{
+	clear();
+	if (node.empty())
+		return false;
+
+	cv::Mat codes, offset, step;
+	node["offset"] >> offset;
+	node["step"] >> step;
+	node["codes"] >> codes;
+	return assign(codes, offset, step, num_features, dim);
+}
@@ -1,6 +1,230 @@
 #include<cob_people_detection/subspace_analysis.h>
 #include<thirdparty/decomposition.hpp>
 
+namespace
+{
+/// Cholesky factorization A = L*L^T of a symmetric matrix (CV_64FC1), fails if A is not numerically positive definite.
+bool choleskyFactor(const cv::Mat& A, cv::Mat& L)
+{
+	int n = A.rows;
+	L = cv::Mat::zeros(n, n, CV_64FC1);
+	for (int j = 0; j < n; j++)
+	{
+		double* Lj = L.ptr<double>(j);
+		double d = A.at<double>(j, j);
+		for (int k = 0; k < j; k++)
+			d -= Lj[k] * Lj[k];
+		if (!(d > 1e-14 * A.at<double>(j, j)))
+			return false;
+		Lj[j] = sqrt(d);
+		for (int i = j + 1; i < n; i++)
+		{
+			double* Li = L.ptr<double>(i);
+			double s = A.at<double>(i, j);
+			for (int k = 0; k < j; k++)
+				s -= Li[k] * Lj[k];
+			Li[j] = s / Lj[j];
+		}
+	}
+	return true;
+}
+
+/// B := L^-1*B for lower triangular L (forward substitution on the rows of B).
+void solveLower(const cv::Mat& L, cv::Mat& B)
+{
+	for (int i = 0; i < L.rows; i++)
+	{
+		const double* Li = L.ptr<double>(i);
+		double* Bi = B.ptr<double>(i);
+		for (int k = 0; k < i; k++)
+		{
+			if (Li[k] == 0.0)
+				continue;
+			const double* Bk = B.ptr<double>(k);
+			for (int c = 0; c < B.cols; c++)
+				Bi[c] -= Li[k] * Bk[c];
+		}
+		double inv = 1.0 / Li[i];
+		for (int c = 0; c < B.cols; c++)
+			Bi[c] *= inv;
+	}
+}
+
+/// B := L^-T*B for lower triangular L (back substitution, L is traversed by rows).
+void solveLowerTransposed(const cv::Mat& L, cv::Mat& B)
+{
+	for (int k = L.rows - 1; k >= 0; k--)
+	{
+		const double* Lk = L.ptr<double>(k);
+		double* Bk = B.ptr<double>(k);
+		double inv = 1.0 / Lk[k];
+		for (int c = 0; c < B.cols; c++)
+			Bk[c] *= inv;
+		for (int i = 0; i < k; i++)
+		{
+			if (Lk[i] == 0.0)
+				continue;
+			double* Bi = B.ptr<double>(i);
+			for (int c = 0; c < B.cols; c++)
+				Bi[c] -= Lk[i] * Bk[c];
+		}
+	}
+}
+
+/// Orthonormalizes the rows of Q by modified Gram-Schmidt with reorthogonalization,
+/// rows that vanish (rank deficiency) are replaced by random directions.
+void orthonormalizeRows(cv::Mat& Q, cv::RNG& rng)
+{
+	for (int i = 0; i < Q.rows; i++)
+	{
+		cv::Mat q = Q.row(i);
+		for (int attempt = 0; attempt < 3; attempt++)
+		{
+			for (int pass = 0; pass < 2; pass++)
+			{
+				for (int j = 0; j < i; j++)
+				{
+					cv::Mat q_j = Q.row(j);
+					q -= q.dot(q_j) * q_j;
+				}
+			}
+			double norm = cv::norm(q);
+			if (norm > 1e-12)
+			{
+				q /= norm;
+				break;
+			}
+			rng.fill(q, cv::RNG::NORMAL, 0.0, 1.0);
+		}
+	}
+}
+
+/// Leading eigenvalues and eigenvectors of a symmetric positive semi-definite matrix.
+/// Small problems are decomposed completely, otherwise a block of num_vecs+oversampling vectors
+/// is refined by subspace iteration with Rayleigh-Ritz projection until the residuals of the
+/// leading num_vecs Ritz pairs are negligible.
+/// @param[in] M Symmetric matrix (CV_64FC1)
+/// @param[in] num_vecs Number of eigenpairs
+/// @param[out] eigenvals Eigenvalues in descending order (num_vecs x 1)
+/// @param[out] eigenvecs Eigenvectors as rows (num_vecs x M.cols)
+void symmetricLeadingEigen(const cv::Mat& M, int num_vecs, cv::Mat& eigenvals, cv::Mat& eigenvecs)
+{
+	const int oversampling = 8;
+	const int max_iterations = 1000;
+	const double tolerance = 1e-10;
+
+	int n = M.rows;
+	int block_size = std::min(n, num_vecs + oversampling);
+	if (4 * block_size >= n)
+	{
+		cv::eigen(M, eigenvals, eigenvecs);
+		eigenvals = eigenvals.rowRange(0, num_vecs).clone();
+		eigenvecs = eigenvecs.rowRange(0, num_vecs).clone();
+		return;
+	}
+
+	cv::RNG rng(0x5eed);
+	cv::Mat Q = cv::Mat(block_size, n, CV_64FC1);
+	rng.fill(Q, cv::RNG::NORMAL, 0.0, 1.0);
+	orthonormalizeRows(Q, rng);
+
+	cv::Mat ritz_vals, ritz_vecs;
+	for (int it = 0; it < max_iterations; it++)
+	{
+		// Rayleigh-Ritz projection onto the row space of Q (M is symmetric, so Q*M = (M*Q^T)^T)
+		cv::Mat MQ, H;
+		cv::gemm(Q, M, 1.0, cv::Mat(), 0.0, MQ);
+		cv::gemm(MQ, Q, 1.0, cv::Mat(), 0.0, H, cv::GEMM_2_T);
+		H = 0.5 * (H + H.t());
+		cv::Mat W;
+		cv::eigen(H, ritz_vals, W);
+		ritz_vecs = W * Q;
+		cv::Mat M_ritz_vecs = W * MQ;
+
+		double max_residual = 0.0;
+		for (int i = 0; i < num_vecs; i++)
+			max_residual = std::max(max_residual, cv::norm(M_ritz_vecs.row(i) - ritz_vals.at<double>(i) * ritz_vecs.row(i)));
+		if (max_residual <= tolerance * std::max(fabs(ritz_vals.at<double>(0)), std::numeric_limits<double>::min()))
+			break;
+
+		Q = M_ritz_vecs;
+		orthonormalizeRows(Q, rng);
+	}
+
+	eigenvals = ritz_vals.rowRange(0, num_vecs).clone();
+	eigenvecs = ritz_vecs.rowRange(0, num_vecs).clone();
+}
+
+/// Computes the partial scatter matrices X_b^T*X_b of a range of row blocks.
+class ScatterBlockBody: public cv::ParallelLoopBody
+{
+public:
+	ScatterBlockBody(const cv::Mat& data, int block_rows, std::vector<cv::Mat>& partial) :
+		data_(data), block_rows_(block_rows), partial_(partial)
+	{
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		for (int b = range.start; b < range.end; b++)
+		{
+			int r_end = std::min((b + 1) * block_rows_, data_.rows);
+			cv::mulTransposed(data_.rowRange(b * block_rows_, r_end), partial_[b], true);
+		}
+	}
+
+protected:
+	const cv::Mat& data_;
+	int block_rows_;
+	std::vector<cv::Mat>& partial_;
+};
+
+/// One level of the tree merge of the partial scatter matrices: partial[2*i*stride] += partial[(2*i+1)*stride].
+class ScatterMergeBody: public cv::ParallelLoopBody
+{
+public:
+	ScatterMergeBody(std::vector<cv::Mat>& partial, int stride) :
+		partial_(partial), stride_(stride)
+	{
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		for (int i = range.start; i < range.end; i++)
+		{
+			int dst = 2 * i * stride_;
+			if (dst + stride_ < (int)partial_.size())
+				partial_[dst] += partial_[dst + stride_];
+		}
+	}
+
+protected:
+	std::vector<cv::Mat>& partial_;
+	int stride_;
+};
+
+/// Scatter matrix X^T*X of the rows of X, accumulated block-wise on all threads and merged as a tree.
+void parallelScatter(const cv::Mat& data, cv::Mat& scatter)
+{
+	const int min_block_rows = 64;
+
+	int num_blocks = std::max(1, std::min(cv::getNumThreads(), data.rows / min_block_rows));
+	if (num_blocks == 1)
+	{
+		cv::mulTransposed(data, scatter, true);
+		return;
+	}
+
+	int block_rows = (data.rows + num_blocks - 1) / num_blocks;
+	num_blocks = (data.rows + block_rows - 1) / block_rows;
+	std::vector<cv::Mat> partial(num_blocks);
+	cv::parallel_for_(cv::Range(0, num_blocks), ScatterBlockBody(data, block_rows, partial));
+	for (int stride = 1; stride < num_blocks; stride *= 2)
+		cv::parallel_for_(cv::Range(0, (num_blocks + 2 * stride - 1) / (2 * stride)), ScatterMergeBody(partial, stride));
+	scatter = partial[0];
+}
+}
+
 //---------------------------------------------------------------------------------------------------------------------<
 //---------------------------------------------------------------------------------------------------------------------<
 //---------------------------------------------------------------------------------------------------------------------<
@@ -284,6 +508,102 @@ void SubspaceAnalysis::SSA::decomposeSymmetricMatrix(cv::Mat& data_mat)
 
 }
 
+void SubspaceAnalysis::SSA::decomposeTruncated(cv::Mat& data_mat, int num_vecs)
+{
+	const int oversampling = 10;
+	const int power_iterations = 2;
+
+	int n = data_mat.rows;
+	num_vecs = std::max(1, std::min(num_vecs, std::min(n, data_mat.cols)));
+	int block_size = std::min(num_vecs + oversampling, std::min(n, data_mat.cols));
+
+	// the Gram matrix costs n*n*d, the randomized SVD about (2*power_iterations+2)*n*d*block_size
+	if (n <= (2 * power_iterations + 2) * block_size)
+	{
+		// X*X^T*u = lambda*u  ->  X^T*u/sqrt(lambda) is a unit eigenvector of X^T*X
+		cv::Mat gram, u;
+		cv::mulTransposed(data_mat, gram, false);
+		symmetricLeadingEigen(gram, num_vecs, eigenvals, u);
+		cv::gemm(u, data_mat, 1.0, cv::Mat(), 0.0, eigenvecs);
+	}
+	else
+	{
+		// range finder: orthonormal basis of X*Omega, sharpened by power iterations (basis stored as rows)
+		cv::RNG rng(0x5eed);
+		cv::Mat omega = cv::Mat(block_size, data_mat.cols, CV_64FC1);
+		rng.fill(omega, cv::RNG::NORMAL, 0.0, 1.0);
+		cv::Mat basis, projection;
+		cv::gemm(omega, data_mat, 1.0, cv::Mat(), 0.0, basis, cv::GEMM_2_T);
+		orthonormalizeRows(basis, rng);
+		for (int it = 0; it < power_iterations; it++)
+		{
+			cv::gemm(basis, data_mat, 1.0, cv::Mat(), 0.0, projection);
+			cv::gemm(projection, data_mat, 1.0, cv::Mat(), 0.0, basis, cv::GEMM_2_T);
+			orthonormalizeRows(basis, rng);
+		}
+
+		// SVD of the small matrix B = Q^T*X through the eigendecomposition of B*B^T
+		cv::gemm(basis, data_mat, 1.0, cv::Mat(), 0.0, projection);
+		cv::Mat small_gram, w;
+		cv::mulTransposed(projection, small_gram, false);
+		cv::eigen(small_gram, eigenvals, w);
+		eigenvals = eigenvals.rowRange(0, num_vecs).clone();
+		cv::gemm(w.rowRange(0, num_vecs), projection, 1.0, cv::Mat(), 0.0, eigenvecs);
+	}
+
+	// unit length right singular vectors, eigenvalues of the covariance matrix (scaled by 1/n like cv::PCA)
+	for (int i = 0; i < eigenvecs.rows; i++)
+	{
+		cv::Mat vec = eigenvecs.row(i);
+		vec /= std::max(cv::norm(vec), std::numeric_limits<double>::min());
+	}
+	eigenvals /= (double)n;
+}
+
+void SubspaceAnalysis::SSA::decomposeGeneralizedSymmetricMatrix(cv::Mat& S_inter, cv::Mat& S_intra, int num_vecs)
+{
+	int n = S_intra.rows;
+	num_vecs = std::max(1, std::min(num_vecs, n));
+
+	// S_intra = L*L^T, a growing ridge makes a singular within-class scatter positive definite
+	cv::Mat S_w, S_b, L;
+	S_intra.convertTo(S_w, CV_64FC1);
+	S_inter.convertTo(S_b, CV_64FC1);
+	double ridge = 1e-12 * std::max(cv::trace(S_w)[0] / n, std::numeric_limits<double>::min());
+	int attempts = 0;
+	while (choleskyFactor(S_w, L) == false)
+	{
+		if (++attempts > 20)
+		{
+			std::cout << "SSA::decomposeGeneralizedSymmetricMatrix(): within-class scatter is not positive definite" << std::endl;
+			L = cv::Mat::eye(n, n, CV_64FC1);
+			break;
+		}
+		S_w += ridge * cv::Mat::eye(n, n, CV_64FC1);
+		ridge *= 10.0;
+	}
+
+	// whitened problem L^-1*S_inter*L^-T*y = lambda*y
+	cv::Mat M = S_b.clone();
+	solveLower(L, M);
+	M = M.t();
+	solveLower(L, M);
+	M = 0.5 * (M + M.t());
+
+	cv::Mat y;
+	symmetricLeadingEigen(M, num_vecs, eigenvals, y);
+
+	// v = L^-T*y, scaled to unit length
+	cv::Mat v = y.t();
+	solveLowerTransposed(L, v);
+	eigenvecs = v.t();
+	for (int i = 0; i < eigenvecs.rows; i++)
+	{
+		cv::Mat vec = eigenvecs.row(i);
+		vec /= std::max(cv::norm(vec), std::numeric_limits<double>::min());
+	}
+}
+
 //---------------------------------------------------------------------------------
 // LDA
 //---------------------mean_arr_row--------------------------------------------
@@ -302,24 +622,24 @@ SubspaceAnalysis::PCA2D::PCA2D(std::vector<cv::Mat>& input_data, std::vector<int
 	// is this a valid matrix op TODO
 	mean /= input_data.size();
 
-	// TODO TEMPORARY PCA
-	cv::Mat P = cv::Mat::zeros(input_data[0].cols, input_data[0].cols, CV_64FC1);
-
+	// sum of (A_i-mean)^T*(A_i-mean) = X^T*X for the vertically stacked centered images X
+	int rows = input_data[0].rows;
+	cv::Mat centered = cv::Mat(input_data.size() * rows, input_data[0].cols, CV_64FC1);
 	for (int i = 0; i < input_data.size(); i++)
 	{
-		cv::Mat temp;
-		cv::subtract(input_data[i], mean, temp);
-		cv::mulTransposed(temp, temp, true);
-		cv::add(temp, P, P);
+		cv::Mat dst_block = centered.rowRange(i * rows, (i + 1) * rows);
+		cv::subtract(input_data[i], mean, dst_block);
 	}
 
+	cv::Mat P;
+	parallelScatter(centered, P);
 	P /= input_data.size();
 	decomposeSymmetricMatrix(P);
 	eigenvecs = eigenvecs(cv::Rect(0, 0, input_data[0].cols, ss_dim));
 	eigenvals = eigenvals(cv::Rect(0, 0, 1, ss_dim)).t();
 
 }
-SubspaceAnalysis::LDA2D::LDA2D(std::vector<cv::Mat>& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim)
+SubspaceAnalysis::LDA2D::LDA2D(std::vector<cv::Mat>& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim, LDASolver solver)
 {
 	SubspaceAnalysis::unique_elements(input_labels, num_classes_, unique_labels_);
 	mean = cv::Mat::zeros(input_data[0].rows, input_data[0].cols, CV_64FC1);
@@ -370,50 +690,49 @@ SubspaceAnalysis::LDA2D::LDA2D(std::vector<cv::Mat>& input_data, std::vector<int
 		class_means[i] /= class_sizes[i];
 	}
 
-	cv::Mat S_intra = cv::Mat::zeros(input_data[0].cols, input_data[0].cols, CV_64FC1);
-	cv::Mat S_inter = cv::Mat::zeros(input_data[0].cols, input_data[0].cols, CV_64FC1);
-	int class_index;
-
+	// scatter matrices as X^T*X of vertically stacked difference matrices
+	int rows = input_data[0].rows;
+	cv::Mat intra_diffs = cv::Mat(input_data.size() * rows, input_data[0].cols, CV_64FC1);
 	for (int i = 0; i < input_data.size(); ++i)
 	{
 		//reduce data matrix
-		class_index = input_labels[i];
-		cv::Mat tmp;
-
-		cv::subtract(input_data[i], class_means[class_index], tmp);
-		cv::Mat temp;
-		cv::mulTransposed(input_data[i], temp, true);
-		cv::add(temp, S_intra, S_intra);
+		cv::Mat dst_block = intra_diffs.rowRange(i * rows, (i + 1) * rows);
+		cv::subtract(input_data[i], class_means[input_labels[i]], dst_block);
 	}
+	cv::Mat inter_diffs = cv::Mat(num_classes_ * rows, input_data[0].cols, CV_64FC1);
 	for (int c = 0; c < num_classes_; c++)
 	{
-		cv::Mat temp;
-		class_index = unique_labels_[c];
-		cv::subtract(class_means[c], mean_mat, temp);
-		cv::mulTransposed(temp, temp, true);
-		temp = temp * class_sizes[c];
-		cv::add(S_inter, temp, S_inter);
+		cv::Mat dst_block = inter_diffs.rowRange(c * rows, (c + 1) * rows);
+		cv::subtract(class_means[c], mean_mat, dst_block);
+		dst_block *= sqrt((double)class_sizes[c]);
 	}
 
-	for (int i = 0; i < input_data.size(); i++)
-	{
-	}
 	// //Intra class scatter
+	cv::Mat S_intra, S_inter;
+	parallelScatter(intra_diffs, S_intra);
+	parallelScatter(inter_diffs, S_inter);
 
-	cv::Mat S_intra_inv = S_intra.inv();
+	if (solver == LDA_SOLVER_CHOLESKY)
+		decomposeGeneralizedSymmetricMatrix(S_inter, S_intra, ss_dim);
+	else
+	{
+		cv::Mat S_intra_inv = S_intra.inv();
 
-	cv::Mat P;
-	gemm(S_intra_inv, S_inter, 1.0, cv::Mat(), 0.0, P);
+		cv::Mat P;
+		gemm(S_intra_inv, S_inter, 1.0, cv::Mat(), 0.0, P);
 
-	decomposeSymmetricMatrix(P);
+		decomposeSymmetricMatrix(P);
+	}
 
 	eigenvecs = eigenvecs(cv::Rect(0, 0, input_data[0].cols, ss_dim));
 	eigenvals = eigenvals(cv::Rect(0, 0, 1, ss_dim)).t();
 	//cv::normalize(eigenvecs,eigenvecs);
 
 }
-SubspaceAnalysis::LDA::LDA(cv::Mat& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim)
+SubspaceAnalysis::LDA::LDA(cv::Mat& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim, LDASolver solver) :
+	solver_(solver)
 {
+	ss_dim_ = ss_dim;
 
 	SubspaceAnalysis::unique_elements(input_labels, num_classes_, unique_labels_);
 	cv::Mat data_work = input_data.clone();
@@ -447,18 +766,17 @@ void SubspaceAnalysis::LDA::calcClassMean(cv::Mat& data_mat, cv::Mat& label_mat,
 void SubspaceAnalysis::LDA::calcClassMean(cv::Mat& data_mat, std::vector<int>& label_vec, cv::Mat& class_mean_arr, int& num_classes)
 {
 
+	// class sums in one GEMM with the class indicator matrix
 	std::vector<int> samples_per_class(num_classes, 0);
-
-	int class_index;
+	cv::Mat indicator = cv::Mat::zeros(num_classes, data_mat.rows, CV_64FC1);
 	for (int i = 0; i < data_mat.rows; i++)
 	{
-		cv::Mat data_row = data_mat.row(i);
-		class_index = label_vec[i];
-		cv::Mat mean_row = class_mean_arr.row(class_index);
-
-		add(mean_row, data_row, mean_row);
-		samples_per_class[class_index]++;
+		indicator.at<double>(label_vec[i], i) = 1.0;
+		samples_per_class[label_vec[i]]++;
 	}
+	cv::Mat class_sums;
+	cv::gemm(indicator, data_mat, 1.0, cv::Mat(), 0.0, class_sums);
+	class_mean_arr += class_sums;
 
 	for (int i = 0; i < num_classes; i++)
 	{
@@ -471,8 +789,7 @@ void SubspaceAnalysis::LDA::calcClassMean(cv::Mat& data_mat, std::vector<int>& l
 void SubspaceAnalysis::LDA::calcProjMatrix(cv::Mat& data_arr, std::vector<int>& label_vec)
 {
 
-	cv::Mat S_intra = cv::Mat::zeros(data_arr.cols, data_arr.cols, CV_64FC1);
-	cv::Mat S_inter = cv::Mat::zeros(data_arr.cols, data_arr.cols, CV_64FC1);
+	cv::Mat S_intra, S_inter;
 	int class_index;
 
 	for (int i = 0; i < data_arr.rows; ++i)
@@ -483,18 +800,23 @@ void SubspaceAnalysis::LDA::calcProjMatrix(cv::Mat& data_arr, std::vector<int>&
 		cv::Mat class_mean_row = class_mean_arr.row(class_index);
 		cv::subtract(data_row, class_mean_row, data_row);
 	}
+	// Inter class scatter from the centered class means
+	cv::Mat mean_diffs = cv::Mat(num_classes_, data_arr.cols, CV_64FC1);
 	for (int c = 0; c < num_classes_; c++)
 	{
-		cv::Mat temp;
 		class_index = unique_labels_[c];
-		cv::Mat class_mean_row = class_mean_arr.row(class_index);
-		cv::subtract(class_mean_row, mean, temp);
-		cv::mulTransposed(temp, temp, true);
-		cv::add(S_inter, temp, S_inter);
-
+		cv::Mat dst_row = mean_diffs.row(c);
+		cv::subtract(class_mean_arr.row(class_index), mean, dst_row);
 	}
+	parallelScatter(mean_diffs, S_inter);
 	// //Intra class scatter
-	cv::mulTransposed(data_arr, S_intra, true);
+	parallelScatter(data_arr, S_intra);
+
+	if (solver_ == LDA_SOLVER_CHOLESKY)
+	{
+		decomposeGeneralizedSymmetricMatrix(S_inter, S_intra, ss_dim_);
+		return;
+	}
 
 	cv::Mat S_intra_inv = S_intra.inv();
 
@@ -511,8 +833,10 @@ void SubspaceAnalysis::LDA::calcProjMatrix(cv::Mat& data_arr, std::vector<int>&
 // ILDA
 //---------------------------------------------------------------------------------
 //
-SubspaceAnalysis::ILDA::ILDA(cv::Mat& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim)
+SubspaceAnalysis::ILDA::ILDA(cv::Mat& input_data, std::vector<int>& input_labels, int& num_classes, int& ss_dim, LDASolver solver)
 {
+	solver_ = solver;
+	ss_dim_ = ss_dim;
 	SubspaceAnalysis::unique_elements(input_labels, num_classes_, unique_labels_);
 	cv::Mat data_work = input_data.clone();
 	mean = cv::Mat::zeros(1, data_work.cols, CV_64FC1);
@@ -534,8 +858,7 @@ SubspaceAnalysis::ILDA::ILDA(cv::Mat& input_data, std::vector<int>& input_labels
 void SubspaceAnalysis::ILDA::calcProjMatrix(cv::Mat& data_arr, std::vector<int>& label_vec)
 {
 
-	cv::Mat S_intra = cv::Mat::zeros(data_arr.cols, data_arr.cols, CV_64FC1);
-	cv::Mat S_inter = cv::Mat::zeros(data_arr.cols, data_arr.cols, CV_64FC1);
+	cv::Mat S_intra, S_inter;
 	int class_index;
 
 	for (int i = 0; i < data_arr.rows; ++i)
@@ -546,18 +869,26 @@ void SubspaceAnalysis::ILDA::calcProjMatrix(cv::Mat& data_arr, std::vector<int>&
 		cv::Mat class_mean_row = class_mean_arr.row(class_index);
 		cv::subtract(data_row, class_mean_row, data_row);
 	}
+	// Inter class scatter from the centered class means
+	cv::Mat mean_diffs = cv::Mat(num_classes_, data_arr.cols, CV_64FC1);
 	for (int c = 0; c < num_classes_; c++)
 	{
-		cv::Mat temp;
 		class_index = unique_labels_[c];
-		cv::Mat class_mean_row = class_mean_arr.row(class_index);
-		cv::subtract(class_mean_row, mean, temp);
-		cv::mulTransposed(temp, temp, true);
-		cv::add(S_inter, temp, S_inter);
-
+		cv::Mat dst_row = mean_diffs.row(c);
+		cv::subtract(class_mean_arr.row(class_index), mean, dst_row);
 	}
+	parallelScatter(mean_diffs, S_inter);
 	// //Intra class scatter
-	cv::mulTransposed(data_arr, S_intra, true);
+	parallelScatter(data_arr, S_intra);
+
+	// the class weights below scale the same rows of S_intra and S_inter, they cancel in S_intra^-1*S_inter,
+	// so the symmetric problem of the unweighted scatter matrices has the same solution
+	if (solver_ == LDA_SOLVER_CHOLESKY)
+	{
+		decomposeGeneralizedSymmetricMatrix(S_inter, S_intra, ss_dim_);
+		return;
+	}
+
 	cv::Mat S_intra_inv = S_intra.inv();
 	cv::Mat sigma = cv::Mat(1, num_classes_, CV_64FC1);
 
@@ -606,16 +937,12 @@ SubspaceAnalysis::PCA::PCA(cv::Mat& input_data, int& ss_dim)
 {
 
 	ss_dim_ = ss_dim;
-	PCA_OpenCv(input_data, ss_dim);
-	return;
-	cv::Mat data_work = input_data.clone();
-	mean = cv::Mat::zeros(1, data_work.cols, CV_64FC1);
-	calcDataMatMean(data_work, mean);
+	cv::Mat data_work;
+	input_data.convertTo(data_work, CV_64FC1);
+	cv::reduce(data_work, mean, 0, CV_REDUCE_AVG, CV_64F);
+	// only the leading ss_dim components are computed
 	calcProjMatrix(data_work);
-	//truncate eigenvectors and eigenvals
-	eigenvecs = eigenvecs(cv::Rect(0, 0, input_data.cols, ss_dim));
-	eigenvals = eigenvals(cv::Rect(0, 0, 1, ss_dim)).t();
-	//cv::normalize(eigenvecs,eigenvecs);
+	eigenvals = eigenvals.t();
 
 	//cv::Mat dummy;
 	//eigenvecs.copyTo(dummy);
@@ -642,6 +969,109 @@ void SubspaceAnalysis::PCA::PCA_OpenCv(cv::Mat& input_data, int& ss_dim)
 
 }
 
+//---------------------------------------------------------------------------------
+// IPCA
+//---------------------------------------------------------------------------------
+//
+SubspaceAnalysis::IPCA::IPCA(cv::Mat& eigenvectors, cv::Mat& eigenvalues, cv::Mat& mean_arr, int num_samples)
+{
+	eigenvectors.convertTo(eigenvecs, CV_64FC1);
+	eigenvalues.reshape(1, 1).convertTo(eigenvals, CV_64FC1);
+	mean_arr.reshape(1, 1).convertTo(mean, CV_64FC1);
+	num_samples_ = num_samples;
+	ss_dim_ = eigenvecs.rows;
+}
+
+void SubspaceAnalysis::IPCA::update(cv::Mat& new_data, int max_dim)
+{
+	int n = num_samples_;
+	int m = new_data.rows;
+	int k = eigenvecs.rows;
+	double total = (double)(n + m);
+
+	cv::Mat data;
+	new_data.convertTo(data, CV_64FC1);
+	cv::Mat new_mean;
+	cv::reduce(data, new_mean, 0, CV_REDUCE_AVG, CV_64F);
+
+	// candidate directions: centered new samples and the shift of the mean
+	cv::Mat centered = cv::Mat(m, data.cols, CV_64FC1);
+	for (int i = 0; i < m; i++)
+	{
+		cv::Mat dst_row = centered.row(i);
+		cv::subtract(data.row(i), new_mean, dst_row);
+	}
+	cv::Mat mean_diff = mean - new_mean;
+	cv::Mat residuals = centered.clone();
+	residuals.push_back(mean_diff);
+
+	// remove the components inside the current eigenspace
+	cv::Mat coeffs;
+	cv::gemm(residuals, eigenvecs, 1.0, cv::Mat(), 0.0, coeffs, cv::GEMM_2_T);
+	cv::gemm(coeffs, eigenvecs, -1.0, residuals, 1.0, residuals);
+
+	// orthonormalize the remaining directions (Gram-Schmidt), negligible ones are dropped
+	cv::Mat basis = eigenvecs.clone();
+	for (int i = 0; i < residuals.rows; i++)
+	{
+		cv::Mat r = residuals.row(i);
+		double initial_norm = cv::norm(r);
+		for (int b = k; b < basis.rows; b++)
+		{
+			cv::Mat q = basis.row(b);
+			r -= r.dot(q) * q;
+		}
+		double norm = cv::norm(r);
+		if (norm > 1e-6 * initial_norm && norm > 1e-10)
+			basis.push_back(cv::Mat(r / norm));
+	}
+
+	// covariance of all samples expressed in the extended basis
+	cv::Mat Y, z;
+	cv::gemm(centered, basis, 1.0, cv::Mat(), 0.0, Y, cv::GEMM_2_T);
+	cv::gemm(mean_diff, basis, 1.0, cv::Mat(), 0.0, z, cv::GEMM_2_T);
+	cv::Mat C = cv::Mat::zeros(basis.rows, basis.rows, CV_64FC1);
+	for (int i = 0; i < k; i++)
+		C.at<double>(i, i) = eigenvals.at<double>(i) * n / total;
+	cv::Mat temp;
+	cv::mulTransposed(Y, temp, true);
+	C += temp / total;
+	cv::mulTransposed(z, temp, true);
+	C += temp * (n * m / (total * total));
+
+	cv::Mat vals, vecs;
+	cv::eigen(C, vals, vecs);
+	int dim = basis.rows;
+	if (max_dim > 0)
+		dim = std::min(dim, max_dim);
+	rotation = vecs.rowRange(0, dim).clone();
+
+	// store the mean coordinates for the mapping of existing features
+	cv::gemm(mean, eigenvecs, 1.0, cv::Mat(), 0.0, prev_mean_coeffs, cv::GEMM_2_T);
+
+	cv::gemm(rotation, basis, 1.0, cv::Mat(), 0.0, eigenvecs);
+	eigenvals = vals.rowRange(0, dim).t();
+	cv::gemm(mean, eigenvecs, 1.0, cv::Mat(), 0.0, mean_coeffs, cv::GEMM_2_T);
+	mean = (mean * n + new_mean * m) / total;
+	num_samples_ = n + m;
+	ss_dim_ = dim;
+}
+
+void SubspaceAnalysis::IPCA::updateFeatures(cv::Mat& features)
+{
+	// x*U'^T = mean*U'^T + (x-mean)*U^T*R^T, the old samples have no component in the new directions
+	int k = prev_mean_coeffs.cols;
+	cv::Mat centered;
+	features.convertTo(centered, CV_64FC1);
+	for (int i = 0; i < centered.rows; i++)
+	{
+		cv::Mat row = centered.row(i);
+		row -= prev_mean_coeffs;
+	}
+	cv::Mat offset = cv::repeat(mean_coeffs, centered.rows, 1);
+	cv::gemm(centered, rotation.colRange(0, k), 1.0, offset, 1.0, features, cv::GEMM_2_T);
+}
+
 void SubspaceAnalysis::PCA::calcProjMatrix(cv::Mat& data)
 {
 	cv::Mat data_row;
@@ -652,6 +1082,6 @@ void SubspaceAnalysis::PCA::calcProjMatrix(cv::Mat& data)
 		cv::subtract(data_row, mean, data_row);
 	}
 
-	decomposeSVD(data);
+	decomposeTruncated(data, ss_dim_);
 }
 
@@ -0,0 +1,525 @@
+#ifdef __LINUX__
+#include "cob_people_detection/training_data_archive.h"
+#else
+#endif
+
+// stream
+#include <iostream>
+#include <cstring>
+#include <ctime>
+
+// mapping
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// boost
+#include "boost/filesystem/operations.hpp"
+
+namespace fs = boost::filesystem;
+using namespace ipa_PeopleDetector;
+
+const char* TrainingDataArchive::data_file_name = "tdata.pack";
+const char* TrainingDataArchive::index_file_name = "tdata.index";
+const char TrainingDataArchive::data_magic[4] = { 'F', 'R', 'T', 'P' };
+const char TrainingDataArchive::index_magic[4] = { 'F', 'R', 'T', 'I' };
+
+namespace
+{
+uint64_t alignedSize(uint64_t size)
+{
+	return (size + TrainingDataArchive::record_alignment - 1) / TrainingDataArchive::record_alignment * TrainingDataArchive::record_alignment;
+}
+
+uint64_t matBytes(int rows, int cols, int type)
+{
+	return (uint64_t)rows * cols * CV_ELEM_SIZE(type);
+}
+
+bool readHeader(const fs::path& file_name, const char* magic, TrainingDataArchive::Header& header)
+{
+	std::ifstream file(file_name.string().c_str(), std::ios::in | std::ios::binary);
+	file.read((char*)&header, sizeof(header));
+	return file.good() && std::memcmp(header.magic, magic, sizeof(header.magic)) == 0 && header.version == TrainingDataArchive::version
+			&& header.byte_order == TrainingDataArchive::byte_order_tag;
+}
+
+TrainingDataArchive::Header makeHeader(const char* magic, uint64_t archive_id)
+{
+	TrainingDataArchive::Header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, magic, sizeof(header.magic));
+	header.version = TrainingDataArchive::version;
+	header.byte_order = TrainingDataArchive::byte_order_tag;
+	header.archive_id = archive_id;
+	return header;
+}
+
+uint64_t newArchiveId()
+{
+	static uint64_t counter = 0;
+	return ((uint64_t)std::time(0) << 32) ^ ((uint64_t)getpid() << 16) ^ (uint64_t)std::clock() ^ (++counter);
+}
+}
+
+TrainingDataArchive::TrainingDataArchive() :
+	archive_id_(0), data_(0), size_(0), journal_entries_(0)
+{
+}
+
+TrainingDataArchive::~TrainingDataArchive()
+{
+	close();
+}
+
+void TrainingDataArchive::close()
+{
+	if (data_ != 0)
+		munmap(data_, size_);
+	data_ = 0;
+	size_ = 0;
+	archive_id_ = 0;
+	records_.clear();
+	record_labels_.clear();
+	record_live_.clear();
+	live_.clear();
+	journal_entries_ = 0;
+}
+
+bool TrainingDataArchive::exists(const boost::filesystem::path& data_directory)
+{
+	// a missing index is recovered from the temporary index by open() after an interrupted commit
+	fs::path index_file = data_directory / index_file_name;
+	return fs::is_regular_file(data_directory / data_file_name) && (fs::is_regular_file(index_file) || fs::is_regular_file(index_file.string() + ".tmp"));
+}
+
+bool TrainingDataArchive::open(const boost::filesystem::path& data_directory)
+{
+	close();
+	directory_ = data_directory;
+
+	fs::path data_file = data_directory / data_file_name;
+	int fd = ::open(data_file.string().c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(Header))
+	{
+		::close(fd);
+		return false;
+	}
+
+	// private writable mapping: the images can be normalized in place, modified pages are copied
+	size_ = file_stat.st_size;
+	void* mapping = mmap(0, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		std::cerr << "Error: TrainingDataArchive::open: Can't map " << data_file.string() << ".\n" << std::endl;
+		size_ = 0;
+		return false;
+	}
+	data_ = (uchar*)mapping;
+
+	const Header* header = (const Header*)data_;
+	if (std::memcmp(header->magic, data_magic, sizeof(data_magic)) != 0 || header->version != version || header->byte_order != byte_order_tag)
+	{
+		std::cerr << "Error: TrainingDataArchive::open: " << data_file.string() << " is no training data archive of version " << version << ".\n" << std::endl;
+		close();
+		return false;
+	}
+	archive_id_ = header->archive_id;
+
+	// a crash between the two renames of TrainingDataArchiveWriter::commit leaves the new data file next to the old index,
+	// the committed index of the new data file is still waiting as temporary file then
+	fs::path index_file = data_directory / index_file_name;
+	fs::path tmp_index_file = index_file.string() + ".tmp";
+	Header index_header;
+	if ((readHeader(index_file, index_magic, index_header) == false || index_header.archive_id != archive_id_)
+			&& readHeader(tmp_index_file, index_magic, index_header) == true && index_header.archive_id == archive_id_)
+	{
+		std::cout << "TrainingDataArchive::open: Completing the interrupted commit of the archive in " << data_directory.string() << ".\n";
+		boost::system::error_code error;
+		fs::rename(tmp_index_file, index_file, error);
+	}
+
+	if (readIndex(index_file) == false)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool TrainingDataArchive::readIndex(const boost::filesystem::path& index_file)
+{
+	Header header;
+	if (readHeader(index_file, index_magic, header) == false || header.archive_id != archive_id_)
+	{
+		std::cerr << "Error: TrainingDataArchive::readIndex: " << index_file.string() << " does not belong to the data file.\n" << std::endl;
+		return false;
+	}
+
+	uint64_t index_size = fs::file_size(index_file);
+	std::ifstream file(index_file.string().c_str(), std::ios::in | std::ios::binary);
+	file.seekg(sizeof(Header));
+	std::vector<char> label_buffer;
+	while (true)
+	{
+		IndexEntry entry;
+		file.read((char*)&entry, sizeof(entry));
+		if (!file.good())
+			break;
+
+		// the label of a damaged entry may claim more bytes than the index file has left
+		uint64_t padded_length = ((uint64_t)entry.label_length + 7) / 8 * 8;
+		bool valid = (padded_length <= index_size - (uint64_t)file.tellg());
+		if (valid == true)
+		{
+			label_buffer.resize(padded_length + 1);
+			file.read(&label_buffer[0], padded_length);
+			if (!file.good())
+				break;
+			label_buffer[entry.label_length] = 0;
+		}
+
+		// the data is written before the index, entries without complete data only remain after a damaged write
+		if (valid == true && (entry.flags & (flag_deleted | flag_relabel)) == 0)
+		{
+			uint64_t end = entry.offset + matBytes(entry.image_rows, entry.image_cols, entry.image_type);
+			if (entry.flags & flag_depth_map)
+				end = depthMapOffset(entry) + matBytes(entry.depth_rows, entry.depth_cols, entry.depth_type);
+			valid = (entry.offset % record_alignment == 0 && entry.offset >= sizeof(Header) && entry.image_rows >= 0 && entry.image_cols >= 0 && entry.depth_rows >= 0
+					&& entry.depth_cols >= 0 && end <= size_);
+		}
+		if (valid == true)
+			valid = applyEntry(entry, std::string(&label_buffer[0]));
+		if (valid == false)
+		{
+			std::cerr << "Error: TrainingDataArchive::readIndex: Ignoring damaged entries after record " << records_.size() << " of " << index_file.string() << ".\n" << std::endl;
+			break;
+		}
+	}
+	updateLive();
+	return true;
+}
+
+bool TrainingDataArchive::applyEntry(const IndexEntry& entry, const std::string& label)
+{
+	if ((entry.flags & (flag_deleted | flag_relabel)) == 0)
+	{
+		records_.push_back(entry);
+		record_labels_.push_back(label);
+		record_live_.push_back(true);
+		return true;
+	}
+
+	// journal entry
+	if (entry.offset >= records_.size())
+		return false;
+	if (entry.flags & flag_deleted)
+		record_live_[entry.offset] = false;
+	else
+		record_labels_[entry.offset] = label;
+	journal_entries_++;
+	return true;
+}
+
+void TrainingDataArchive::updateLive()
+{
+	live_.clear();
+	for (int r = 0; r < (int)records_.size(); r++)
+		if (record_live_[r] == true)
+			live_.push_back(r);
+}
+
+uint64_t TrainingDataArchive::depthMapOffset(const IndexEntry& entry) const
+{
+	return entry.offset + alignedSize(matBytes(entry.image_rows, entry.image_cols, entry.image_type));
+}
+
+bool TrainingDataArchive::hasDepthMap(int index) const
+{
+	return (records_[live_[index]].flags & flag_depth_map) != 0;
+}
+
+void TrainingDataArchive::getImage(int index, cv::Mat& image) const
+{
+	const IndexEntry& entry = records_[live_[index]];
+	if (entry.offset + matBytes(entry.image_rows, entry.image_cols, entry.image_type) > size_)
+	{
+		image.release();
+		return;
+	}
+	image = cv::Mat(entry.image_rows, entry.image_cols, entry.image_type, data_ + entry.offset);
+}
+
+void TrainingDataArchive::getDepthMap(int index, cv::Mat& depth_map) const
+{
+	const IndexEntry& entry = records_[live_[index]];
+	uint64_t offset = depthMapOffset(entry);
+	if (hasDepthMap(index) == false || offset + matBytes(entry.depth_rows, entry.depth_cols, entry.depth_type) > size_)
+	{
+		depth_map.release();
+		return;
+	}
+	depth_map = cv::Mat(entry.depth_rows, entry.depth_cols, entry.depth_type, data_ + offset);
+}
+
+bool TrainingDataArchive::compact(bool reclaim_data)
+{
+	fs::path directory = directory_;
+	if (reclaim_data == true)
+	{
+		// map the records appended since opening, then copy the stored faces into a new archive
+		if (open(directory) == false)
+			return false;
+		TrainingDataArchiveWriter writer;
+		bool success = writer.create(directory);
+		for (int i = 0; i < size() && success == true; i++)
+		{
+			cv::Mat image, depth_map;
+			getImage(i, image);
+			getDepthMap(i, depth_map);
+			success = (writer.append(label(i), image, depth_map) >= 0);
+		}
+		if (success == true)
+			success = writer.commit();
+		if (success == false)
+		{
+			std::cerr << "Error: TrainingDataArchive::compact: Can't rewrite the archive in " << directory.string() << ".\n" << std::endl;
+			close();
+			return false;
+		}
+		return open(directory);
+	}
+
+	// new index with the records of the stored faces, the data file is not touched
+	fs::path index_file = directory / index_file_name;
+	fs::path tmp_file = index_file.string() + ".tmp";
+	std::ofstream file(tmp_file.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	Header header = makeHeader(index_magic, archive_id_);
+	file.write((const char*)&header, sizeof(header));
+	const char padding[8] = { 0 };
+	for (int i = 0; i < size(); i++)
+	{
+		IndexEntry entry = records_[live_[i]];
+		const std::string& entry_label = record_labels_[live_[i]];
+		entry.label_length = entry_label.size();
+		file.write((const char*)&entry, sizeof(entry));
+		file.write(entry_label.data(), entry_label.size());
+		file.write(padding, (8 - entry_label.size() % 8) % 8);
+	}
+	file.close();
+	if (!file.good())
+	{
+		std::cerr << "Error: TrainingDataArchive::compact: Writing " << tmp_file.string() << " failed.\n" << std::endl;
+		fs::remove(tmp_file);
+		close();
+		return false;
+	}
+	fs::rename(tmp_file, index_file);
+
+	// renumber the records
+	std::vector<IndexEntry> records;
+	std::vector<std::string> record_labels;
+	for (int i = 0; i < size(); i++)
+	{
+		records.push_back(records_[live_[i]]);
+		record_labels.push_back(record_labels_[live_[i]]);
+	}
+	records_.swap(records);
+	record_labels_.swap(record_labels);
+	record_live_.assign(records_.size(), true);
+	journal_entries_ = 0;
+	updateLive();
+	return true;
+}
+
+TrainingDataArchiveWriter::TrainingDataArchiveWriter() :
+	archive_(0), data_size_(0), next_record_(0), created_(false)
+{
+}
+
+TrainingDataArchiveWriter::~TrainingDataArchiveWriter()
+{
+	data_.close();
+	index_.close();
+	if (created_ == true)
+	{
+		// not committed
+		fs::remove(data_file_);
+		fs::remove(index_file_);
+	}
+}
+
+bool TrainingDataArchiveWriter::create(const boost::filesystem::path& data_directory)
+{
+	target_data_file_ = data_directory / TrainingDataArchive::data_file_name;
+	target_index_file_ = data_directory / TrainingDataArchive::index_file_name;
+	data_file_ = target_data_file_.string() + ".tmp";
+	index_file_ = target_index_file_.string() + ".tmp";
+	archive_ = 0;
+	next_record_ = 0;
+
+	data_.open(data_file_.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	index_.open(index_file_.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!data_.is_open() || !index_.is_open())
+	{
+		std::cerr << "Error: TrainingDataArchiveWriter::create: Can't create " << data_file_.string() << ".\n" << std::endl;
+		return false;
+	}
+	created_ = true;
+
+	uint64_t archive_id = newArchiveId();
+	TrainingDataArchive::Header data_header = makeHeader(TrainingDataArchive::data_magic, archive_id);
+	TrainingDataArchive::Header index_header = makeHeader(TrainingDataArchive::index_magic, archive_id);
+	data_.write((const char*)&data_header, sizeof(data_header));
+	index_.write((const char*)&index_header, sizeof(index_header));
+	data_size_ = sizeof(data_header);
+	return data_.good() && index_.good();
+}
+
+bool TrainingDataArchiveWriter::openForAppend(TrainingDataArchive& archive)
+{
+	if (archive.isOpen() == false)
+		return false;
+	target_data_file_ = data_file_ = archive.directory_ / TrainingDataArchive::data_file_name;
+	target_index_file_ = index_file_ = archive.directory_ / TrainingDataArchive::index_file_name;
+	created_ = false;
+
+	// the files must still belong to the open archive
+	TrainingDataArchive::Header data_header, index_header;
+	if (readHeader(data_file_, TrainingDataArchive::data_magic, data_header) == false
+			|| readHeader(index_file_, TrainingDataArchive::index_magic, index_header) == false || data_header.archive_id != archive.archive_id_
+			|| index_header.archive_id != archive.archive_id_)
+	{
+		std::cerr << "Error: TrainingDataArchiveWriter::openForAppend: The archive in " << archive.directory_.string() << " has been replaced or is damaged.\n" << std::endl;
+		return false;
+	}
+
+	data_size_ = fs::file_size(data_file_);
+	data_.open(data_file_.string().c_str(), std::ios::out | std::ios::binary | std::ios::app);
+	index_.open(index_file_.string().c_str(), std::ios::out | std::ios::binary | std::ios::app);
+	if (!data_.is_open() || !index_.is_open())
+	{
+		std::cerr << "Error: TrainingDataArchiveWriter::openForAppend: Can't open " << data_file_.string() << " for writing.\n" << std::endl;
+		return false;
+	}
+	archive_ = &archive;
+	next_record_ = archive.numRecords();
+	return true;
+}
+
+void TrainingDataArchiveWriter::writeRecord(const cv::Mat& mat)
+{
+	const char padding[TrainingDataArchive::record_alignment] = { 0 };
+	uint64_t start = alignedSize(data_size_);
+	data_.write(padding, start - data_size_);
+	cv::Mat continuous = mat.isContinuous() ? mat : mat.clone();
+	uint64_t bytes = continuous.total() * continuous.elemSize();
+	data_.write((const char*)continuous.data, bytes);
+	data_size_ = start + bytes;
+}
+
+void TrainingDataArchiveWriter::addEntry(const TrainingDataArchive::IndexEntry& entry, const std::string& label)
+{
+	const char padding[8] = { 0 };
+	pending_index_.append((const char*)&entry, sizeof(entry));
+	pending_index_.append(label);
+	pending_index_.append(padding, (8 - label.size() % 8) % 8);
+	pending_entries_.push_back(entry);
+	pending_labels_.push_back(label);
+}
+
+int TrainingDataArchiveWriter::append(const std::string& label, const cv::Mat& image, const cv::Mat& depth_map)
+{
+	TrainingDataArchive::IndexEntry entry;
+	std::memset(&entry, 0, sizeof(entry));
+	entry.offset = alignedSize(data_size_);
+	entry.image_rows = image.rows;
+	entry.image_cols = image.cols;
+	entry.image_type = image.type();
+	writeRecord(image);
+	if (!depth_map.empty())
+	{
+		entry.depth_rows = depth_map.rows;
+		entry.depth_cols = depth_map.cols;
+		entry.depth_type = depth_map.type();
+		entry.flags |= TrainingDataArchive::flag_depth_map;
+		writeRecord(depth_map);
+	}
+	entry.label_length = label.size();
+
+	// the index entries are kept back until the data has been flushed
+	addEntry(entry, label);
+	return data_.good() ? next_record_++ : -1;
+}
+
+void TrainingDataArchiveWriter::remove(int record)
+{
+	TrainingDataArchive::IndexEntry entry;
+	std::memset(&entry, 0, sizeof(entry));
+	entry.offset = record;
+	entry.flags = TrainingDataArchive::flag_deleted;
+	addEntry(entry, std::string());
+}
+
+void TrainingDataArchiveWriter::relabel(int record, const std::string& label)
+{
+	TrainingDataArchive::IndexEntry entry;
+	std::memset(&entry, 0, sizeof(entry));
+	entry.offset = record;
+	entry.flags = TrainingDataArchive::flag_relabel;
+	entry.label_length = label.size();
+	addEntry(entry, label);
+}
+
+bool TrainingDataArchiveWriter::commit()
+{
+	data_.flush();
+	if (data_.good())
+	{
+		index_.write(pending_index_.data(), pending_index_.size());
+		index_.flush();
+	}
+	pending_index_.clear();
+	bool success = data_.good() && index_.good();
+	data_.close();
+	index_.close();
+	if (success == false)
+	{
+		std::cerr << "Error: TrainingDataArchiveWriter::commit: Writing " << data_file_.string() << " failed.\n" << std::endl;
+		if (archive_ != 0)
+			archive_->close();
+		return false;
+	}
+
+	if (created_ == true)
+	{
+		// a reader that opens the new data file with the old index rejects the mismatching archive id or completes the commit
+		// with the temporary index (see TrainingDataArchive::open)
+		fs::rename(data_file_, target_data_file_);
+		boost::system::error_code error;
+		fs::rename(index_file_, target_index_file_, error);
+		created_ = false;
+		TrainingDataArchive::Header data_header, index_header;
+		if (error && (readHeader(target_data_file_, TrainingDataArchive::data_magic, data_header) == false
+				|| readHeader(target_index_file_, TrainingDataArchive::index_magic, index_header) == false || index_header.archive_id != data_header.archive_id))
+		{
+			std::cerr << "Error: TrainingDataArchiveWriter::commit: Can't rename " << index_file_.string() << ".\n" << std::endl;
+			return false;
+		}
+	}
+	else if (archive_ != 0)
+	{
+		// the archive object follows the journal without reading the index again
+		for (int i = 0; i < (int)pending_entries_.size(); i++)
+			archive_->applyEntry(pending_entries_[i], pending_labels_[i]);
+		archive_->updateLive();
+	}
+	pending_entries_.clear();
+	pending_labels_.clear();
+	return true;
+}
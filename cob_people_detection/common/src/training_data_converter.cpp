@@ -0,0 +1,97 @@
+#include <cob_people_detection/training_data_archive.h>
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "boost/filesystem/operations.hpp"
+
+// Converts the training data of a data directory from the former layout (tdata.xml with one image file
+// per face in img/ and one XML file per depth map in depth/) into the packed training data archive
+// (tdata.pack, tdata.index). The former files are kept, the recognizer ignores them once the archive exists.
+//
+// usage: training_data_converter <data directory> [--force]
+//   --force: replace an existing archive
+
+namespace fs = boost::filesystem;
+
+int main(int argc, const char *argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "usage: training_data_converter <data directory> [--force]" << std::endl;
+		return 1;
+	}
+	fs::path data_directory = argv[1];
+	bool force = (argc > 2 && std::string(argv[2]) == "--force");
+
+	if (ipa_PeopleDetector::TrainingDataArchive::exists(data_directory) && force == false)
+	{
+		std::cout << "The training data in " << data_directory.string() << " has already been converted, use --force to convert it again." << std::endl;
+		return 1;
+	}
+
+	fs::path complete = data_directory / "tdata.xml";
+	cv::FileStorage fileStorage(complete.string(), cv::FileStorage::READ);
+	if (!fileStorage.isOpened())
+	{
+		std::cout << "Can't open " << complete.string() << "." << std::endl;
+		return 1;
+	}
+
+	ipa_PeopleDetector::TrainingDataArchiveWriter writer;
+	if (writer.create(data_directory) == false)
+		return 1;
+
+	int number_entries = (int)fileStorage["number_entries"];
+	int converted_images = 0, converted_depthmaps = 0;
+	for (int i = 0; i < number_entries; i++)
+	{
+		std::ostringstream tag_label, tag_image, tag_dm;
+		tag_label << "label_" << i;
+		tag_image << "image_" << i;
+		tag_dm << "depthmap_" << i;
+		std::string label = (std::string)fileStorage[tag_label.str().c_str()];
+		std::string image_file = (std::string)fileStorage[tag_image.str().c_str()];
+		std::string dm_file = (std::string)fileStorage[tag_dm.str().c_str()];
+
+		// images are stored unchanged, they have been normalized when they were captured
+		cv::Mat image = cv::imread((data_directory / image_file).string(), -1);
+		if (image.empty())
+		{
+			std::cout << "Skipping entry " << i << ": can't read " << (data_directory / image_file).string() << "." << std::endl;
+			continue;
+		}
+
+		cv::Mat depthmap;
+		if (dm_file.empty() == false)
+		{
+			cv::FileStorage dm_storage((data_directory / dm_file).string(), cv::FileStorage::READ);
+			if (dm_storage.isOpened())
+			{
+				dm_storage["depthmap"] >> depthmap;
+				dm_storage.release();
+			}
+			if (depthmap.empty())
+				std::cout << "Entry " << i << ": can't read " << (data_directory / dm_file).string() << ", the face is stored without depth map." << std::endl;
+			else
+				converted_depthmaps++;
+		}
+
+		if (writer.append(label, image, depthmap) < 0)
+		{
+			std::cout << "Writing the archive failed." << std::endl;
+			return 1;
+		}
+		converted_images++;
+	}
+	fileStorage.release();
+
+	if (writer.commit() == false)
+		return 1;
+
+	std::cout << converted_images << " of " << number_entries << " faces and " << converted_depthmaps << " depth maps converted into "
+			<< (data_directory / ipa_PeopleDetector::TrainingDataArchive::data_file_name).string() << "." << std::endl;
+	return 0;
+}
@@ -74,6 +74,7 @@
 #include <sensor_msgs/Image.h>
 //#include <sensor_msgs/PointCloud2.h>
 #include <cob_perception_msgs/DetectionArray.h>
+#include <cob_people_detection/TrackIdentities.h>
 
 // services
 //#include <cob_people_detection/DetectPeople.h>
@@ -114,12 +115,15 @@ protected:
 	message_filters::Synchronizer<message_filters::sync_policies::ApproximateTime<cob_perception_msgs::DetectionArray, sensor_msgs::Image> >* sync_input_2_;
 	message_filters::Subscriber<cob_perception_msgs::DetectionArray> face_position_subscriber_; ///< receives the face messages from the face detector
 	ros::Publisher face_position_publisher_; ///< publisher for the positions of the detected faces
+	ros::Publisher track_identity_publisher_; ///< publisher for the identities of the tracked faces, used by the face recognizer to skip identified faces
 
 	ros::NodeHandle node_handle_; ///< ROS node handle
 
 	std::vector<cob_perception_msgs::Detection> face_position_accumulator_; ///< accumulates face positions over time
 	boost::timed_mutex face_position_accumulator_mutex_; ///< secures write and read operations to face_position_accumulator_
 	std::vector<std::map<std::string, double> > face_identification_votes_; ///< collects votes for all names (map index) ever assigned to each detection (vector index) in face_position_accumulator_
+	std::vector<unsigned int> face_track_ids_; ///< stable id of each detection (vector index) in face_position_accumulator_
+	unsigned int next_track_id_; ///< id of the next new track
 
 	// parameters
 	bool debug_; ///< enables some debug outputs
@@ -169,6 +173,10 @@ public:
 
 	unsigned long prepareFacePositionMessage(cob_perception_msgs::DetectionArray& face_position_msg_out, ros::Time image_recording_time);
 
+	/// Publishes the id, label, identity confidence and position of every tracked face.
+	/// @param stamp Time stamp of the processed detections
+	void publishTrackIdentities(const ros::Time& stamp);
+
 	/// checks the detected faces from the input topic against the people segmentation and outputs faces if both are positive
 	void inputCallback(const cob_perception_msgs::DetectionArray::ConstPtr& face_position_msg_in, const sensor_msgs::Image::ConstPtr& people_segmentation_image_msg);
 
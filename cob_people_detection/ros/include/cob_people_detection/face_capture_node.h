@@ -136,7 +136,7 @@ protected:
 	};
 	enum UpdateMode
 	{
-		BY_INDEX = 1, BY_LABEL
+		BY_INDEX = 1, BY_LABEL, BY_LABEL_LIST
 	};
 	//enum DeleteMode {BY_INDEX=1, BY_LABEL};
 
@@ -74,6 +74,9 @@
 #include <geometry_msgs/Point.h>
 #include <cob_perception_msgs/DetectionArray.h>
 #include <cob_perception_msgs/ColorDepthImageArray.h>
+#include <cob_people_detection/RecognitionQueueStatus.h>
+#include <cob_people_detection/setVerificationTarget.h>
+#include <cob_people_detection/TrackIdentities.h>
 
 // Actions
 #include <actionlib/server/simple_action_server.h>
@@ -82,6 +85,13 @@
 //boost includes
 
 #include<boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <map>
+#include <set>
 
 namespace ipa_PeopleDetector
 {
@@ -100,10 +110,51 @@ public:
 
 protected:
 
-	/// Callback for incoming head detections
+	/// Callback for incoming head detections, the frame is queued for the recognition workers according to queue_policy_
 	void facePositionsCallback(const cob_perception_msgs::ColorDepthImageArray::ConstPtr& face_positions);
 	//void facePositionsCallback(const cob_perception_msgs::ColorDepthImageCropArray::ConstPtr& face_positions);
 
+	/// Recognizes the faces of one frame.
+	/// @param face_positions Head detections of the frame
+	/// @param detection_msg Positions and labels of the detected faces
+	/// @return False if the images of the frame can not be converted
+	bool recognizeFrame(const cob_perception_msgs::ColorDepthImageArray::ConstPtr& face_positions, cob_perception_msgs::DetectionArray& detection_msg);
+
+	/// Callback for the identities of the faces tracked by the detection tracker
+	void trackIdentitiesCallback(const cob_people_detection::TrackIdentities::ConstPtr& track_identities);
+
+	/// Decides which faces of a frame are recognized. A face of a track that the detection tracker has identified with high confidence
+	/// takes the label of the track and is only recognized again after track_reverification_interval_. Faces of new, unknown or
+	/// uncertain tracks and of tracks whose last re-verification disagreed with their label are always recognized, due re-verifications
+	/// are added in the order of their age up to max_recognitions_per_frame_.
+	/// @param heads_depth_images Depth images of the heads (xyz)
+	/// @param face_bounding_boxes Faces of every head
+	/// @param stamp Time stamp of the frame
+	/// @param track_labels Receives the label of every face that is not recognized, empty for the faces that are recognized, indices correspond with face_bounding_boxes
+	/// @param face_tracks Receives the id and the label of the identified track of every face, -1 and an empty label if the face has no identified track
+	void scheduleFaces(std::vector<cv::Mat>& heads_depth_images, const std::vector<std::vector<cv::Rect> >& face_bounding_boxes, const ros::Time& stamp,
+			std::vector<std::vector<std::string> >& track_labels, std::vector<std::vector<std::pair<int, std::string> > >& face_tracks);
+
+	/// Compares the recognized faces of identified tracks with the label of their track. A track whose face is recognized as
+	/// another person is recognized in every frame until the detection tracker agrees with the recognition again.
+	/// @param face_tracks Identified track of every face from scheduleFaces
+	/// @param track_labels Labels of the faces that were not recognized from scheduleFaces
+	/// @param identification_labels Labels of all faces, indices correspond with face_tracks
+	void updateDisputedTracks(const std::vector<std::vector<std::pair<int, std::string> > >& face_tracks, const std::vector<std::vector<std::string> >& track_labels,
+			const std::vector<std::vector<std::string> >& identification_labels);
+
+	/// Main loop of a recognition worker, takes frames from the queue until the node shuts down.
+	void recognitionWorker();
+
+	/// Publishes the results in the order in which the workers took the frames from the queue.
+	/// @param sequence Position of the frame in the order of the queue
+	/// @param detection_msg Result of the frame
+	/// @param valid False if the frame could not be recognized, its position is skipped
+	void publishInOrder(unsigned long sequence, const cob_perception_msgs::DetectionArray& detection_msg, bool valid);
+
+	/// Publishes the queue depth and the frame counters.
+	void publishQueueStatus(const ros::TimerEvent& event);
+
 	/// Computes the 3D coordinate of a detected face.
 	/// @param depth_image Coordinate image in format CV32FC3
 	/// @param center2Dx Image x-coordinate of the center of the detected face
@@ -116,14 +167,35 @@ protected:
 	/// Callback for load requests to load a new recognition model
 	void loadModelServerCallback(const cob_people_detection::loadModelGoalConstPtr& goal);
 
+	/// Callback that switches between the recognition against the whole gallery and the verification of a single identity
+	bool setVerificationTargetCallback(cob_people_detection::setVerificationTarget::Request &req, cob_people_detection::setVerificationTarget::Response &res);
+
+	/// Follows the global parameter verification_target_parameter_, the verification target changes whenever the parameter changes.
+	/// A label that the recognition model does not serve is reported once and taken over as soon as a model serves it.
+	void checkVerificationTargetParameter(const ros::TimerEvent& event);
+
+	/// Sets the verification target, empty to recognize against the whole gallery.
+	/// @return False if the recognition model does not serve label, the verification target is not changed then
+	bool setVerificationTarget(const std::string& label);
+
 	ros::NodeHandle node_handle_;
 
 	ros::Subscriber face_position_subscriber_; ///< subscribes to the positions of detected face regions
 
+	ros::Subscriber track_identity_subscriber_; ///< subscribes to the identities of the faces tracked by the detection tracker
+
 	ros::Publisher face_recognition_publisher_; ///< publisher for the positions and labels of the detected faces
 
+	ros::Publisher queue_status_publisher_; ///< publisher for the status of the recognition queue
+
+	ros::Timer queue_status_timer_; ///< triggers publishQueueStatus
+
 	LoadModelServer* load_model_server_; ///< Action server that handles load requests for a new recognition model
 
+	ros::ServiceServer verification_target_server_; ///< Service server that sets the verification target
+
+	ros::Timer verification_target_timer_; ///< triggers checkVerificationTargetParameter
+
 	FaceRecognizer face_recognizer_; ///< implementation of the face recognizer
 
 
@@ -132,6 +204,52 @@ protected:
 	std::string classifier_directory_; ///< path to the face feature haarcascades
 	bool enable_face_recognition_; ///< this flag enables or disables the face recognition step
 	bool display_timing_;
+	std::string verification_target_parameter_; ///< name of the global parameter that holds the verification target, empty if the parameter is not followed
+	std::string verification_target_prefix_; ///< prefix that is removed from the value of verification_target_parameter_ (the login stores the user id as '_' + id)
+	std::string verification_parameter_value_; ///< last seen value of the parameter verification_target_parameter_ (without verification_target_prefix_)
+	bool verification_parameter_pending_; ///< true if the recognition model did not serve verification_parameter_value_ yet
+	double verification_threshold_; ///< faces with a smaller distance to the verification target (relative to the unknown threshold) are accepted
+	std::string verification_label_; ///< identity the faces are verified against, empty to recognize against the whole gallery
+	boost::mutex verification_mutex_; ///< secures verification_label_
+
+	// recognition scheduling with the identities of the detection tracker
+	bool schedule_track_recognition_; ///< faces of tracks that are identified with high confidence are only recognized at track_reverification_interval_
+	double track_identity_min_confidence_; ///< minimal identity confidence of a track (0..1) whose faces are not recognized in every frame
+	double track_reverification_interval_; ///< time in seconds after which the identity of a track is verified again
+	int max_recognitions_per_frame_; ///< maximal number of faces per frame including re-verifications, faces of new and unknown tracks are always recognized, 0 = no limit
+	double track_association_range_m_; ///< maximal distance in meters between a face and the last position of its track
+	cob_people_detection::TrackIdentities::ConstPtr track_identities_; ///< latest identities of the tracked faces
+	std::map<unsigned int, ros::Time> track_recognition_times_; ///< time stamp of the frame in which each track was recognized last
+	std::set<unsigned int> disputed_tracks_; ///< tracks whose last recognition disagreed with the label of the track
+	boost::mutex track_mutex_; ///< secures track_identities_, track_recognition_times_ and disputed_tracks_
+	int number_recognition_workers_; ///< number of threads that recognize frames concurrently
+	int recognition_queue_size_; ///< number of frames that wait for a free worker
+	enum QueuePolicy
+	{
+		KEEP_LATEST = 0, DROP_OLDEST
+	};
+	QueuePolicy queue_policy_; ///< behavior of a full queue
+
+	// recognition queue
+	std::deque<cob_perception_msgs::ColorDepthImageArray::ConstPtr> frame_queue_; ///< frames that wait for a worker
+	boost::mutex queue_mutex_; ///< secures frame_queue_, the sequence numbers and the queue counters
+	boost::condition_variable queue_condition_; ///< signals queued frames and the shutdown to the workers
+	boost::thread_group recognition_workers_; ///< recognition threads
+	bool shutdown_; ///< stops the workers
+	unsigned long next_sequence_; ///< sequence number of the next frame taken from the queue
+	int busy_workers_; ///< workers that are recognizing a frame
+	unsigned long frames_received_; ///< frames received since the start
+	unsigned long frames_dropped_; ///< frames discarded by the queue policy
+
+	// ordered publishing
+	std::map<unsigned long, std::pair<bool, cob_perception_msgs::DetectionArray> > pending_results_; ///< finished results waiting for older frames
+	boost::mutex publish_mutex_; ///< secures the ordered publishing state
+	unsigned long next_published_sequence_; ///< sequence number of the next published result
+	ros::Time last_published_stamp_; ///< time stamp of the last published result
+	unsigned long frames_late_; ///< results not published because a newer frame had been published already
+	unsigned long frames_published_; ///< published results
+	unsigned long faces_detected_; ///< faces in the recognized frames, secured by queue_mutex_
+	unsigned long faces_recognized_; ///< faces passed to the face recognizer, secured by queue_mutex_
 
 };
 
@@ -114,6 +114,7 @@ DetectionTrackerNode::DetectionTrackerNode(ros::NodeHandle nh) :
 {
 	it_ = 0;
 	sync_input_2_ = 0;
+	next_track_id_ = 1;
 
 	// parameters
 	std::cout << "\n---------------------------\nPeople Detection Parameters:\n---------------------------\n";
@@ -164,6 +165,7 @@ DetectionTrackerNode::DetectionTrackerNode(ros::NodeHandle nh) :
 
 	// publishers
 	face_position_publisher_ = node_handle_.advertise<cob_perception_msgs::DetectionArray>("face_position_array", 1);
+	track_identity_publisher_ = node_handle_.advertise<cob_people_detection::TrackIdentities>("track_identities", 1);
 
 	std::cout << "DetectionTrackerNode initialized." << std::endl;
 }
@@ -213,8 +215,9 @@ unsigned long DetectionTrackerNode::copyDetection(const cob_perception_msgs::Det
 	//	pointOut->x = pointIn->x; pointOut->y = pointIn->y; pointOut->z = pointIn->z;
 	dest.pose.pose = src.pose.pose;
 
-	// person ID
-	if (update == true)
+	// person ID, a face that took the label of its track in the face recognizer (detector "track") is no new vote,
+	// the track keeps its label and its votes do not decay until the face is recognized again
+	if (update == true && src.detector != "track")
 	{
 		// update label history
 		// if (src.label!="No face")
@@ -251,7 +254,7 @@ unsigned long DetectionTrackerNode::copyDetection(const cob_perception_msgs::Det
 				face_identification_votes_[updateIndex]["UnknownHead"] = face_identification_votes_[updateIndex]["Unknown"];
 		}
 	}
-	else
+	else if (update == false)
 		dest.label = src.label;
 
 	if (dest.label == "UnknownHead")
@@ -263,7 +266,8 @@ unsigned long DetectionTrackerNode::copyDetection(const cob_perception_msgs::Det
 	// if (src.detector=="color") dest.detector = "color";
 	// }
 	// else dest.detector = src.detector;
-	dest.detector = src.detector;
+	// faces that took the label of their track are face detections for the subscribers of the tracker
+	dest.detector = (src.detector == "track") ? std::string("face") : src.detector;
 
 	dest.header.stamp = src.header.stamp; //ros::Time::now();
 
@@ -385,6 +389,25 @@ unsigned long DetectionTrackerNode::prepareFacePositionMessage(cob_perception_ms
 	return ipa_Utils::RET_OK;
 }
 
+void DetectionTrackerNode::publishTrackIdentities(const ros::Time& stamp)
+{
+	// the vote score of a label converges to max_score if the label is detected in every frame
+	double max_score = face_identification_score_decay_rate_ / std::max(1. - face_identification_score_decay_rate_, 1e-6);
+
+	cob_people_detection::TrackIdentities track_identities_msg;
+	track_identities_msg.header.stamp = stamp;
+	for (int i = 0; i < (int)face_position_accumulator_.size(); i++)
+	{
+		cob_people_detection::TrackIdentity track;
+		track.track_id = face_track_ids_[i];
+		track.label = face_position_accumulator_[i].label;
+		track.confidence = std::min(1., face_identification_votes_[i][track.label] / max_score);
+		track.position = face_position_accumulator_[i].pose.pose.position;
+		track_identities_msg.tracks.push_back(track);
+	}
+	track_identity_publisher_.publish(track_identities_msg);
+}
+
 /// checks the detected faces from the input topic against the people segmentation and outputs faces if both are positive
 void DetectionTrackerNode::inputCallback(const cob_perception_msgs::DetectionArray::ConstPtr& face_position_msg_in,
 		const sensor_msgs::Image::ConstPtr& people_segmentation_image_msg)
@@ -415,6 +438,7 @@ void DetectionTrackerNode::inputCallback(const cob_perception_msgs::DetectionArr
 			{
 				face_position_accumulator_.erase(face_position_accumulator_.begin() + i);
 				face_identification_votes_.erase(face_identification_votes_.begin() + i);
+				face_track_ids_.erase(face_track_ids_.begin() + i);
 			}
 		}
 		if (debug_)
@@ -450,7 +474,7 @@ void DetectionTrackerNode::inputCallback(const cob_perception_msgs::DetectionArr
 			double segmentedPeopleRatio = (double)(faceArea - numberBlackPixels) / (double)faceArea;
 
 			// if (debug_) std::cout << "ratio: " << segmentedPeopleRatio << "\n";
-			if ((det_in.detector == "face" && segmentedPeopleRatio < min_segmented_people_ratio_face_) || (det_in.detector == "head" && segmentedPeopleRatio
+			if (((det_in.detector == "face" || det_in.detector == "track") && segmentedPeopleRatio < min_segmented_people_ratio_face_) || (det_in.detector == "head" && segmentedPeopleRatio
 					< min_segmented_people_ratio_head_))
 			{
 				// False detection
@@ -617,6 +641,7 @@ void DetectionTrackerNode::inputCallback(const cob_perception_msgs::DetectionArr
 				new_identification_data["UnknownHead"] = 0.0;
 				new_identification_data[det_in.label] = 1.0;
 				face_identification_votes_.push_back(new_identification_data);
+				face_track_ids_.push_back(next_track_id_++);
 			}
 		}
 	}
@@ -632,6 +657,7 @@ void DetectionTrackerNode::inputCallback(const cob_perception_msgs::DetectionArr
 	prepareFacePositionMessage(face_position_msg_out, image_recording_time);
 	face_position_msg_out.header.stamp = face_position_msg_in->header.stamp;
 	face_position_publisher_.publish(face_position_msg_out);
+	publishTrackIdentities(face_position_msg_in->header.stamp);
 
 	static tf::TransformBroadcaster br;
 
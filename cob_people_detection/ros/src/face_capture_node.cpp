@@ -346,6 +346,16 @@ void FaceCaptureNode::updateDataServerCallback(const cob_people_detection::updat
 		// update all entries identified by their old label
 		face_recognizer_trainer_.updateFaceLabels(goal->old_label, goal->new_label);
 	}
+	else if (goal->update_mode == BY_LABEL_LIST)
+	{
+		// update the entries of several labels at once
+		if (face_recognizer_trainer_.updateFaceLabels(goal->old_labels, goal->new_labels) != ipa_Utils::RET_OK)
+		{
+			ROS_ERROR("FaceCaptureNode::updateDataServerCallback: old_labels and new_labels differ in length.");
+			update_data_server_->setAborted(result, "old_labels and new_labels differ in length. No entries have been updated.");
+			return;
+		}
+	}
 	else
 	{
 		ROS_ERROR("FaceCaptureNode::updateDataServerCallback: Unknown update_mode.");
@@ -378,6 +388,11 @@ void FaceCaptureNode::deleteDataServerCallback(const cob_people_detection::delet
 		// delete all entries identified by their label
 		face_recognizer_trainer_.deleteFaces(goal->label, face_images_,face_depthmaps_);
 	}
+	else if (goal->delete_mode == BY_LABEL_LIST)
+	{
+		// delete the entries of several labels in one pass
+		face_recognizer_trainer_.deleteFaces(goal->labels, face_images_,face_depthmaps_);
+	}
 	else
 	{
 		ROS_ERROR("FaceCaptureNode::deleteDataServerCallback: Unknown delete_mode.");
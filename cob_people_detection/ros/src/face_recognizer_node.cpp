@@ -72,13 +72,20 @@
 
 // Boost
 #include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <cfloat>
 
 #include <sys/time.h>
 
 using namespace ipa_PeopleDetector;
 
 FaceRecognizerNode::FaceRecognizerNode(ros::NodeHandle nh) :
-	node_handle_(nh)
+	node_handle_(nh), load_model_server_(0), verification_parameter_pending_(false), shutdown_(false), next_sequence_(0), busy_workers_(0),
+			frames_received_(0), frames_dropped_(0), next_published_sequence_(0), frames_late_(0), frames_published_(0), faces_detected_(0),
+			faces_recognized_(0)
 {
 	//	data_directory_ = ros::package::getPath("cob_people_detection") + "/common/files/";
 	//	classifier_directory_ = ros::package::getPath("cob_people_detection") + "/common/files/";
@@ -95,6 +102,15 @@ FaceRecognizerNode::FaceRecognizerNode(ros::NodeHandle nh) :
 	int recognition_method; // choose subspace method
 	bool use_unknown_thresh; // use threshold for unknown faces
 	bool use_depth; // use depth for recognition
+	bool use_float_model; // store and evaluate the recognition model in single precision
+	int gallery_index_probes; // number of gallery index lists searched per face, 0 = exact search
+	int max_incremental_updates; // number of incremental model updates for new persons before a full training, 0 = always train
+	int quantized_candidates; // number of candidates from the 8 bit quantized gallery that are compared in full precision, 0 = off
+	int cascade_size; // width and height of the faces in the coarse stage of the recognition cascade, 0 = off
+	int cascade_feature_dim; // feature dimension of the coarse cascade stage
+	int cascade_candidates; // number of training images passed from the coarse cascade stage to the full model
+	bool parallel_matching; // match large galleries exactly in parallel shards on all cores
+	bool export_xml_model; // additionally write the recognition model in the XML format
 	std::vector < std::string > identification_labels_to_recognize; // a list of labels of persons that shall be recognized
 	std::cout << "\n--------------------------\nFace Recognizer Parameters:\n--------------------------\n";
 	//if(!node_handle_.getParam("~data_directory", data_directory_)) std::cout<<"PARAM NOT AVAILABLE"<<std::endl;
@@ -119,6 +135,47 @@ FaceRecognizerNode::FaceRecognizerNode(ros::NodeHandle nh) :
 	std::cout << " use use unknown thresh: " << use_unknown_thresh << "\n";
 	node_handle_.param("use_depth", use_depth, true);
 	std::cout << " use depth: " << use_depth << "\n";
+	node_handle_.param("use_float_model", use_float_model, false);
+	std::cout << "use_float_model = " << use_float_model << "\n";
+	node_handle_.param("gallery_index_probes", gallery_index_probes, 0);
+	std::cout << "gallery_index_probes = " << gallery_index_probes << "\n";
+	node_handle_.param("max_incremental_updates", max_incremental_updates, 0);
+	std::cout << "max_incremental_updates = " << max_incremental_updates << "\n";
+	node_handle_.param("quantized_candidates", quantized_candidates, 0);
+	std::cout << "quantized_candidates = " << quantized_candidates << "\n";
+	node_handle_.param("cascade_size", cascade_size, 0);
+	std::cout << "cascade_size = " << cascade_size << "\n";
+	node_handle_.param("cascade_feature_dim", cascade_feature_dim, 5);
+	std::cout << "cascade_feature_dim = " << cascade_feature_dim << "\n";
+	node_handle_.param("cascade_candidates", cascade_candidates, 20);
+	std::cout << "cascade_candidates = " << cascade_candidates << "\n";
+	node_handle_.param("parallel_matching", parallel_matching, false);
+	std::cout << "parallel_matching = " << parallel_matching << "\n";
+	node_handle_.param("export_xml_model", export_xml_model, false);
+	std::cout << "export_xml_model = " << export_xml_model << "\n";
+	node_handle_.param("recognition_workers", number_recognition_workers_, 1);
+	std::cout << "recognition_workers = " << number_recognition_workers_ << "\n";
+	node_handle_.param("recognition_queue_size", recognition_queue_size_, 1);
+	std::cout << "recognition_queue_size = " << recognition_queue_size_ << "\n";
+	std::string recognition_queue_policy;
+	node_handle_.param("recognition_queue_policy", recognition_queue_policy, std::string("keep_latest"));
+	std::cout << "recognition_queue_policy = " << recognition_queue_policy << "\n";
+	node_handle_.param("verification_target_parameter", verification_target_parameter_, std::string(""));
+	std::cout << "verification_target_parameter = " << verification_target_parameter_ << "\n";
+	node_handle_.param("verification_target_prefix", verification_target_prefix_, std::string(""));
+	std::cout << "verification_target_prefix = " << verification_target_prefix_ << "\n";
+	node_handle_.param("verification_threshold", verification_threshold_, 1.1);
+	std::cout << "verification_threshold = " << verification_threshold_ << "\n";
+	node_handle_.param("schedule_track_recognition", schedule_track_recognition_, false);
+	std::cout << "schedule_track_recognition = " << schedule_track_recognition_ << "\n";
+	node_handle_.param("track_identity_min_confidence", track_identity_min_confidence_, 0.8);
+	std::cout << "track_identity_min_confidence = " << track_identity_min_confidence_ << "\n";
+	node_handle_.param("track_reverification_interval", track_reverification_interval_, 2.0);
+	std::cout << "track_reverification_interval = " << track_reverification_interval_ << "\n";
+	node_handle_.param("max_recognitions_per_frame", max_recognitions_per_frame_, 0);
+	std::cout << "max_recognitions_per_frame = " << max_recognitions_per_frame_ << "\n";
+	node_handle_.param("track_association_range_m", track_association_range_m_, 0.2);
+	std::cout << "track_association_range_m = " << track_association_range_m_ << "\n";
 	node_handle_.param("display_timing", display_timing_, false);
 	std::cout << "display_timing = " << display_timing_ << "\n";
 	node_handle_.param("norm_size", norm_size, 100);
@@ -148,9 +205,22 @@ FaceRecognizerNode::FaceRecognizerNode(ros::NodeHandle nh) :
 		}
 	}
 
+	number_recognition_workers_ = std::max(1, number_recognition_workers_);
+	recognition_queue_size_ = std::max(1, recognition_queue_size_);
+	if (recognition_queue_policy.compare("drop_oldest") == 0)
+		queue_policy_ = DROP_OLDEST;
+	else
+	{
+		if (recognition_queue_policy.compare("keep_latest") != 0)
+			ROS_WARN("Unknown recognition_queue_policy '%s', keep_latest is used.", recognition_queue_policy.c_str());
+		queue_policy_ = KEEP_LATEST;
+	}
+
 	// initialize face recognizer
 	unsigned long return_value = face_recognizer_.init(data_directory_, norm_size, norm_illumination, norm_align, norm_extreme_illumination, metric, debug,
-			identification_labels_to_recognize, recognition_method, feature_dimension, use_unknown_thresh, use_depth);
+			identification_labels_to_recognize, recognition_method, feature_dimension, use_unknown_thresh, use_depth, use_float_model,
+			gallery_index_probes, max_incremental_updates, quantized_candidates, cascade_size, cascade_feature_dim, cascade_candidates,
+			parallel_matching, export_xml_model);
 	if (return_value == ipa_Utils::RET_FAILED)
 	{
 		ROS_ERROR("Recognition model not trained");
@@ -163,20 +233,42 @@ FaceRecognizerNode::FaceRecognizerNode(ros::NodeHandle nh) :
 
 		// advertise topics
 		face_recognition_publisher_ = node_handle_.advertise<cob_perception_msgs::DetectionArray>("face_recognitions", 1);
+		queue_status_publisher_ = node_handle_.advertise<cob_people_detection::RecognitionQueueStatus>("recognition_queue_status", 1);
+
+		// start the recognition workers, the subscriber callback only queues the frames
+		for (int i = 0; i < number_recognition_workers_; i++)
+			recognition_workers_.create_thread(boost::bind(&FaceRecognizerNode::recognitionWorker, this));
+		queue_status_timer_ = node_handle_.createTimer(ros::Duration(1.0), &FaceRecognizerNode::publishQueueStatus, this);
 
 		// subscribe to head detection topic
-		face_position_subscriber_ = nh.subscribe("face_positions", 1, &FaceRecognizerNode::facePositionsCallback, this);
+		face_position_subscriber_ = nh.subscribe("face_positions", recognition_queue_size_, &FaceRecognizerNode::facePositionsCallback, this);
+
+		// identities of the tracked faces for the recognition scheduling
+		if (schedule_track_recognition_ == true)
+			track_identity_subscriber_ = nh.subscribe("track_identities", 1, &FaceRecognizerNode::trackIdentitiesCallback, this);
 
 		// launch LoadModel server
 		load_model_server_ = new LoadModelServer(node_handle_, "load_model_server", boost::bind(&FaceRecognizerNode::loadModelServerCallback, this, _1), false);
 		load_model_server_->start();
 
+		// verification of a single identity
+		verification_target_server_ = node_handle_.advertiseService("set_verification_target", &FaceRecognizerNode::setVerificationTargetCallback, this);
+		if (verification_target_parameter_.empty() == false)
+			verification_target_timer_ = node_handle_.createTimer(ros::Duration(0.5), &FaceRecognizerNode::checkVerificationTargetParameter, this);
+
 		ROS_INFO("FaceRecognizerNode initialized.");
 	}
 }
 
 FaceRecognizerNode::~FaceRecognizerNode(void)
 {
+	{
+		boost::lock_guard<boost::mutex> lock(queue_mutex_);
+		shutdown_ = true;
+	}
+	queue_condition_.notify_all();
+	recognition_workers_.join_all();
+
 	if (load_model_server_ != 0)
 		delete load_model_server_;
 }
@@ -366,6 +458,243 @@ void voidDeleter(const sensor_msgs::Image* const )
 //	face_recognition_publisher_.publish(detection_msg);
 //}
 void FaceRecognizerNode::facePositionsCallback(const cob_perception_msgs::ColorDepthImageArray::ConstPtr& face_positions)
+{
+	{
+		boost::lock_guard<boost::mutex> lock(queue_mutex_);
+		frames_received_++;
+		if (queue_policy_ == KEEP_LATEST)
+		{
+			// the new frame replaces all waiting frames
+			frames_dropped_ += frame_queue_.size();
+			frame_queue_.clear();
+		}
+		else if ((int)frame_queue_.size() >= recognition_queue_size_)
+		{
+			frame_queue_.pop_front();
+			frames_dropped_++;
+		}
+		frame_queue_.push_back(face_positions);
+	}
+	queue_condition_.notify_one();
+}
+
+void FaceRecognizerNode::recognitionWorker()
+{
+	while (true)
+	{
+		// frames are taken in the order of the queue, the sequence number restores this order for publishing
+		cob_perception_msgs::ColorDepthImageArray::ConstPtr face_positions;
+		unsigned long sequence;
+		{
+			boost::unique_lock<boost::mutex> lock(queue_mutex_);
+			while (frame_queue_.empty() == true && shutdown_ == false)
+				queue_condition_.wait(lock);
+			if (shutdown_ == true)
+				return;
+			face_positions = frame_queue_.front();
+			frame_queue_.pop_front();
+			sequence = next_sequence_++;
+			busy_workers_++;
+		}
+
+		cob_perception_msgs::DetectionArray detection_msg;
+		bool valid = recognizeFrame(face_positions, detection_msg);
+		publishInOrder(sequence, detection_msg, valid);
+
+		boost::lock_guard<boost::mutex> lock(queue_mutex_);
+		busy_workers_--;
+	}
+}
+
+void FaceRecognizerNode::publishInOrder(unsigned long sequence, const cob_perception_msgs::DetectionArray& detection_msg, bool valid)
+{
+	boost::lock_guard<boost::mutex> lock(publish_mutex_);
+	pending_results_[sequence] = std::make_pair(valid, detection_msg);
+
+	// publish all results whose older frames are done
+	std::map<unsigned long, std::pair<bool, cob_perception_msgs::DetectionArray> >::iterator it = pending_results_.begin();
+	while (it != pending_results_.end() && it->first == next_published_sequence_)
+	{
+		if (it->second.first == true)
+		{
+			// frames that arrived out of order are not published after a newer frame
+			if (it->second.second.header.stamp < last_published_stamp_)
+				frames_late_++;
+			else
+			{
+				face_recognition_publisher_.publish(it->second.second);
+				last_published_stamp_ = it->second.second.header.stamp;
+				frames_published_++;
+			}
+		}
+		pending_results_.erase(it++);
+		next_published_sequence_++;
+	}
+}
+
+void FaceRecognizerNode::publishQueueStatus(const ros::TimerEvent& event)
+{
+	cob_people_detection::RecognitionQueueStatus status;
+	status.header.stamp = ros::Time::now();
+	status.queue_size = recognition_queue_size_;
+	status.workers = number_recognition_workers_;
+	{
+		boost::lock_guard<boost::mutex> lock(queue_mutex_);
+		status.queue_depth = frame_queue_.size();
+		status.busy_workers = busy_workers_;
+		status.frames_received = frames_received_;
+		status.frames_dropped = frames_dropped_;
+		status.faces_detected = faces_detected_;
+		status.faces_recognized = faces_recognized_;
+	}
+	{
+		boost::lock_guard<boost::mutex> lock(publish_mutex_);
+		status.frames_late = frames_late_;
+		status.frames_published = frames_published_;
+	}
+	queue_status_publisher_.publish(status);
+}
+
+void FaceRecognizerNode::trackIdentitiesCallback(const cob_people_detection::TrackIdentities::ConstPtr& track_identities)
+{
+	boost::lock_guard<boost::mutex> lock(track_mutex_);
+	track_identities_ = track_identities;
+
+	// forget the tracks that have ended
+	std::map<unsigned int, ros::Time> track_recognition_times;
+	for (int t = 0; t < (int)track_identities->tracks.size(); t++)
+	{
+		std::map<unsigned int, ros::Time>::iterator it = track_recognition_times_.find(track_identities->tracks[t].track_id);
+		if (it != track_recognition_times_.end())
+			track_recognition_times.insert(*it);
+	}
+	track_recognition_times_.swap(track_recognition_times);
+	std::set<unsigned int> disputed_tracks;
+	for (int t = 0; t < (int)track_identities->tracks.size(); t++)
+		if (disputed_tracks_.count(track_identities->tracks[t].track_id) > 0)
+			disputed_tracks.insert(track_identities->tracks[t].track_id);
+	disputed_tracks_.swap(disputed_tracks);
+}
+
+void FaceRecognizerNode::scheduleFaces(std::vector<cv::Mat>& heads_depth_images, const std::vector<std::vector<cv::Rect> >& face_bounding_boxes,
+		const ros::Time& stamp, std::vector<std::vector<std::string> >& track_labels, std::vector<std::vector<std::pair<int, std::string> > >& face_tracks)
+{
+	track_labels.resize(face_bounding_boxes.size());
+	face_tracks.resize(face_bounding_boxes.size());
+	for (int i = 0; i < (int)face_bounding_boxes.size(); i++)
+	{
+		track_labels[i].assign(face_bounding_boxes[i].size(), "");
+		face_tracks[i].assign(face_bounding_boxes[i].size(), std::make_pair(-1, std::string()));
+	}
+
+	boost::lock_guard<boost::mutex> lock(track_mutex_);
+	// without current track identities all faces are recognized
+	if (!track_identities_ || (stamp - track_identities_->header.stamp).toSec() > track_reverification_interval_)
+		return;
+	const std::vector<cob_people_detection::TrackIdentity>& tracks = track_identities_->tracks;
+
+	std::vector<bool> track_assigned(tracks.size(), false);
+	int recognitions = 0;
+	std::vector<std::pair<double, int> > due_faces; // age of the last recognition, index into due_positions and due_track_ids
+	std::vector<std::pair<int, int> > due_positions; // head and face index
+	std::vector<unsigned int> due_track_ids;
+	for (int i = 0; i < (int)face_bounding_boxes.size(); i++)
+	{
+		for (int j = 0; j < (int)face_bounding_boxes[i].size(); j++)
+		{
+			// faces without a valid 3D position are not published at all
+			const cv::Rect& face_bb = face_bounding_boxes[i][j];
+			geometry_msgs::Point position;
+			if (determine3DFaceCoordinates(heads_depth_images[i], face_bb.x + 0.5 * (float)face_bb.width, face_bb.y + 0.5 * (float)face_bb.height, position, 6) == false)
+			{
+				track_labels[i][j] = "Unknown";
+				continue;
+			}
+
+			// closest track that is not assigned to another face yet
+			int track = -1;
+			double min_distance = track_association_range_m_;
+			for (int t = 0; t < (int)tracks.size(); t++)
+			{
+				double dx = tracks[t].position.x - position.x, dy = tracks[t].position.y - position.y, dz = tracks[t].position.z - position.z;
+				double distance = sqrt(dx * dx + dy * dy + dz * dz);
+				if (track_assigned[t] == false && distance < min_distance)
+				{
+					track = t;
+					min_distance = distance;
+				}
+			}
+
+			// new, unknown and uncertain tracks are always recognized
+			if (track == -1)
+			{
+				recognitions++;
+				continue;
+			}
+			track_assigned[track] = true;
+			const cob_people_detection::TrackIdentity& identity = tracks[track];
+			if (identity.label == "Unknown" || identity.label == "UnknownHead" || identity.confidence < track_identity_min_confidence_)
+			{
+				track_recognition_times_[identity.track_id] = stamp;
+				recognitions++;
+				continue;
+			}
+
+			// a track whose face was recognized as another person is recognized until the tracker follows the recognition
+			face_tracks[i][j] = std::make_pair((int)identity.track_id, identity.label);
+			if (disputed_tracks_.count(identity.track_id) > 0)
+			{
+				track_recognition_times_[identity.track_id] = stamp;
+				recognitions++;
+				continue;
+			}
+
+			// identified tracks keep their label until the re-verification is due
+			track_labels[i][j] = identity.label;
+			std::map<unsigned int, ros::Time>::iterator last_recognition = track_recognition_times_.find(identity.track_id);
+			double age = (last_recognition == track_recognition_times_.end()) ? DBL_MAX : (stamp - last_recognition->second).toSec();
+			if (age >= track_reverification_interval_)
+			{
+				due_faces.push_back(std::make_pair(age, (int)due_positions.size()));
+				due_positions.push_back(std::make_pair(i, j));
+				due_track_ids.push_back(identity.track_id);
+			}
+		}
+	}
+
+	// the longest unverified tracks first, up to the limit of recognitions per frame
+	std::sort(due_faces.begin(), due_faces.end(), std::greater<std::pair<double, int> >());
+	for (int k = 0; k < (int)due_faces.size(); k++)
+	{
+		if (max_recognitions_per_frame_ > 0 && recognitions >= max_recognitions_per_frame_)
+			break;
+		const std::pair<int, int>& face = due_positions[due_faces[k].second];
+		track_labels[face.first][face.second] = "";
+		track_recognition_times_[due_track_ids[due_faces[k].second]] = stamp;
+		recognitions++;
+	}
+}
+
+void FaceRecognizerNode::updateDisputedTracks(const std::vector<std::vector<std::pair<int, std::string> > >& face_tracks,
+		const std::vector<std::vector<std::string> >& track_labels, const std::vector<std::vector<std::string> >& identification_labels)
+{
+	boost::lock_guard<boost::mutex> lock(track_mutex_);
+	for (int i = 0; i < (int)face_tracks.size(); i++)
+	{
+		for (int j = 0; j < (int)face_tracks[i].size(); j++)
+		{
+			// only recognized faces of identified tracks
+			if (face_tracks[i][j].first < 0 || track_labels[i][j].empty() == false)
+				continue;
+			if (identification_labels[i][j] == face_tracks[i][j].second)
+				disputed_tracks_.erase(face_tracks[i][j].first);
+			else
+				disputed_tracks_.insert(face_tracks[i][j].first);
+		}
+	}
+}
+
+bool FaceRecognizerNode::recognizeFrame(const cob_perception_msgs::ColorDepthImageArray::ConstPtr& face_positions, cob_perception_msgs::DetectionArray& detection_msg)
 {
 	//	Timer tim;
 	//	tim.start();
@@ -395,7 +724,7 @@ void FaceRecognizerNode::facePositionsCallback(const cob_perception_msgs::ColorD
 			} catch (cv_bridge::Exception& e)
 			{
 				ROS_ERROR("cv_bridge exception: %s", e.what());
-				return;
+				return false;
 			}
 			heads_color_images[i] = cv_ptr->image;
 		}
@@ -408,7 +737,7 @@ void FaceRecognizerNode::facePositionsCallback(const cob_perception_msgs::ColorD
 		} catch (cv_bridge::Exception& e)
 		{
 			ROS_ERROR("cv_bridge exception: %s", e.what());
-			return;
+			return false;
 		}
 		heads_depth_images[i] = cv_ptr->image;
 
@@ -429,15 +758,59 @@ void FaceRecognizerNode::facePositionsCallback(const cob_perception_msgs::ColorD
 
 	// --- face recognition ---
 	std::vector<std::vector<std::string> > identification_labels;
+	std::vector<std::vector<double> > verification_distances;
 	bool identification_failed = false;
-	if (enable_face_recognition_ == true)
+	std::string verification_label;
+	{
+		boost::lock_guard<boost::mutex> lock(verification_mutex_);
+		verification_label = verification_label_;
+	}
+
+	// faces of tracks that are identified with high confidence are not recognized in every frame
+	std::vector<std::vector<std::string> > track_labels;
+	std::vector<std::vector<std::pair<int, std::string> > > face_tracks;
+	std::vector<std::vector<cv::Rect> > faces_to_recognize = face_bounding_boxes;
+	if (enable_face_recognition_ == true && schedule_track_recognition_ == true)
+	{
+		scheduleFaces(heads_depth_images, face_bounding_boxes, face_positions->header.stamp, track_labels, face_tracks);
+		for (int i = 0; i < (int)faces_to_recognize.size(); i++)
+		{
+			faces_to_recognize[i].clear();
+			for (int j = 0; j < (int)face_bounding_boxes[i].size(); j++)
+				if (track_labels[i][j].empty() == true)
+					faces_to_recognize[i].push_back(face_bounding_boxes[i][j]);
+		}
+	}
+	{
+		boost::lock_guard<boost::mutex> lock(queue_mutex_);
+		for (int i = 0; i < (int)face_bounding_boxes.size(); i++)
+		{
+			faces_detected_ += face_bounding_boxes[i].size();
+			if (enable_face_recognition_ == true)
+				faces_recognized_ += faces_to_recognize[i].size();
+		}
+	}
+
+	bool verification = false;
+	if (enable_face_recognition_ == true && verification_label.empty() == false)
+	{
+		// verification mode: every face is only compared to the training images of the verified identity
+		unsigned long result_state = face_recognizer_.verifyFaces(heads_color_images, heads_depth_images, faces_to_recognize, verification_label,
+				verification_threshold_, identification_labels, verification_distances);
+		if (result_state == ipa_Utils::RET_OK)
+			verification = true;
+		else
+			ROS_WARN_THROTTLE(5.0, "FaceRecognizerNode::face_positions_callback: Verification of %s failed, the faces are recognized against the whole gallery.",
+					verification_label.c_str());
+	}
+	if (enable_face_recognition_ == true && verification == false)
 	{
 		// recognize faces
 		//unsigned long result_state = face_recognizer_.recognizeFaces(heads_color_images, face_bounding_boxes, identification_labels);
 
 		//timeval t1,t2;
 		//gettimeofday(&t1,NULL);
-		unsigned long result_state = face_recognizer_.recognizeFaces(heads_color_images, heads_depth_images, face_bounding_boxes, identification_labels);
+		unsigned long result_state = face_recognizer_.recognizeFaces(heads_color_images, heads_depth_images, faces_to_recognize, identification_labels);
 		//gettimeofday(&t2,NULL);
 		//std::cout<<(t2.tv_sec - t1.tv_sec) * 1000.0<<std::endl;
 		if (result_state == ipa_Utils::RET_FAILED)
@@ -449,6 +822,7 @@ void FaceRecognizerNode::facePositionsCallback(const cob_perception_msgs::ColorD
 	if (enable_face_recognition_ == false || identification_failed == true)
 	{
 		// label all image unknown if face recognition disabled
+		track_labels.clear();
 		identification_labels.resize(face_positions->head_detections.size());
 		for (uint i = 0; i < identification_labels.size(); i++)
 		{
@@ -457,9 +831,34 @@ void FaceRecognizerNode::facePositionsCallback(const cob_perception_msgs::ColorD
 				identification_labels[i][j] = "Unknown";
 		}
 	}
+	else if (track_labels.size() > 0)
+	{
+		// faces that were not recognized take the label of their track, their verification distance is unknown (-1)
+		for (int i = 0; i < (int)track_labels.size(); i++)
+		{
+			std::vector<std::string> labels(track_labels[i].size());
+			std::vector<double> distances(track_labels[i].size(), -1.);
+			int k = 0;
+			for (int j = 0; j < (int)track_labels[i].size(); j++)
+			{
+				if (track_labels[i][j].empty() == true)
+				{
+					labels[j] = identification_labels[i][k];
+					if (verification == true)
+						distances[j] = verification_distances[i][k];
+					k++;
+				}
+				else
+					labels[j] = track_labels[i][j];
+			}
+			identification_labels[i].swap(labels);
+			if (verification == true)
+				verification_distances[i].swap(distances);
+		}
+		updateDisputedTracks(face_tracks, track_labels, identification_labels);
+	}
 
-	// --- publish detection message ---
-	cob_perception_msgs::DetectionArray detection_msg;
+	// --- detection message, it is published in the order of the frames ---
 	detection_msg.header = face_positions->header;
 
 	int counter = 1;
@@ -520,8 +919,11 @@ void FaceRecognizerNode::facePositionsCallback(const cob_perception_msgs::ColorD
 				det.mask.roi.height = face_bb.height;
 				// set label
 				det.label = identification_labels[head][face];
-				// set origin of detection
-				det.detector = "face";
+				// relative distance to the verified identity
+				if (verification == true)
+					det.score = verification_distances[head][face];
+				// set origin of detection, faces that took the label of their track are no recognition results ("track")
+				det.detector = (track_labels.size() > 0 && track_labels[head][face].empty() == false) ? "track" : "face";
 				// header
 				det.header = face_positions->header;
 				// add to message
@@ -530,13 +932,11 @@ void FaceRecognizerNode::facePositionsCallback(const cob_perception_msgs::ColorD
 		}
 	}
 
-	// publish message
-	face_recognition_publisher_.publish(detection_msg);
-
 	if (display_timing_ == true)
 		ROS_INFO("%d FaceRecognition: Time stamp of pointcloud message: %f. Delay: %f.", face_positions->header.seq, face_positions->header.stamp.toSec(),
 				ros::Time::now().toSec() - face_positions->header.stamp.toSec());
 	//	ROS_INFO("Face recognition took %f ms", tim.getElapsedTimeInMilliSec());
+	return true;
 }
 
 bool FaceRecognizerNode::determine3DFaceCoordinates(cv::Mat& depth_image, int center2Dx, int center2Dy, geometry_msgs::Point& center3D, int search_radius)
@@ -568,6 +968,62 @@ bool FaceRecognizerNode::determine3DFaceCoordinates(cv::Mat& depth_image, int ce
 	return valid_coordinates;
 }
 
+bool FaceRecognizerNode::setVerificationTargetCallback(cob_people_detection::setVerificationTarget::Request &req,
+		cob_people_detection::setVerificationTarget::Response &res)
+{
+	res.success = setVerificationTarget(req.label);
+	if (res.success == false)
+		ROS_WARN("FaceRecognizerNode::setVerificationTargetCallback: The recognition model does not contain %s, the verification target is not changed.",
+				req.label.c_str());
+	return true;
+}
+
+void FaceRecognizerNode::checkVerificationTargetParameter(const ros::TimerEvent& event)
+{
+	// an unset parameter ends the verification, e.g. at the end of an escort session
+	std::string value;
+	if (ros::param::getCached(verification_target_parameter_, value) == false)
+		value = "";
+	if (verification_target_prefix_.empty() == false && value.compare(0, verification_target_prefix_.size(), verification_target_prefix_) == 0)
+		value.erase(0, verification_target_prefix_.size());
+	bool changed = (value != verification_parameter_value_);
+	if (changed == false && verification_parameter_pending_ == false)
+		return;
+	verification_parameter_value_ = value;
+
+	// a label that is not served yet (e.g. a model without the user is still loaded) is recognized against the whole gallery
+	// until a model serves it, the missing label is only reported when the parameter changes
+	verification_parameter_pending_ = (setVerificationTarget(value) == false);
+	if (verification_parameter_pending_ == true && changed == true)
+	{
+		ROS_WARN("FaceRecognizerNode::checkVerificationTargetParameter: The recognition model does not contain %s, the faces are recognized against the whole gallery until it does.",
+				value.c_str());
+		setVerificationTarget("");
+	}
+}
+
+bool FaceRecognizerNode::setVerificationTarget(const std::string& label)
+{
+	if (label.empty() == false && face_recognizer_.servesLabel(label) == false)
+		return false;
+
+	boost::lock_guard<boost::mutex> lock(verification_mutex_);
+	if (label == verification_label_)
+		return true;
+	{
+		// the identities of the tracks were determined for the previous target, so all tracks are recognized again
+		boost::lock_guard<boost::mutex> lock(track_mutex_);
+		track_recognition_times_.clear();
+		disputed_tracks_.clear();
+	}
+	verification_label_ = label;
+	if (label.empty() == true)
+		ROS_INFO("FaceRecognizerNode: Faces are recognized against the whole gallery.");
+	else
+		ROS_INFO("FaceRecognizerNode: Faces are verified against %s.", label.c_str());
+	return true;
+}
+
 void FaceRecognizerNode::loadModelServerCallback(const cob_people_detection::loadModelGoalConstPtr& goal)
 {
 	// read list of labels of persons that shall be recognized from goal message
@@ -575,8 +1031,22 @@ void FaceRecognizerNode::loadModelServerCallback(const cob_people_detection::loa
 	for (int i = 0; i < (int)goal->labels.size(); i++)
 		identification_labels_to_recognize[i] = goal->labels[i];
 
-	// load the corresponding recognition model
-	bool result_state = face_recognizer_.loadRecognitionModel(identification_labels_to_recognize);
+	// load the corresponding recognition model on a background thread, the recognition continues with the previous model meanwhile
+	unsigned long result_state = ipa_Utils::RET_FAILED;
+	if (face_recognizer_.startLoadingRecognitionModel(identification_labels_to_recognize) == true)
+	{
+		ros::Rate feedback_rate(5.0);
+		while (face_recognizer_.isLoadingRecognitionModel() == true && ros::ok())
+		{
+			double progress = 0.0;
+			cob_people_detection::loadModelFeedback feedback;
+			face_recognizer_.getTrainingProgress(progress, feedback.status);
+			feedback.progress = progress;
+			load_model_server_->publishFeedback(feedback);
+			feedback_rate.sleep();
+		}
+		result_state = face_recognizer_.finishLoadingRecognitionModel(identification_labels_to_recognize);
+	}
 
 	cob_people_detection::loadModelResult result;
 	if (result_state == ipa_Utils::RET_OK)
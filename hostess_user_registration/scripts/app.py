@@ -292,15 +292,18 @@ def delete_user_entries():
         if client.wait_for_server(timeout=rospy.Duration(10)):
             message = json.loads(request.data)
             
+            # all selected users are removed from the face database with one goal
+            labels = []
             for i in message['utenti']:
                 id_string = '00000000' + str(i)
-                id_string = id_string[-8:]
-                
-                goal=deleteDataGoal(delete_mode=2, label=id_string)
-                
-                client.send_goal(goal)
-                client.wait_for_result()
-                
+                labels.append(id_string[-8:])
+            
+            goal=deleteDataGoal(delete_mode=3, labels=labels)
+            
+            client.send_goal(goal)
+            client.wait_for_result()
+            
+            for i in message['utenti']:
                 user = User.query.filter_by(id=i).first_or_404()
                 
                 with app.app_context():